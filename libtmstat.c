@@ -44,7 +44,9 @@
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -96,8 +98,11 @@ struct tmstat_column {
     uint16_t            size;               //!< Column size.
     uint8_t             type;               //!< Data type.
     uint8_t             rule;               //!< Merge rule.
+    uint8_t             flags;              //!< TM_COL_* flags.
 } __attribute__((packed));
 
+#define TM_COL_DISJOINT 0x01    //!< Table was registered disjoint.
+
 /**
  * Index container--a dynamically-sized array of pointers.
  * Order is not preserved across item removals.
@@ -148,6 +153,8 @@ struct tmstat_label {
     char                name[TM_MAX_NAME+1];    //!< Label name.
     char                ctime[26];              //!< Creation time string.
     time_t              time;                   //!< Creation time in secs.
+    uint8_t             pad[5];                 //!< Align commits.
+    uint64_t            commits;                //!< Change count.
 } __attribute__((packed));
 
 /**
@@ -234,6 +241,64 @@ struct TMSTAT {
     char               *next_page;          //!< Next free page in curr. alloc.
     struct alloc       *allocs;             //!< Allocations for slabs.
     struct timespec     ctime;              //!< Ctime of dir when last read.
+    unsigned            pin_count;          //!< Scans in progress.
+    uint64_t            generation;         //!< Bumped when tables change.
+    uint64_t           *child_gen;          //!< Child generations seen.
+    struct tmstat_pool *pool;               //!< Worker threads, or NULL.
+    char               *select;             //!< Child name pattern, or NULL.
+    struct tmstat_label *label;             //!< Our own label, or NULL.
+    struct tmidx        view_idx;           //!< Cached merged views.
+};
+
+/**
+ * Merge kernels.  Numeric kernels come in groups of four, one per width
+ * (1, 2, 4 and 8 bytes), so that the kernel for a width is the group's
+ * first entry plus log2 of the width.
+ */
+enum tmstat_mop {
+    TMSTAT_MOP_SUM8     = 0,    //!< Sum (same for signed and unsigned).
+    TMSTAT_MOP_SUM16    = 1,
+    TMSTAT_MOP_SUM32    = 2,
+    TMSTAT_MOP_SUM64    = 3,
+    TMSTAT_MOP_MIN_U8   = 4,    //!< Unsigned minimum.
+    TMSTAT_MOP_MIN_U16  = 5,
+    TMSTAT_MOP_MIN_U32  = 6,
+    TMSTAT_MOP_MIN_U64  = 7,
+    TMSTAT_MOP_MIN_S8   = 8,    //!< Signed minimum.
+    TMSTAT_MOP_MIN_S16  = 9,
+    TMSTAT_MOP_MIN_S32  = 10,
+    TMSTAT_MOP_MIN_S64  = 11,
+    TMSTAT_MOP_MAX_U8   = 12,   //!< Unsigned maximum.
+    TMSTAT_MOP_MAX_U16  = 13,
+    TMSTAT_MOP_MAX_U32  = 14,
+    TMSTAT_MOP_MAX_U64  = 15,
+    TMSTAT_MOP_MAX_S8   = 16,   //!< Signed maximum.
+    TMSTAT_MOP_MAX_S16  = 17,
+    TMSTAT_MOP_MAX_S32  = 18,
+    TMSTAT_MOP_MAX_S64  = 19,
+    TMSTAT_MOP_OR       = 20,   //!< Bytewise or.
+    TMSTAT_MOP_MIN_MEM  = 21,   //!< Smallest by memcmp.
+    TMSTAT_MOP_MAX_MEM  = 22,   //!< Largest by memcmp.
+    TMSTAT_MOP_BAD      = 23,   //!< Unsupported column; merging fails.
+};
+
+/**
+ * Vector merge kernel: merge count elements of src into dst.
+ */
+typedef void (*tmstat_vkernel_fn)(uint8_t *dst, const uint8_t *src,
+                                  unsigned count);
+
+/**
+ * One step of a compiled merge plan: a run of adjacent columns sharing a
+ * kernel.
+ */
+struct tmstat_mstep {
+    enum tmstat_mop         op;             //!< Kernel.
+    tmstat_vkernel_fn       vkernel;        //!< Vector kernel, or NULL.
+    unsigned                offset;         //!< Byte offset of run.
+    unsigned                count;          //!< Elements (bytes for OR and
+                                            //!< MEM kernels, column index
+                                            //!< for BAD).
 };
 
 /**
@@ -251,6 +316,10 @@ struct TMTABLE {
     TMCOL                   key_col;        //!< Key column metadata (duped).
     unsigned                key_col_count;  //!< Number of Key columns.
     bool                    want_merge : 1; //!< Table needs row merge pass.
+    bool                    disjoint : 1;   //!< Rows never share a key.
+    TMTABLE                 rollup;         //!< Maintained aggregate, or NULL.
+    struct tmstat_mstep    *merge;          //!< Compiled merge plan.
+    unsigned                merge_count;    //!< Steps in merge plan.
     LIST_HEAD(, TMROW)      row_list;       //!< Row handles.
 };
 
@@ -264,6 +333,22 @@ struct TMROW {
     uint32_t                inode_addr;     //!< Row address.
     TMTABLE                 table;          //!< Parent table.
     bool                    own_row : 1;    //!< This handle owns this row.
+    bool                    in_arena : 1;   //!< Handle lives in an arena.
+    struct tmstat_lazy     *lazy;           //!< Unmerged sources, or NULL.
+};
+
+/**
+ * Sources of a lazily merged row.  The row's data start out as a copy
+ * of the first source; each other column is merged from the rest the
+ * first time it is read.  The sources lie in slabs kept mapped by the
+ * row itself, since a segment with rows outstanding is not refreshed,
+ * but their publishers may still retire them and reuse their slots; a
+ * source no longer holding the row's key is left out.
+ */
+struct tmstat_lazy {
+    bool               *ready;          //!< Columns merged so far.
+    unsigned            src_count;      //!< Source rows.
+    const uint8_t      *src[];          //!< Source row data.
 };
 
 /**
@@ -435,6 +520,7 @@ static THREAD struct TMCOL tm_cols_label[] = {
     TMCOL_TEXT(struct tmstat_label, name),
     TMCOL_TEXT(struct tmstat_label, ctime),
     TMCOL_INT(struct tmstat_label, time,        .rule = TMSTAT_R_MAX),
+    TMCOL_UINT(struct tmstat_label, commits,    .rule = TMSTAT_R_MAX),
 };
 
 /**
@@ -457,46 +543,40 @@ static GLOBALSET uint32_t tmstat_nextid = 1;
  */
 #define TMSTAT_SEGMENT_HEADER "|  +- "
 
-/*
- * The red-black tree implementation herein was adapted from the
- * (public domain) code found at
- * http://eternallyconfuzzled.com/tuts/datastructures/jsw_tut_rbtree.aspx
- * There is a delete routine to be found there; it is not present here
- * because we never delete from our trees.  Note that this
- * implementation is incapable of supporting iteration but is snappy
- * due to the absence of parent pointers.
+/**
+ * Fewest slabs worth splitting across worker threads; smaller scans run
+ * on the calling thread.
  */
+#define TMSTAT_PARALLEL_SLABS   8
 
 /**
- * Red-black search tree node.
+ * Fewest rows worth partitioning across worker threads for a merge.
  */
-struct tmrbt_node {
-    int red;                        /* Node color.  0 = black, 1 = red. */
-    TMROW key;                      /* The node's key. */
-    struct tmrbt_node *link[2];     /* Children.  0 = left, 1 = right. */
-};
-typedef struct tmrbt_node *tmrbt_node;
+#define TMSTAT_PARALLEL_ROWS    4096
+
+/**
+ * Arena chunk size.  Larger requests get a chunk of their own.
+ */
+#define TMSTAT_ARENA_CHUNK  (64 * 1024)
 
 /**
- * A block of nodes allocated by a tmrbt.  This is like a slab in
- * allocator parlance but we don't want to confuse our terminology.
+ * Arena chunk.
  */
-#define TMRBT_SZ_POOL 62
-struct tmrbt_pool {
-    struct tmrbt_node node[TMRBT_SZ_POOL]; /* The goodies. */
-    unsigned c;                     /* Index of next free node. */
-    struct tmrbt_pool *next;        /* The next pool or NULL. */
+struct tmstat_arena_chunk {
+    struct tmstat_arena_chunk *next;    //!< Previously filled chunk.
+    size_t          used;               //!< Bytes handed out.
+    size_t          size;               //!< Bytes available in data.
+    uint8_t         data[] __attribute__((aligned(ROW_ALIGN)));
 };
-typedef struct tmrbt_pool *tmrbt_pool;
 
 /**
- * Red-black search tree.
+ * Arena--a bump allocator whose allocations are all freed at once.
+ * Used to hold the pseudo rows of a result set so that building them
+ * costs a handful of mallocs rather than one per row.
  */
-struct tmrbt {
-    tmrbt_node root;                /* Tree's root node. */
-    tmrbt_pool pool;                /* Our memory allocations. */
+struct tmstat_arena {
+    struct tmstat_arena_chunk *chunk;   //!< Current chunk, or NULL.
 };
-typedef struct tmrbt *tmrbt;
 
 TMTABLE tmstat_table(TMSTAT, char *);
 
@@ -609,205 +689,74 @@ tmidx_count(struct tmidx *idx)
     return idx->c;
 }
 
-static int64_t tmstat_row_cmp(TMROW r1, TMROW r2);
-int tmstat_pseudo_row_create(TMTABLE table, TMROW *row);
-int tmstat_alloc_weak_ref_row(TMTABLE table, struct tmidx *rows, uint8_t *row,
-                              struct tmstat_slab *slab, unsigned line);
-
 /**
- * Allocate a red-black tree node.  We use pools of nodes not to
- * reduce the number of calls to malloc but to make freeing the tree
- * easier; this way, we don't have to walk the tree to free it.  A
- * non-recursive free would be very challenging without an
- * auxiliary data structure because the nodes do not contain parent
- * pointers.
+ * Initialize arena.
+ *
+ * @param[in]   arena   Arena to initialize.
  */
-static tmrbt_node
-tmrbt_node_alloc(tmrbt tree, TMROW key)
-{
-    tmrbt_node node;
-    if (tree->pool->c == TMRBT_SZ_POOL) {
-        tmrbt_pool next = tree->pool;
-        tree->pool = (tmrbt_pool)malloc(sizeof(*tree->pool));
-        if (tree->pool == NULL) {
-            tree->pool = next;
-            return NULL;
-        }
-        tree->pool->next = next;
-        tree->pool->c = 0;
-    }
-    node = &tree->pool->node[tree->pool->c++];
-    node->red = 1;
-    node->key = key;
-    node->link[0] = NULL;
-    node->link[1] = NULL;
-    return node;
-}
-
-static inline int
-tmrbt_is_red(tmrbt_node node)
-{
-    return (node != NULL) && (node->red == 1);
-}
-
-static tmrbt_node
-tmrbt_rot_single(tmrbt_node root, int dir)
-{
-    tmrbt_node save = root->link[!dir];
-
-    root->link[!dir] = save->link[dir];
-    save->link[dir] = root;
-
-    root->red = 1;
-    save->red = 0;
-
-    return save;
-}
-
-static tmrbt_node
-tmrbt_rot_double(tmrbt_node root, int dir)
+static inline void
+tmstat_arena_init(struct tmstat_arena *arena)
 {
-    root->link[!dir] = tmrbt_rot_single(root->link[!dir], !dir);
-    return tmrbt_rot_single(root, dir);
+    arena->chunk = NULL;
 }
 
-static tmrbt
-tmrbt_alloc()
+/**
+ * Allocate from arena.  Allocations are ROW_ALIGN-aligned.
+ *
+ * @param[in]   arena   Arena to allocate from.
+ * @param[in]   size    Bytes required.
+ * @return pointer to memory on success, NULL on failure.
+ */
+static void *
+tmstat_arena_alloc(struct tmstat_arena *arena, size_t size)
 {
-    tmrbt tree;
-    tree = (tmrbt)malloc(sizeof(*tree));
-    if (tree == NULL) {
-        return NULL;
-    }
-    tree->root = NULL;
-    tree->pool = (tmrbt_pool)malloc(sizeof(*tree->pool));
-    if (tree->pool == NULL) {
-        free(tree);
-        return NULL;
-    }
-    tree->pool->c = 0;
-    tree->pool->next = NULL;
-    return tree;
-}
+    struct tmstat_arena_chunk *chunk = arena->chunk;
+    void           *p;
 
-static void
-tmrbt_free(tmrbt tree)
-{
-    if (tree == NULL) return;
-    tmrbt_pool pool = tree->pool;
-    while (pool) {
-        tmrbt_pool next = pool->next;
-        free(pool);
-        pool = next;
-    }
-    free(tree);
-}
+    size = ROUND_UP(size, ROW_ALIGN);
+    if ((chunk == NULL) || (chunk->size - chunk->used < size)) {
+        /* Start a new chunk. */
+        size_t n = TMSTAT_MAX(size, (size_t)TMSTAT_ARENA_CHUNK);
 
-static TMROW
-tmrbt_find(tmrbt tree, TMROW key)
-{
-    tmrbt_node node = tree->root;
-    while (node) {
-        int64_t cmp = tmstat_row_cmp(node->key, key);
-        if (cmp == 0) {
-            return node->key;
+        chunk = (struct tmstat_arena_chunk *)malloc(
+            sizeof(struct tmstat_arena_chunk) + n);
+        if (chunk == NULL) {
+            /* Allocation failure; malloc sets errno. */
+            return NULL;
         }
-        node = node->link[cmp < 0];
+        chunk->next = arena->chunk;
+        chunk->used = 0;
+        chunk->size = n;
+        arena->chunk = chunk;
     }
-    return NULL;
+    p = &chunk->data[chunk->used];
+    chunk->used += size;
+    return p;
 }
 
 /**
- * Red-black search tree insertion.
- *
- * Warning!  On failure, the tree will no longer maintain the
- * red-black properties.
+ * Free everything allocated from arena.
  *
- * @param[in]   tree        Tree to modify.
- * @param[in]   key         Element to insert.
- * @return 0 on success, -1 on failure.
+ * @param[in]   arena   Arena to free.
  */
-static int
-tmrbt_insert(tmrbt tree, TMROW key)
+static void
+tmstat_arena_free(struct tmstat_arena *arena)
 {
-    int ret = 0;
-
-    if (tree->root == NULL) {
-        /* Empty tree case. */
-        tree->root = tmrbt_node_alloc(tree, key);
-        if (tree->root == NULL) {
-            /* Memory exhausted. */
-            ret = -1;
-            goto out;
-        }
-    } else {
-        struct tmrbt_node head = { 0 };     /* False tree root. */
-        tmrbt_node g, t;                    /* Grandparent & parent. */
-        tmrbt_node p, q;                    /* Iterator & parent. */
-        int dir = 0, last;
-        int64_t cmp;
-
-        /* Set up helpers. */
-        t = &head;
-        g = p = NULL;
-        q = t->link[1] = tree->root;
-
-        /* Search down the tree. */
-        for (;;) {
-            if (q == NULL) {
-                /* Insert new node at the bottom. */
-                q = tmrbt_node_alloc(tree, key);
-                if (q == NULL) {
-                    /* Memory exhausted. */
-                    ret = -1;
-                    goto out;
-                }
-                p->link[dir] = q;
-            }
-            else if (tmrbt_is_red(q->link[0]) && tmrbt_is_red(q->link[1])) {
-                /* Color flip. */
-                q->red = 1;
-                q->link[0]->red = 0;
-                q->link[1]->red = 0;
-            }
-
-            /* Fix red violation. */
-            if (tmrbt_is_red(q) && tmrbt_is_red(p)) {
-                int dir2 = t->link[1] == g;
+    struct tmstat_arena_chunk *chunk, *next;
 
-                if (q == p->link[last])
-                    t->link[dir2] = tmrbt_rot_single(g, !last);
-                else
-                    t->link[dir2] = tmrbt_rot_double(g, !last);
-            }
-
-            /* Stop if found. */
-            cmp = tmstat_row_cmp(q->key, key);
-            if (cmp == 0) {
-                break;
-            }
-
-            last = dir;
-            dir = cmp < 0;
-
-            /* Update helpers. */
-            if (g != NULL)
-                t = g;
-            g = p, p = q;
-            q = q->link[dir];
-        }
-
-        /* Update root. */
-        tree->root = head.link[1];
+    for (chunk = arena->chunk; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
     }
-
-    /* Make root black. */
-    tree->root->red = 0;
-
-out:
-    return ret;
+    arena->chunk = NULL;
 }
 
+static int64_t tmstat_data_cmp(TMTABLE table, const uint8_t *d1,
+                               const uint8_t *d2);
+int tmstat_pseudo_row_create(TMTABLE table, TMROW *row);
+int tmstat_alloc_weak_ref_row(TMTABLE table, struct tmidx *rows, uint8_t *row,
+                              struct tmstat_slab *slab, unsigned line);
+
 /**
  * Map a portion of a file.
  *
@@ -1717,6 +1666,7 @@ _tmstat_create(TMSTAT tmstat, char *name)
     tmidx_init(&tmstat->slab_idx);
     tmidx_init(&tmstat->table_idx);
     tmidx_init(&tmstat->child_idx);
+    tmidx_init(&tmstat->view_idx);
 
     if (name != NULL) {
         /*
@@ -1794,6 +1744,7 @@ _tmstat_create(TMSTAT tmstat, char *name)
     snprintf(label->name, sizeof(label->name), "%s", leaf_name);
     snprintf(label->ctime, sizeof(label->ctime), "%s", nowstr);
     label->time = now;
+    tmstat->label = label;
 
     /*
      * Success!
@@ -1873,6 +1824,190 @@ tmstat_publish(TMSTAT stat, char *directory)
     return ret;
 }
 
+/**
+ * Worker thread pool.  The caller posts an array of jobs and runs jobs
+ * alongside the workers until every job has finished.
+ */
+struct tmstat_pool {
+    pthread_mutex_t     lock;           //!< Protects everything below.
+    pthread_cond_t      work;           //!< Signalled when jobs are posted.
+    pthread_cond_t      done;           //!< Signalled when all jobs finish.
+    pthread_t          *thread;         //!< Worker threads.
+    unsigned            thread_count;   //!< Number of worker threads.
+    void              (*fn)(void *);    //!< Job function.
+    uint8_t            *job;            //!< Posted jobs.
+    size_t              job_size;       //!< Size of each job.
+    unsigned            job_count;      //!< Number of jobs posted.
+    unsigned            job_next;       //!< Next job to hand out.
+    unsigned            job_done;       //!< Number of jobs finished.
+    bool                shutdown;       //!< Workers should exit.
+};
+
+/**
+ * Run posted jobs until none are left.  Called with the pool locked;
+ * returns with it locked.
+ *
+ * @param[in]   pool        Pool.
+ */
+static void
+tmstat_pool_drain(struct tmstat_pool *pool)
+{
+    void               *job;
+
+    while (pool->job_next < pool->job_count) {
+        job = &pool->job[pool->job_next++ * pool->job_size];
+        pthread_mutex_unlock(&pool->lock);
+        pool->fn(job);
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->job_done == pool->job_count) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+}
+
+/**
+ * Worker thread body.
+ *
+ * @param[in]   arg         Pool.
+ * @return NULL.
+ */
+static void *
+tmstat_pool_worker(void *arg)
+{
+    struct tmstat_pool *pool = (struct tmstat_pool *)arg;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->shutdown) {
+        if (pool->job_next < pool->job_count) {
+            tmstat_pool_drain(pool);
+        } else {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * Stop and free a worker pool.
+ *
+ * @param[in]   pool        Pool, or NULL.
+ */
+static void
+tmstat_pool_destroy(struct tmstat_pool *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (unsigned i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->thread[i], NULL);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->thread);
+    free(pool);
+}
+
+/**
+ * Start a worker pool.
+ *
+ * @param[in]   thread_count Number of worker threads.
+ * @param[out]  poolp       New pool.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_pool_create(unsigned thread_count, struct tmstat_pool **poolp)
+{
+    struct tmstat_pool *pool;
+    signed              err;
+
+    pool = (struct tmstat_pool *)calloc(1, sizeof(struct tmstat_pool));
+    if (pool == NULL) {
+        /* Allocation failure; calloc sets errno. */
+        return -1;
+    }
+    pool->thread = (pthread_t *)calloc(thread_count, sizeof(pthread_t));
+    if (pool->thread == NULL) {
+        /* Allocation failure; calloc sets errno. */
+        free(pool);
+        return -1;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    for (unsigned i = 0; i < thread_count; i++) {
+        err = pthread_create(&pool->thread[i], NULL, tmstat_pool_worker,
+                             pool);
+        if (err != 0) {
+            /* Keep what we have; tear it down and report the failure. */
+            tmstat_pool_destroy(pool);
+            errno = err;
+            return -1;
+        }
+        pool->thread_count++;
+    }
+    *poolp = pool;
+    return 0;
+}
+
+/**
+ * Run jobs across the pool and the calling thread, returning once all
+ * of them have finished.
+ *
+ * @param[in]   pool        Pool.
+ * @param[in]   fn          Job function.
+ * @param       job         Job array; each element is passed to fn.
+ * @param[in]   job_size    Size of each job.
+ * @param[in]   job_count   Number of jobs.
+ */
+static void
+tmstat_pool_run(struct tmstat_pool *pool, void (*fn)(void *), void *job,
+                size_t job_size, unsigned job_count)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->job = (uint8_t *)job;
+    pool->job_size = job_size;
+    pool->job_count = job_count;
+    pool->job_next = 0;
+    pool->job_done = 0;
+    pthread_cond_broadcast(&pool->work);
+    tmstat_pool_drain(pool);
+    while (pool->job_done < pool->job_count) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    /* Nothing left for workers to pick up. */
+    pool->job_count = 0;
+    pool->job_next = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Set the number of threads used to scan large tables.
+ */
+int
+tmstat_set_threads(TMSTAT stat, unsigned threads)
+{
+    struct tmstat_pool *pool = NULL;
+
+    if ((threads > 1) &&
+        (tmstat_pool_create(threads - 1, &pool) != 0)) {
+        /* tmstat_pool_create sets errno. */
+        return -1;
+    }
+    tmstat_pool_destroy(stat->pool);
+    stat->pool = pool;
+    return 0;
+}
+
+struct tmstat_view;
+static void tmstat_view_free(struct tmstat_view *view);
+
 /**
  * Free in-process resources for a segment without freeing the
  * struct TMSTAT itself.
@@ -1883,11 +2018,21 @@ _tmstat_dealloc(TMSTAT stat)
     TMTABLE             table;
     TMSTAT              child;
     TMROW               row;
+    struct tmstat_view *view;
 
     if (stat == NULL) {
         return;
     }
 
+    /*
+     * Free cached views.
+     */
+    free(stat->child_gen);
+    TMIDX_FOREACH(&stat->view_idx, view) {
+        tmstat_view_free(view);
+    }
+    tmidx_free(&stat->view_idx);
+
     /*
      * Free tables.
      */
@@ -1927,6 +2072,7 @@ _tmstat_dealloc(TMSTAT stat)
         }
         free(table->col);
         free(table->key_col);
+        free(table->merge);
         free(table);
     }
 
@@ -1962,10 +2108,51 @@ _tmstat_dealloc(TMSTAT stat)
 void
 tmstat_dealloc(TMSTAT stat)
 {
+    if (stat != NULL) {
+        tmstat_pool_destroy(stat->pool);
+        free(stat->select);
+    }
     _tmstat_dealloc(stat);
     free(stat);
 }
 
+static int tmstat_rollup_fold(TMSTAT stat);
+
+/*
+ * Announce that a segment's rows have been updated.
+ */
+int
+tmstat_commit(TMSTAT stat)
+{
+    if ((stat->origin != CREATE) || (stat->label == NULL)) {
+        /* Only a writer's rows change. */
+        errno = EINVAL;
+        return -1;
+    }
+    if (tmstat_rollup_fold(stat) != 0) {
+        /* tmstat_rollup_fold sets errno. */
+        return -1;
+    }
+    /* Make the row updates visible before the count that announces them. */
+    __atomic_add_fetch(&stat->label->commits, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * Announce that rows have come or gone, as tmstat_commit does for
+ * updates.  Does nothing for a segment that does not count its commits.
+ *
+ * @param[in]   stat        Segment.
+ */
+static void
+tmstat_label_bump(TMSTAT stat)
+{
+    if ((stat->origin == CREATE) && (stat->label != NULL)) {
+        /* Release, not a full barrier: this runs on every row change. */
+        __atomic_add_fetch(&stat->label->commits, 1, __ATOMIC_RELEASE);
+    }
+}
+
 /**
  * Attempt to remove the segment from the filesystem.
  */
@@ -2051,6 +2238,16 @@ known_table: ;
              * because it is exposed through tmstat_is_table_sorted.
              */
             table->td->is_sorted = child_table->td->is_sorted && one_child;
+            /* Keys stay disjoint only if every child promises so. */
+            table->disjoint = true;
+            TMIDX_FOREACH(&stat->child_idx, child) {
+                TMTABLE t = tmstat_table(child, child_table->td->name);
+
+                if ((t != NULL) && !t->disjoint) {
+                    table->disjoint = false;
+                }
+            }
+            table->want_merge &= !table->disjoint;
         }
     }
     ret = 0;
@@ -2165,7 +2362,7 @@ out:
 }
 
 /*
- * As a favor to tmstat_row_cmp, copy key column definitions into
+ * As a favor to tmstat_data_cmp, copy key column definitions into
  * their own little space.
  *
  * @param[in]   tmtable     The table to operate on.
@@ -2193,47 +2390,288 @@ tmstat_pull_key_cols(TMTABLE tmtable)
     return 0;
 }
 
+#if defined(__x86_64__) && defined(__GNUC__)
 /*
- * Pick up the column descriptors from one slab.
+ * Vector merge kernels.  Each is built for SSE2 (which every x86-64 has),
+ * AVX2 and AVX-512; tmstat_vkernel picks among them at run time.  VEXPR
+ * merges whole vectors x and y, SEXPR the scalars left at the end.
+ */
+#define TMSTAT_VSEL(m, a, b)    (((a) & (vec)(m)) | ((b) & ~(vec)(m)))
+#define TMSTAT_VKERNEL(name, isa, bytes, type, vexpr, sexpr)                \
+static __attribute__((target(isa))) void                                    \
+name(uint8_t *dst, const uint8_t *src, unsigned count)                      \
+{                                                                           \
+    typedef type        vec __attribute__((vector_size(bytes)));           \
+    const unsigned      n = (bytes) / sizeof(type);                         \
+    vec                 x, y;                                               \
+    unsigned            i;                                                  \
+                                                                            \
+    for (i = 0; i + n <= count; i += n) {                                   \
+        memcpy(&x, &dst[i * sizeof(type)], sizeof(x));                      \
+        memcpy(&y, &src[i * sizeof(type)], sizeof(y));                      \
+        x = (vexpr);                                                        \
+        memcpy(&dst[i * sizeof(type)], &x, sizeof(x));                      \
+    }                                                                       \
+    for (; i < count; i++) {                                                \
+        type            x1 = ((type *)dst)[i];                              \
+        type            y1 = ((const type *)src)[i];                        \
+        ((type *)dst)[i] = (sexpr);                                         \
+    }                                                                       \
+}
+#define TMSTAT_VKERNELS(isa, bytes, sfx)                                    \
+    TMSTAT_VKERNEL(tmstat_vsum32_##sfx, isa, bytes, uint32_t,               \
+                   x + y, x1 + y1)                                          \
+    TMSTAT_VKERNEL(tmstat_vsum64_##sfx, isa, bytes, uint64_t,               \
+                   x + y, x1 + y1)                                          \
+    TMSTAT_VKERNEL(tmstat_vmin_u32_##sfx, isa, bytes, uint32_t,             \
+                   TMSTAT_VSEL(x < y, x, y), TMSTAT_MIN(x1, y1))            \
+    TMSTAT_VKERNEL(tmstat_vmin_u64_##sfx, isa, bytes, uint64_t,             \
+                   TMSTAT_VSEL(x < y, x, y), TMSTAT_MIN(x1, y1))            \
+    TMSTAT_VKERNEL(tmstat_vmin_s32_##sfx, isa, bytes, int32_t,              \
+                   TMSTAT_VSEL(x < y, x, y), TMSTAT_MIN(x1, y1))            \
+    TMSTAT_VKERNEL(tmstat_vmin_s64_##sfx, isa, bytes, int64_t,              \
+                   TMSTAT_VSEL(x < y, x, y), TMSTAT_MIN(x1, y1))            \
+    TMSTAT_VKERNEL(tmstat_vmax_u32_##sfx, isa, bytes, uint32_t,             \
+                   TMSTAT_VSEL(x > y, x, y), TMSTAT_MAX(x1, y1))            \
+    TMSTAT_VKERNEL(tmstat_vmax_u64_##sfx, isa, bytes, uint64_t,             \
+                   TMSTAT_VSEL(x > y, x, y), TMSTAT_MAX(x1, y1))            \
+    TMSTAT_VKERNEL(tmstat_vmax_s32_##sfx, isa, bytes, int32_t,              \
+                   TMSTAT_VSEL(x > y, x, y), TMSTAT_MAX(x1, y1))            \
+    TMSTAT_VKERNEL(tmstat_vmax_s64_##sfx, isa, bytes, int64_t,              \
+                   TMSTAT_VSEL(x > y, x, y), TMSTAT_MAX(x1, y1))            \
+    TMSTAT_VKERNEL(tmstat_vor_##sfx, isa, bytes, uint8_t,                   \
+                   x | y, x1 | y1)                                          \
+    static const tmstat_vkernel_fn tmstat_vkernels_##sfx[] = {              \
+        [TMSTAT_MOP_SUM32]      = tmstat_vsum32_##sfx,                      \
+        [TMSTAT_MOP_SUM64]      = tmstat_vsum64_##sfx,                      \
+        [TMSTAT_MOP_MIN_U32]    = tmstat_vmin_u32_##sfx,                    \
+        [TMSTAT_MOP_MIN_U64]    = tmstat_vmin_u64_##sfx,                    \
+        [TMSTAT_MOP_MIN_S32]    = tmstat_vmin_s32_##sfx,                    \
+        [TMSTAT_MOP_MIN_S64]    = tmstat_vmin_s64_##sfx,                    \
+        [TMSTAT_MOP_MAX_U32]    = tmstat_vmax_u32_##sfx,                    \
+        [TMSTAT_MOP_MAX_U64]    = tmstat_vmax_u64_##sfx,                    \
+        [TMSTAT_MOP_MAX_S32]    = tmstat_vmax_s32_##sfx,                    \
+        [TMSTAT_MOP_MAX_S64]    = tmstat_vmax_s64_##sfx,                    \
+        [TMSTAT_MOP_OR]         = tmstat_vor_##sfx,                         \
+    };
+
+TMSTAT_VKERNELS("sse2", 16, sse2)
+TMSTAT_VKERNELS("avx2", 32, avx2)
+TMSTAT_VKERNELS("avx512f", 64, avx512)
+
+/*
+ * Choose a vector kernel for a merge run: the one for the widest
+ * instruction set that both the CPU supports and the run fills.
  *
- * @param[in]   stat        Associated segment.
- * @param[in]   slab        Source slab.
- * @return 0 on success, -1 on failure.
+ * @param[in]   op          Scalar kernel.
+ * @param[in]   bytes       Length of run.
+ * @return kernel, or NULL if the run is better merged a scalar at a time.
+ */
+static tmstat_vkernel_fn
+tmstat_vkernel(enum tmstat_mop op, unsigned bytes)
+{
+    if (op > TMSTAT_MOP_OR) {
+        return NULL;
+    }
+    __builtin_cpu_init();
+    if ((bytes >= 64) && __builtin_cpu_supports("avx512f")) {
+        return tmstat_vkernels_avx512[op];
+    }
+    if ((bytes >= 32) && __builtin_cpu_supports("avx2")) {
+        return tmstat_vkernels_avx2[op];
+    }
+    if (bytes >= 16) {
+        return tmstat_vkernels_sse2[op];
+    }
+    return NULL;
+}
+#else
+/*
+ * No vector kernels for this architecture.
+ */
+static tmstat_vkernel_fn
+tmstat_vkernel(enum tmstat_mop op, unsigned bytes)
+{
+    return NULL;
+}
+#endif
+
+/*
+ * Order columns by offset, for tmstat_compile_merge.
  */
 static int
-tmstat_subscribe_cols(TMSTAT stat, struct tmstat_slab *slab)
+tmstat_col_offset_cmp(const void *a, const void *b)
 {
-    unsigned                rowno;
-    struct tmstat_column   *column;
-    TMTABLE                 tmtable;
-    TMCOL                   tmcol;
-    signed                  ret;
+    TMCOL               c1 = *(TMCOL const *)a;
+    TMCOL               c2 = *(TMCOL const *)b;
 
-    TMSTAT_SLAB_FOREACH(stat, slab, rowno, column) {
-        /* Construct TMCOL from column descriptor. */
-        tmtable = (TMTABLE)tmidx_entry(&stat->table_idx, column->tableid);
-        if (tmtable == NULL) {
-            /* Missing column descriptor table; bail. */
-            errno = ENOENT;
-            return -1;
-            goto out;
+    return (c1->offset > c2->offset) - (c1->offset < c2->offset);
+}
+
+/*
+ * Choose the merge kernel for a column.
+ *
+ * @param[in]   col         Column.
+ * @return kernel, or TMSTAT_MOP_BAD if the column cannot be merged.
+ */
+static enum tmstat_mop
+tmstat_col_mop(TMCOL col)
+{
+    enum tmstat_mop     base;
+    unsigned            width;
+
+    switch (col->rule) {
+    case TMSTAT_R_OR:
+        return TMSTAT_MOP_OR;
+    case TMSTAT_R_SUM:
+        base = TMSTAT_MOP_SUM8;
+        break;
+    case TMSTAT_R_MIN:
+        if ((col->type != TMSTAT_T_UNSIGNED) &&
+            (col->type != TMSTAT_T_SIGNED)) {
+            return TMSTAT_MOP_MIN_MEM;
         }
-        if (tmtable->col == NULL) {
-            /* Allocate TMCOL objects. */
-            tmtable->col = (TMCOL)
-                calloc(tmtable->td->cols, sizeof(struct TMCOL));
-            if (tmtable->col == NULL) {
-                /* Allocation failure; calloc sets errno. */
-                ret = -1;
-                goto out;
-            }
+        base = (col->type == TMSTAT_T_SIGNED) ?
+            TMSTAT_MOP_MIN_S8 : TMSTAT_MOP_MIN_U8;
+        break;
+    case TMSTAT_R_MAX:
+        if ((col->type != TMSTAT_T_UNSIGNED) &&
+            (col->type != TMSTAT_T_SIGNED)) {
+            return TMSTAT_MOP_MAX_MEM;
         }
-        assert(tmtable->col_count < tmtable->td->cols);
-        tmcol = &tmtable->col[tmtable->col_count++];
-        tmcol->name = tmstat_name_copy(column->name);
-        if (tmcol->name == NULL) {
-            /* Allocation failure; tmstat_name_copy sets errno. */
-            ret = -1;
+        base = (col->type == TMSTAT_T_SIGNED) ?
+            TMSTAT_MOP_MAX_S8 : TMSTAT_MOP_MAX_U8;
+        break;
+    default:
+        return TMSTAT_MOP_BAD;
+    }
+    for (width = 0; width < 4; width++) {
+        if (col->size == (1u << width)) {
+            return base + width;
+        }
+    }
+    return TMSTAT_MOP_BAD;
+}
+
+/*
+ * Compile the table's merge plan: skip key columns, then walk the rest
+ * in offset order, coalescing adjacent columns that share a kernel into
+ * a single run.
+ *
+ * @param[in]   tmtable     The table to operate on.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_compile_merge(TMTABLE tmtable)
+{
+    TMCOL              *cols;
+    TMCOL               col;
+    struct tmstat_mstep *step;
+    enum tmstat_mop     op;
+    unsigned            i, n = 0, width;
+
+    free(tmtable->merge);
+    tmtable->merge = NULL;
+    tmtable->merge_count = 0;
+    cols = calloc(tmtable->col_count + 1, sizeof(TMCOL));
+    if (cols == NULL) {
+        return -1;
+    }
+    for (i = 0; i < tmtable->col_count; i++) {
+        /* Keys aren't merged, nor are columns with unknown rules. */
+        if ((tmtable->col[i].rule != TMSTAT_R_KEY) &&
+            (tmtable->col[i].rule <= TMSTAT_R_MAX)) {
+            cols[n++] = &tmtable->col[i];
+        }
+    }
+    qsort(cols, n, sizeof(TMCOL), tmstat_col_offset_cmp);
+    /* At most one step per column. */
+    tmtable->merge = calloc(n + 1, sizeof(struct tmstat_mstep));
+    if (tmtable->merge == NULL) {
+        free(cols);
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        col = cols[i];
+        op = tmstat_col_mop(col);
+        if (op < TMSTAT_MOP_OR) {
+            /* Numeric kernels count elements. */
+            width = col->size;
+        } else {
+            /* The others count bytes (or name the column). */
+            width = 1;
+        }
+        if (tmtable->merge_count > 0) {
+            step = &tmtable->merge[tmtable->merge_count - 1];
+            if ((step->op == op) && (op < TMSTAT_MOP_MIN_MEM) &&
+                (step->offset + step->count * width == col->offset)) {
+                /* Extends the previous run. */
+                step->count += col->size / width;
+                continue;
+            }
+        }
+        step = &tmtable->merge[tmtable->merge_count++];
+        step->op = op;
+        step->vkernel = NULL;
+        step->offset = col->offset;
+        if (op == TMSTAT_MOP_BAD) {
+            step->count = col - tmtable->col;
+        } else {
+            step->count = col->size / width;
+        }
+    }
+    free(cols);
+    /* Bind long runs to vector kernels. */
+    for (i = 0; i < tmtable->merge_count; i++) {
+        step = &tmtable->merge[i];
+        width = (step->op < TMSTAT_MOP_OR) ? 1u << (step->op % 4) : 1;
+        step->vkernel = tmstat_vkernel(step->op, step->count * width);
+    }
+    return 0;
+}
+
+/*
+ * Pick up the column descriptors from one slab.
+ *
+ * @param[in]   stat        Associated segment.
+ * @param[in]   slab        Source slab.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_subscribe_cols(TMSTAT stat, struct tmstat_slab *slab)
+{
+    unsigned                rowno;
+    struct tmstat_column   *column;
+    TMTABLE                 tmtable, coltable;
+    TMCOL                   tmcol;
+    signed                  ret;
+
+    coltable = (TMTABLE)tmidx_entry(&stat->table_idx, TM_ID_COLUMN);
+    TMSTAT_SLAB_FOREACH(stat, slab, rowno, column) {
+        /* Construct TMCOL from column descriptor. */
+        tmtable = (TMTABLE)tmidx_entry(&stat->table_idx, column->tableid);
+        if (tmtable == NULL) {
+            /* Missing column descriptor table; bail. */
+            errno = ENOENT;
+            return -1;
+            goto out;
+        }
+        if (tmtable->col == NULL) {
+            /* Allocate TMCOL objects. */
+            tmtable->col = (TMCOL)
+                calloc(tmtable->td->cols, sizeof(struct TMCOL));
+            if (tmtable->col == NULL) {
+                /* Allocation failure; calloc sets errno. */
+                ret = -1;
+                goto out;
+            }
+        }
+        assert(tmtable->col_count < tmtable->td->cols);
+        tmcol = &tmtable->col[tmtable->col_count++];
+        tmcol->name = tmstat_name_copy(column->name);
+        if (tmcol->name == NULL) {
+            /* Allocation failure; tmstat_name_copy sets errno. */
+            ret = -1;
             goto out;
         }
         tmcol->type = column->type;
@@ -2244,8 +2682,15 @@ tmstat_subscribe_cols(TMSTAT stat, struct tmstat_slab *slab)
             /* This table has merge instructions; enable merge pass. */
             tmtable->want_merge = true;
         }
+        if ((coltable->rowsz >= sizeof(struct tmstat_column)) &&
+            (column->flags & TM_COL_DISJOINT)) {
+            tmtable->disjoint = true;
+        }
         if (tmtable->td->cols == tmtable->col_count) {
-            if (tmstat_pull_key_cols(tmtable) != 0) {
+            /* Rows that never share a key are never merged. */
+            tmtable->want_merge &= !tmtable->disjoint;
+            if ((tmstat_pull_key_cols(tmtable) != 0) ||
+                (tmstat_compile_merge(tmtable) != 0)) {
                 ret = -1;
                 goto out;
             }
@@ -2536,6 +2981,8 @@ out:
 }
 
 
+static struct tmstat_label *tmstat_label_root(TMSTAT stat);
+
 /*
  * Subscribe to file.
  *
@@ -2656,6 +3103,11 @@ tmstat_subscribe_file(TMSTAT *stat, int fd, off_t size,
     }
     tmidx_free(&slab_idx);
 
+    /*
+     * Find our own label, so rows need not search for it.
+     */
+    tmstat->label = tmstat_label_root(tmstat);
+
     /*
      * Done.
      */
@@ -2672,10 +3124,11 @@ cleanup:
 }
 
 /*
- * Subscribe to directory.
+ * Subscribe to directory, skipping files whose names do not match
+ * pattern (unless it is NULL).  On success, tmstat owns pattern.
  */
 static int
-_tmstat_subscribe(TMSTAT tmstat, const char *directory)
+_tmstat_subscribe(TMSTAT tmstat, const char *directory, char *pattern)
 {
     struct stat             status;
     DIR                    *dir;
@@ -2711,6 +3164,10 @@ _tmstat_subscribe(TMSTAT tmstat, const char *directory)
             /* Ignore everything starting with '.'. */
             continue;
         }
+        if ((pattern != NULL) && (fnmatch(pattern, dirent->d_name, 0) != 0)) {
+            /* Not selected; never map it. */
+            continue;
+        }
         snprintf(filename, sizeof(filename), "%s/%s", path, dirent->d_name);
         fd = open(filename, O_RDONLY);
         if (fd == -1) {
@@ -2764,6 +3221,7 @@ _tmstat_subscribe(TMSTAT tmstat, const char *directory)
         tmstat->ctime.tv_sec = st.st_ctim.tv_sec;
         tmstat->ctime.tv_nsec = st.st_ctim.tv_nsec;
         tmstat->origin = SUBSCRIBE;
+        tmstat->select = pattern;
         strncpy(tmstat->directory, directory, sizeof(tmstat->directory));
     }
     tmidx_free(&child_idx);
@@ -2776,20 +3234,39 @@ _tmstat_subscribe(TMSTAT tmstat, const char *directory)
  */
 int
 tmstat_subscribe(TMSTAT *stat, char *directory)
+{
+    return tmstat_subscribe_select(stat, directory, NULL);
+}
+
+/*
+ * Subscribe to the segments in directory whose names match pattern.
+ */
+int
+tmstat_subscribe_select(TMSTAT *stat, char *directory, const char *pattern)
 {
     TMSTAT          tmstat;
+    char           *copy = NULL;
     signed          ret;
 
     *stat = NULL;
+    if (pattern != NULL) {
+        copy = strdup(pattern);
+        if (copy == NULL) {
+            /* Memory exhaustion; strdup sets errno. */
+            return -1;
+        }
+    }
     tmstat = (TMSTAT)malloc(sizeof(struct TMSTAT));
     if (tmstat == NULL) {
         /* Memory exhaustion; calloc sets errno. */
+        free(copy);
         return -1;
     }
-    ret = _tmstat_subscribe(tmstat, directory);
+    ret = _tmstat_subscribe(tmstat, directory, copy);
     if (ret == -1) {
         /* Failure; _tmstat_subscribe sets errno. */
         free(tmstat);
+        free(copy);
         return -1;
     }
     *stat = tmstat;
@@ -2929,14 +3406,51 @@ out:
 int
 tmstat_table_register(TMSTAT stat, TMTABLE *table, char *name,
                       TMCOL col, unsigned count, unsigned size)
+{
+    return tmstat_table_register_flags(stat, table, name, col, count, size,
+                                       0);
+}
+
+/**
+ * Column of a maintained aggregate counting the rows folded into it.
+ * Zero means the table was empty or has not been folded yet; either
+ * way the aggregate stands for nothing.
+ */
+#define TMSTAT_ROLLUP_ROWS  "rollup.rows"
+
+/**
+ * Name the table holding a table's maintained aggregate.
+ *
+ * @param[out]  buf         Buffer for the name.
+ * @param[in]   name        Table name.
+ * @return true on success, false if the name would be too long.
+ */
+static bool
+tmstat_rollup_name(char buf[TM_MAX_NAME + 1], const char *name)
+{
+    return (snprintf(buf, TM_MAX_NAME + 1, ".rollup/%s", name) <=
+            TM_MAX_NAME);
+}
+
+/*
+ * Register table, as modified by flags.
+ */
+int
+tmstat_table_register_flags(TMSTAT stat, TMTABLE *table, char *name,
+                            TMCOL col, unsigned count, unsigned size,
+                            unsigned flags)
 {
     TMTABLE                 tmtable = NULL, tdtable, coltable;
+    TMTABLE                 rollup = NULL;
+    TMROW                   row;
     struct tmstat_column   *column;
     unsigned                i, j, ofs;
     signed                  ret;
     uint32_t                inode;
     uint8_t                 fake_row[size];
     uint32_t                colinode[count];
+    char                    rollup_name[TM_MAX_NAME + 1];
+    struct TMCOL            rollup_col[count + 1];
 
     if (stat == NULL || (count > 0 && col == NULL)) {
         errno = EINVAL;
@@ -2996,6 +3510,39 @@ tmstat_table_register(TMSTAT stat, TMTABLE *table, char *name,
         }
     }
 
+    /*
+     * Register the aggregate's table, with its one row, first: there is
+     * no unregistering it should that fail.
+     */
+    if (flags & TMSTAT_TABLE_ROLLUP) {
+        if (!tmstat_rollup_name(rollup_name, name)) {
+            /* Name too long to qualify. */
+            errno = EINVAL;
+            goto fail;
+        }
+        /* The aggregate's row carries its row count after the rest. */
+        memcpy(rollup_col, col, count * sizeof(struct TMCOL));
+        rollup_col[count].name = TMSTAT_ROLLUP_ROWS;
+        rollup_col[count].size = sizeof(uint64_t);
+        rollup_col[count].offset = ROUND_UP(size, ROW_ALIGN);
+        rollup_col[count].type = TMSTAT_T_UNSIGNED;
+        rollup_col[count].rule = TMSTAT_R_SUM;
+        ret = tmstat_table_register(stat, &rollup, rollup_name, rollup_col,
+                                    count + 1, ROUND_UP(size, ROW_ALIGN) +
+                                    sizeof(uint64_t));
+        if (ret != 0) {
+            /* Registration failure; tmstat_table_register sets errno. */
+            goto fail;
+        }
+        ret = tmstat_row_create(stat, rollup, &row);
+        if (ret != 0) {
+            /* Allocation failure; tmstat_row_create sets errno. */
+            goto fail;
+        }
+        tmstat_row_preserve(row);
+        tmstat_row_drop(row);
+    }
+
     /*
      * Allocate table handle.
      */
@@ -3023,10 +3570,12 @@ tmstat_table_register(TMSTAT stat, TMTABLE *table, char *name,
         }
     }
     tmtable->stat = stat;
+    tmtable->rollup = rollup;
     tmtable->tableid = tmidx_add(&stat->table_idx, tmtable);
     tmtable->rowsz = size;
     tmidx_init(&tmtable->avail_idx);
-    if (tmstat_pull_key_cols(tmtable) != 0) {
+    if ((tmstat_pull_key_cols(tmtable) != 0) ||
+        (tmstat_compile_merge(tmtable) != 0)) {
         goto fail;
     }
 
@@ -3091,6 +3640,8 @@ tmstat_table_register(TMSTAT stat, TMTABLE *table, char *name,
             column->rule = col[i].rule;
             column->offset = col[i].offset;
             column->size = col[i].size;
+            column->flags = (flags & TMSTAT_TABLE_DISJOINT) ?
+                TM_COL_DISJOINT : 0;
             if (col[i].rule != TMSTAT_R_KEY) {
                 /* This table has merge instructions; enable merge pass. */
                 tmtable->want_merge = true;
@@ -3098,6 +3649,13 @@ tmstat_table_register(TMSTAT stat, TMTABLE *table, char *name,
         }
         ofs = col[i].offset + col[i].size;
     }
+    if (flags & TMSTAT_TABLE_DISJOINT) {
+        /* Rows that never share a key are never merged. */
+        tmtable->disjoint = true;
+        tmtable->want_merge = false;
+    }
+    /* Prepared queries must notice the new table. */
+    stat->generation++;
     goto out;
 
     /*
@@ -3115,6 +3673,8 @@ fail:
             free(tmtable->col[i].name);
         }
         free(tmtable->col);
+        free(tmtable->key_col);
+        free(tmtable->merge);
     }
     free(tmtable);
     tmtable = NULL;
@@ -3230,6 +3790,8 @@ tmstat_pseudo_row_create(TMTABLE table, TMROW *row)
         return -1;
     }
     r->own_row = false;
+    r->in_arena = false;
+    r->lazy = NULL;
     r->inode_addr = -1;
     r->table = table;
     r->data = (uint8_t*)r + ROUND_UP(sizeof(struct TMROW), ROW_ALIGN);
@@ -3240,6 +3802,39 @@ tmstat_pseudo_row_create(TMTABLE table, TMROW *row)
     return 0;
 }
 
+/**
+ * Create a pseudo row in an arena.  Such rows are not linked into the
+ * table's row list; whoever owns the arena must keep the table alive
+ * until the arena is freed.  Dropping the last
+ * reference frees nothing.
+ *
+ * @param[in]   arena       Arena to allocate from.
+ * @param[in]   table       Table describing the row.
+ * @param[out]  row         New row.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_arena_row_create(struct tmstat_arena *arena, TMTABLE table, TMROW *row)
+{
+    TMROW           r;
+
+    r = (TMROW)tmstat_arena_alloc(arena,
+        ROUND_UP(sizeof(struct TMROW), ROW_ALIGN) + table->rowsz);
+    if (r == NULL) {
+        /* Allocation failure; tmstat_arena_alloc sets errno. */
+        return -1;
+    }
+    r->own_row = false;
+    r->in_arena = true;
+    r->lazy = NULL;
+    r->inode_addr = -1;
+    r->table = table;
+    r->data = (uint8_t*)r + ROUND_UP(sizeof(struct TMROW), ROW_ALIGN);
+    r->ref_count = 1;
+    *row = r;
+    return 0;
+}
+
 /*
  * Create a new row.
  */
@@ -3259,6 +3854,8 @@ tmstat_row_create(TMSTAT stat, TMTABLE table, TMROW *row)
     r->ref_count = 1;
     r->table = table;
     r->own_row = true;
+    r->in_arena = false;
+    r->lazy = NULL;
     /* Add row to table. */
     ret = tmstat_row_add(stat, table, &r->data, &r->inode_addr);
     if (ret != 0) {
@@ -3269,6 +3866,7 @@ tmstat_row_create(TMSTAT stat, TMTABLE table, TMROW *row)
     }
     /* Insert into table's row list. */
     LIST_INSERT_HEAD(&table->row_list, r, entry);
+    tmstat_label_bump(stat);
 out:
     *row = r;
     return ret;
@@ -3295,6 +3893,8 @@ tmstat_row_create_n(TMSTAT stat, TMTABLE table, TMROW *row, unsigned n)
         row[i]->ref_count = 1;
         row[i]->table = table;
         row[i]->own_row = true;
+        row[i]->in_arena = false;
+        row[i]->lazy = NULL;
         /* Insert into table's row list. */
         LIST_INSERT_HEAD(&table->row_list, row[i], entry);
     }
@@ -3305,6 +3905,7 @@ tmstat_row_create_n(TMSTAT stat, TMTABLE table, TMROW *row, unsigned n)
         errno_save = errno;
         goto fail;
     }
+    tmstat_label_bump(stat);
     return 0;
  fail:
     for (n = i, i = 0; i < n; ++i) {
@@ -3322,6 +3923,7 @@ void
 tmstat_row_preserve(TMROW row)
 {
     row->own_row = false;
+    tmstat_label_bump(row->table->stat);
 }
 
 /*
@@ -3349,6 +3951,10 @@ tmstat_row_drop(TMROW row)
         abort();
     }
     row->ref_count--;
+    if ((row->ref_count == 0) && row->in_arena) {
+        /* Freed along with its arena. */
+        return NULL;
+    }
     if (row->ref_count == 0) {
         /* Free the resources for this row. */
         if (row->own_row) {
@@ -3384,13 +3990,18 @@ tmstat_row_drop(TMROW row)
                 warn("%s: attempt to remove invalid row", __func__);
                 abort();
             }
+            tmstat_label_bump(row->table->stat);
         }
         LIST_REMOVE(row, entry);
+        free(row->lazy);
         free(row);
     }
     return NULL;
 }
 
+static int tmstat_row_resolve(TMROW row, unsigned i);
+static int tmstat_row_resolve_all(TMROW row);
+
 /*
  * Locate field within row.
  */
@@ -3402,6 +4013,10 @@ tmstat_row_field(TMROW row, char *name, void *p)
 
     if (name == NULL) {
         /* Return the base of the structure. */
+        if (tmstat_row_resolve_all(row) != 0) {
+            /* Merge failure; tmstat_row_resolve_all sets errno. */
+            return -1;
+        }
         *(void **)p = row->data;
         return 0;
     }
@@ -3409,6 +4024,10 @@ tmstat_row_field(TMROW row, char *name, void *p)
     for (i = 0; i < row->table->col_count; i++) {
         if (strcmp(col[i].name, name) == 0) {
             /* Return this field. */
+            if (tmstat_row_resolve(row, i) != 0) {
+                /* Merge failure; tmstat_row_resolve sets errno. */
+                return -1;
+            }
             *(void **)p = &row->data[col[i].offset];
             return 0;
         }
@@ -3431,6 +4050,10 @@ tmstat_row_field_signed(TMROW row, char *name)
     for (i = 0; i < row->table->col_count; i++) {
         if (strcmp(col[i].name, name) == 0) {
             /* Return this field. */
+            if (tmstat_row_resolve(row, i) != 0) {
+                /* Merge failure; tmstat_row_resolve sets errno. */
+                return 0;
+            }
             p = &row->data[col[i].offset];
             switch (col[i].type) {
             case TMSTAT_T_SIGNED:
@@ -3454,6 +4077,7 @@ tmstat_row_field_signed(TMROW row, char *name)
             }
         }
     }
+    errno = ENOENT;
     return 0;
 }
 
@@ -3471,6 +4095,10 @@ tmstat_row_field_unsigned(TMROW row, char *name)
     for (i = 0; i < row->table->col_count; i++) {
         if (strcmp(col[i].name, name) == 0) {
             /* Return this field. */
+            if (tmstat_row_resolve(row, i) != 0) {
+                /* Merge failure; tmstat_row_resolve sets errno. */
+                return 0;
+            }
             p = &row->data[col[i].offset];
             switch (col[i].type) {
             case TMSTAT_T_SIGNED:
@@ -3494,6 +4122,7 @@ tmstat_row_field_unsigned(TMROW row, char *name)
             }
         }
     }
+    errno = ENOENT;
     return 0;
 }
 
@@ -3513,6 +4142,79 @@ tmstat_row_table(TMROW row)
     return row->table->td->name;
 }
 
+/**
+ * Find a segment's own label, the one at the root of its label tree.
+ * Segments remember it when created or subscribed; the search is for
+ * those that have yet to.
+ *
+ * @param[in]   stat        Segment.
+ * @return label, or NULL if the segment has none.
+ */
+static struct tmstat_label *
+tmstat_label_root(TMSTAT stat)
+{
+    TMTABLE                 table;
+    struct tmidx            slabs;
+    struct tmstat_slab     *slab;
+    struct tmstat_label    *label, *root = NULL;
+    unsigned                rowno;
+
+    if (stat->label != NULL) {
+        return stat->label;
+    }
+    table = tmstat_table(stat, ".label");
+    if (table == NULL) {
+        /* Pseudo rows and unions have no label of their own. */
+        return NULL;
+    }
+    tmidx_init(&slabs);
+    if (tmstat_slab_idx(stat, table->td, &slabs) == 0) {
+        TMIDX_FOREACH(&slabs, slab) {
+            TMSTAT_SLAB_FOREACH(stat, slab, rowno, label) {
+                if (strncmp(label->tree, TMSTAT_BASE_HEADER,
+                            sizeof(label->tree)) == 0) {
+                    root = label;
+                    goto out;
+                }
+            }
+        }
+    }
+out:
+    tmidx_free(&slabs);
+    return root;
+}
+
+/**
+ * Find the label holding a segment's commit count.
+ *
+ * @param[in]   stat        Segment.
+ * @return label, or NULL if the segment does not count commits.
+ */
+static struct tmstat_label *
+tmstat_label_counter(TMSTAT stat)
+{
+    TMTABLE                 table;
+
+    table = tmstat_table(stat, ".label");
+    if ((table == NULL) || (table->rowsz < sizeof(struct tmstat_label))) {
+        /* Written before commits were counted. */
+        return NULL;
+    }
+    return tmstat_label_root(stat);
+}
+
+/*
+ * Obtain the label of the segment from which a row came.
+ */
+const char *
+tmstat_row_label(TMROW row)
+{
+    struct tmstat_label    *label;
+
+    label = tmstat_label_root(row->table->stat);
+    return (label != NULL) ? label->name : row->table->stat->name;
+}
+
 /*
  * Create a row that refers to an existing row and insert the row
  * into an index. The row must be freed w/ row_drop
@@ -3533,6 +4235,8 @@ tmstat_alloc_weak_ref_row(TMTABLE table, struct tmidx *rows, uint8_t *row,
     tmrow->data = row;
     tmrow->inode_addr = TM_INODE(TM_INODE_SLAB(slab->inode), rowno);
     tmrow->own_row = false;
+    tmrow->in_arena = false;
+    tmrow->lazy = NULL;
     /* Add to index. */
     ret = tmidx_add(rows, tmrow);
     if (ret == -1) {
@@ -3544,123 +4248,170 @@ tmstat_alloc_weak_ref_row(TMTABLE table, struct tmidx *rows, uint8_t *row,
     return 0;
 }
 
+/**
+ * Scan callback, invoked for each row located by tmstat_query_table.
+ *
+ * The row pointer refers directly to slab memory and remains valid only
+ * as long as the segment is neither refreshed nor destroyed.
+ *
+ * @param[in]   arg         Caller context.
+ * @param[in]   table       Table containing the row.
+ * @param[in]   row         Row data.
+ * @param[in]   slab        Slab containing the row.
+ * @param[in]   rowno       Row index within slab.
+ * @return 0 to continue, positive to stop, -1 on failure.
+ */
+typedef int (*tmstat_scan_fn)(void *arg, TMTABLE table, uint8_t *row,
+                              struct tmstat_slab *slab, unsigned rowno);
+
+/*
+ * Scan callback which collects a weak reference handle for each row.
+ */
+static int
+tmstat_collect_row(void *arg, TMTABLE table, uint8_t *row,
+                   struct tmstat_slab *slab, unsigned rowno)
+{
+    return tmstat_alloc_weak_ref_row(table, (struct tmidx *)arg, row, slab,
+                                     rowno);
+}
+
+/**
+ * Determine whether a row holds the given column values.
+ *
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col         Columns to key upon.
+ * @param[in]   value       Column values to match.
+ * @param[in]   row         Row data.
+ * @return true if every column matches.
+ */
+static inline bool
+tmstat_values_match(unsigned col_count, TMCOL *col, void **value,
+                    const uint8_t *row)
+{
+    signed                  match;
+
+    for (unsigned i = 0; i < col_count; i++) {
+        if (col[i]->type == TMSTAT_T_TEXT) {
+            match = strncmp((const char*)value[i],
+                            (const char*)&row[col[i]->offset],
+                            col[i]->size-1);
+        } else {
+            match = memcmp(value[i], &row[col[i]->offset], col[i]->size);
+        }
+        if (match != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 /*
  * Locate rows by column values within slab.
  *
  * @param[in]   table       Associated table.
- * @param[out]  rows        Array containing result rows.
  * @param[in]   slab        Slab to search.
  * @param[in]   col_count   Number of columns to key on.
  * @param[in]   col         Columns to key upon.
  * @param[in]   value       Column values to match.
- * @return 0 on success, -1 on failure.
+ * @param[in]   fn          Callback for each matching row.
+ * @param[in]   arg         Callback context.
+ * @return 0 on success, -1 on failure, or the callback's positive stop value.
  */
 static int
-tmstat_query_slab(TMTABLE table, struct tmidx *rows, struct tmstat_slab *slab,
-                  unsigned col_count, TMCOL *col, void **value)
+tmstat_query_slab(TMTABLE table, struct tmstat_slab *slab,
+                  unsigned col_count, TMCOL *col, void **value,
+                  tmstat_scan_fn fn, void *arg)
 {
     unsigned                rowno;
     uint8_t                *row;
-    signed                  match, ret;
+    signed                  ret;
 
     TMSTAT_SLAB_FOREACH(table->stat, slab, rowno, row) {
         /* Consider this row. */
-        for (unsigned i = 0; i < col_count; i++) {
-            if (col[i]->type == TMSTAT_T_TEXT) {
-                match = strncmp((const char*)value[i],
-                                (const char*)&row[col[i]->offset],
-                                col[i]->size-1);
-            } else {
-                match = memcmp(value[i], &row[col[i]->offset], col[i]->size);
-            }
-            if (match != 0) {
-                /* Key mismatch; reject row. */
-                goto next_row;
-            }
+        if (!tmstat_values_match(col_count, col, value, row)) {
+            /* Key mismatch; reject row. */
+            goto next_row;
         }
-        /* Row match; allocate row handle. */
-        ret = tmstat_alloc_weak_ref_row(table, rows, row, slab, rowno);
-        if (ret == -1) {
-            return -1;
+        /* Row match; hand it to the caller. */
+        ret = fn(arg, table, row, slab, rowno);
+        if (ret != 0) {
+            return ret;
         }
-     
+
 next_row: ;
     }
     return 0;
 }
 
-/*
- * Compare two rows.  In readers, this function is called often; most
- * of the runtime spent in this library will be spent inside this
- * function.  It is, therefore, performance-critical.
+/**
+ * Compare one field of two rows.
  *
- * @param[in]   r1      Handle to first row.
- * @param[in]   r2      Handle to second row.
- * @return 0 on match, positive if r1 > r2, negative if r1 < r2.
+ * @param[in]   col     Column describing the field.
+ * @param[in]   f1      First field.
+ * @param[in]   f2      Second field.
+ * @return 0 on match, positive if f1 > f2, negative if f1 < f2.
  */
-static int64_t
-tmstat_row_cmp(TMROW r1, TMROW r2)
+static inline int64_t
+tmstat_field_cmp(TMCOL col, const uint8_t *f1, const uint8_t *f2)
+{
+    switch (col->type) {
+    case TMSTAT_T_SIGNED:
+        switch (col->size) {
+        case 1:
+            return (int64_t)*(const int8_t *)f1 - (int64_t)*(const int8_t *)f2;
+        case 2:
+            return (int64_t)*(const int16_t *)f1 -
+                   (int64_t)*(const int16_t *)f2;
+        case 4:
+            return (int64_t)*(const int32_t *)f1 -
+                   (int64_t)*(const int32_t *)f2;
+        case 8:
+            return (*(const int64_t *)f1 > *(const int64_t *)f2) ? 1 :
+                   (*(const int64_t *)f1 < *(const int64_t *)f2) ? -1 : 0;
+        }
+        break;
+    case TMSTAT_T_UNSIGNED:
+        switch (col->size) {
+        case 1:
+            return (int64_t)*(const uint8_t *)f1 -
+                   (int64_t)*(const uint8_t *)f2;
+        case 2:
+            return (int64_t)*(const uint16_t *)f1 -
+                   (int64_t)*(const uint16_t *)f2;
+        case 4:
+            return (int64_t)*(const uint32_t *)f1 -
+                   (int64_t)*(const uint32_t *)f2;
+        case 8:
+            return (*(const uint64_t *)f1 > *(const uint64_t *)f2) ? 1 :
+                   (*(const uint64_t *)f1 < *(const uint64_t *)f2) ? -1 : 0;
+        }
+        break;
+    case TMSTAT_T_TEXT:
+        return strncmp((const char *)f1, (const char *)f2, col->size - 1);
+    default:
+        break;
+    }
+    return memcmp(f1, f2, col->size);
+}
+
+/**
+ * Compare several fields of two rows' data, in order.
+ *
+ * @param[in]   col     Columns describing the fields.
+ * @param[in]   count   Number of columns.
+ * @param[in]   d1      First row data.
+ * @param[in]   d2      Second row data.
+ * @return 0 on match, positive if d1 > d2, negative if d1 < d2.
+ */
+static inline int64_t
+tmstat_fields_cmp(TMCOL col, unsigned count, const uint8_t *d1,
+                  const uint8_t *d2)
 {
-    TMCOL       col;
-    unsigned    i, col_count;
     int64_t     match;
 
-    col = r1->table->key_col;
-    col_count = r1->table->key_col_count;
-    for (i = 0; i < col_count; i++) {
-        switch (col[i].type) {
-        case TMSTAT_T_SIGNED:
-            switch (col[i].size) {
-            case 1:
-                match = (int64_t)*(int8_t *)(&r1->data[col[i].offset]) -
-                        (int64_t)*(int8_t *)(&r2->data[col[i].offset]);
-                break;
-            case 2:
-                match = (int64_t)*(int16_t *)(&r1->data[col[i].offset]) -
-                        (int64_t)*(int16_t *)(&r2->data[col[i].offset]);
-                break;
-            case 4:
-                match = (int64_t)*(int32_t *)(&r1->data[col[i].offset]) -
-                        (int64_t)*(int32_t *)(&r2->data[col[i].offset]);
-                break;
-            case 8: 
-                match = (*(int64_t *)(&r1->data[col[i].offset]) >
-                         *(int64_t *)(&r2->data[col[i].offset]))? 1 : (
-                            (*(int64_t *)(&r1->data[col[i].offset]) <
-                            *(int64_t *)(&r2->data[col[i].offset])) ? -1 : 0 );
-                break;
-            }
-            break;
-        case TMSTAT_T_UNSIGNED:
-            switch (col[i].size) {
-            case 1:
-                match = (int64_t)*(uint8_t *)(&r1->data[col[i].offset]) -
-                        (int64_t)*(uint8_t *)(&r2->data[col[i].offset]);
-                break;
-            case 2:
-                match = (int64_t)*(uint16_t *)(&r1->data[col[i].offset]) -
-                        (int64_t)*(uint16_t *)(&r2->data[col[i].offset]);
-                break;
-            case 4:
-                match = (int64_t)*(uint32_t *)(&r1->data[col[i].offset]) -
-                        (int64_t)*(uint32_t *)(&r2->data[col[i].offset]);
-                break;
-            case 8:
-                match = (*(uint64_t *)(&r1->data[col[i].offset]) >
-                         *(uint64_t *)(&r2->data[col[i].offset]))? 1 : (
-                            (*(uint64_t *)(&r1->data[col[i].offset]) <
-                            *(uint64_t *)(&r2->data[col[i].offset])) ? -1 : 0 );
-                break;
-            }
-            break;
-        case TMSTAT_T_TEXT:
-            match = strncmp((char*)&r1->data[col[i].offset], (char*)&r2->data[col[i].offset],
-                           col[i].size-1);
-            break;
-        default:
-            match = memcmp(&r1->data[col[i].offset], &r2->data[col[i].offset],
-                           col[i].size);
-        }
+    for (unsigned i = 0; i < count; i++) {
+        match = tmstat_field_cmp(&col[i], &d1[col[i].offset],
+                                 &d2[col[i].offset]);
         if (match != 0) {
             return match;
         }
@@ -3669,74 +4420,172 @@ tmstat_row_cmp(TMROW r1, TMROW r2)
 }
 
 /**
- * Locate rows by column values within table.
+ * Compare the leading key columns of two rows' data.
  *
- * @param[in]   stat        Segment to search.
+ * @param[in]   table   Table describing both rows.
+ * @param[in]   prefix  Number of leading key columns to compare.
+ * @param[in]   d1      First row data.
+ * @param[in]   d2      Second row data.
+ * @return 0 on match, positive if d1 > d2, negative if d1 < d2.
+ */
+static inline int64_t
+tmstat_prefix_cmp(TMTABLE table, unsigned prefix, const uint8_t *d1,
+                  const uint8_t *d2)
+{
+    return tmstat_fields_cmp(table->key_col, prefix, d1, d2);
+}
+
+/*
+ * Compare the key columns of two rows' data.  In readers, this function
+ * is called often; most of the runtime spent in this library will be
+ * spent inside this function.  It is, therefore, performance-critical.
+ *
+ * @param[in]   table   Table describing both rows.
+ * @param[in]   d1      First row data.
+ * @param[in]   d2      Second row data.
+ * @return 0 on match, positive if d1 > d2, negative if d1 < d2.
+ */
+static int64_t
+tmstat_data_cmp(TMTABLE table, const uint8_t *d1, const uint8_t *d2)
+{
+    return tmstat_prefix_cmp(table, table->key_col_count, d1, d2);
+}
+
+/**
+ * Ways of finding a query's rows within one table.
+ */
+enum tmstat_path {
+    TMSTAT_PATH_NONE,       //!< A column is missing; nothing can match.
+    TMSTAT_PATH_SCAN,       //!< Examine every slab.
+    TMSTAT_PATH_PREFIX,     //!< Search a sorted table for a key prefix.
+    TMSTAT_PATH_SEARCH,     //!< Search a sorted table for the full key.
+};
+
+/**
+ * Query columns resolved against one table.
+ */
+struct tmstat_qtable {
+    TMTABLE             table;          //!< Table to search.
+    enum tmstat_path    path;           //!< Chosen access path.
+    unsigned            prefix;         //!< Leading key columns queried.
+    bool                keyed;          //!< Path uses the key buffer.
+    TMCOL              *cols;           //!< Resolved columns.
+};
+
+/**
+ * Resolve query columns against a table and plan how to search it.
+ *
+ * Sorted tables (those written by tmstat_merge) are searched when the
+ * query pins down the leading key columns: a full key finds its single
+ * row by binary search, and a key prefix finds the run of slabs that
+ * can hold it.  Anything else scans every slab.
+ *
+ * @param[out]  qt          Resolution; qt->cols must have col_count room.
  * @param[in]   table       Table to search.
- * @param[out]  rows        Array containing result row indexes.
  * @param[in]   col_count   Number of columns to key on.
  * @param[in]   col_name    Column names to key upon.
- * @param[in]   values      Column values to match.
  * @return 0 on success, -1 on failure.
  */
 static int
-tmstat_query_table(TMSTAT stat, TMTABLE table, struct tmidx *rows,
-                   unsigned col_count, char **col_name, void **values)
+tmstat_qtable_resolve(struct tmstat_qtable *qt, TMTABLE table,
+                      unsigned col_count, char **col_name)
 {
-    struct tmidx            slabs;
-    struct tmstat_slab     *slab;
-    signed                  ret;
-    TMCOL                   cols[col_count];
-    bool                    all_keys = col_count > 0;
-    TMROW                   row, srow;
-    struct TMROW            srowd;
+    unsigned            i, j;
+    bool                all_keys = col_count > 0;
 
-    /*
-     * Do this before touching any of the autos, since cols may
-     * cause a stack overflow.
-     */
     if (col_count > table->col_count) {
         errno = EINVAL;
         return -1;
     }
-    
-    /* Allocate a pseudo row for doing fast searches. */
-    if (table->td->is_sorted) {
-        ret = tmstat_pseudo_row_create(table, &row);
-        if (ret != 0) {
-            /* tmstat_pseudo_row_create sets errno. */
-            return ret;
+    qt->table = table;
+    qt->path = TMSTAT_PATH_NONE;
+    qt->prefix = 0;
+    qt->keyed = false;
+    for (i = 0; i < col_count; i++) {
+        for (j = 0; j < table->col_count; j++) {
+            if (strcmp(col_name[i], table->col[j].name) == 0) {
+                break;
+            }
+        }
+        if (j == table->col_count) {
+            /* Column does not exist; no rows can match. */
+            return 0;
+        }
+        qt->cols[i] = &table->col[j];
+        if (qt->cols[i]->rule != TMSTAT_R_KEY) {
+            all_keys = false;
         }
-        srow = &srowd;
-        srow->table = table;
     }
-    tmidx_init(&slabs);
-    /* Locate columns. */
-    for (unsigned i = 0; i < col_count; i++) {
-        for (unsigned j = 0; j < table->col_count; j++) {
-            if (strcmp(col_name[i], table->col[j].name) == 0) {
-                cols[i] = &table->col[j];
-                if (!table->td->is_sorted || (cols[i]->rule != TMSTAT_R_KEY)) {
-                    all_keys = false;
-                } else {
-                    /* Populate the keys of the pseudo row. */
-                    if (cols[i]->type == TMSTAT_T_TEXT) {
-                        strncpy((char *)&row->data[cols[i]->offset], values[i],
-                                cols[i]->size);
-                    } else {
-                        memcpy(&row->data[cols[i]->offset], values[i],
-                               cols[i]->size);
-                    }
-                }
-                goto next_col;
+    /* Count the leading key columns the query pins down. */
+    while (qt->prefix < table->key_col_count) {
+        for (i = 0; i < col_count; i++) {
+            if ((qt->cols[i]->rule == TMSTAT_R_KEY) &&
+                (qt->cols[i]->offset ==
+                 table->key_col[qt->prefix].offset)) {
+                break;
             }
         }
+        if (i == col_count) {
+            break;
+        }
+        qt->prefix++;
+    }
+    if (!table->td->is_sorted || (qt->prefix == 0)) {
+        qt->path = TMSTAT_PATH_SCAN;
+    } else if (all_keys && (col_count == table->key_col_count) &&
+               (qt->prefix == table->key_col_count)) {
+        qt->path = TMSTAT_PATH_SEARCH;
+    } else {
+        qt->path = TMSTAT_PATH_PREFIX;
+    }
+    qt->keyed = (qt->path != TMSTAT_PATH_SCAN);
+    return 0;
+}
+
+/**
+ * Locate rows by resolved column values within table.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   qt          Resolved columns.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   values      Column values to match.
+ * @param[in]   key         Scratch row image of at least the table's
+ *                          row size, used when qt->keyed.
+ * @param[in]   fn          Callback for each matching row.
+ * @param[in]   arg         Callback context.
+ * @return 0 on success, -1 on failure, or the callback's positive stop value.
+ */
+static int
+tmstat_query_resolved(TMSTAT stat, struct tmstat_qtable *qt,
+                      unsigned col_count, void **values, uint8_t *key,
+                      tmstat_scan_fn fn, void *arg)
+{
+    TMTABLE                 table = qt->table;
+    TMCOL                  *cols = qt->cols;
+    struct tmidx            slabs;
+    struct tmstat_slab     *slab;
+    signed                  ret;
+
+    if (qt->path == TMSTAT_PATH_NONE) {
         /* Column does not exist; treat as if no rows match. */
-        ret = 0;
-        goto out;
-next_col:
-        ;
+        return 0;
+    }
+    if (qt->keyed) {
+        /* Populate the key for a fast search. */
+        for (unsigned i = 0; i < col_count; i++) {
+            if (cols[i]->rule != TMSTAT_R_KEY) {
+                /* Only key columns take part in the search. */
+                continue;
+            }
+            if (cols[i]->type == TMSTAT_T_TEXT) {
+                strncpy((char *)&key[cols[i]->offset], values[i],
+                        cols[i]->size);
+            } else {
+                memcpy(&key[cols[i]->offset], values[i], cols[i]->size);
+            }
+        }
     }
+    tmidx_init(&slabs);
     /* Locate slabs. */
     ret = tmstat_slab_idx(table->stat, table->td, &slabs);
     if (ret != 0) {
@@ -3748,213 +4597,261 @@ next_col:
      * In this instance, there will be only one result. If it is not found
      * in the binary search, fallback to linear.
      */
-    if (table->td->is_sorted && all_keys &&
-            (col_count == table->key_col_count)) {
+    if (qt->path == TMSTAT_PATH_SEARCH) {
         int search_first = 0;
         int search_last = tmidx_count(&slabs) - 1;
         int search_idx;
         unsigned rowno;
+        uint8_t *data;
         int64_t cmp;
         
         while (search_first <= search_last) {
             search_idx = (search_last - search_first) / 2 + search_first;
             slab = tmidx_entry(&slabs, search_idx);
-            srow->data = tmstat_slab_first(stat, slab, &rowno);
-            cmp = tmstat_row_cmp(row, srow);
+            data = tmstat_slab_first(stat, slab, &rowno);
+            cmp = tmstat_data_cmp(table, key, data);
             if (cmp < 0) {
                 search_last = search_idx - 1;
                 continue;
             } else if (cmp == 0) {
                 /* The only match was found. */
-                ret = tmstat_alloc_weak_ref_row(table, rows, srow->data, slab,
-                                                rowno);
+                ret = fn(arg, table, data, slab, rowno);
                 goto out;
             }
-            srow->data = tmstat_slab_last(stat, slab, &rowno);
-            cmp = tmstat_row_cmp(row, srow);
+            data = tmstat_slab_last(stat, slab, &rowno);
+            cmp = tmstat_data_cmp(table, key, data);
             if (cmp > 0) {
                 search_first = search_idx + 1;
                 continue;
             } else if (cmp == 0) {
                 /* The only match was found. */
-                ret = tmstat_alloc_weak_ref_row(table, rows, srow->data, slab,
-                                                rowno);
+                ret = fn(arg, table, data, slab, rowno);
                 goto out;
             }
             /* It should be in this slab. */
-            ret = tmstat_query_slab(table, rows, slab, col_count, cols, values);
+            ret = tmstat_query_slab(table, slab, col_count, cols, values,
+                                    fn, arg);
             goto out;
         }
         ret = 0;
         goto out;
+    } else if (qt->path == TMSTAT_PATH_PREFIX) {
+        unsigned lo = 0, hi = tmidx_count(&slabs), mid, rowno;
+        uint8_t *data;
+
+        /* Find the first slab whose last row is not below the prefix. */
+        while (lo < hi) {
+            mid = lo + (hi - lo) / 2;
+            slab = tmidx_entry(&slabs, mid);
+            data = tmstat_slab_last(stat, slab, &rowno);
+            if ((data != NULL) &&
+                (tmstat_prefix_cmp(table, qt->prefix, key, data) > 0)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        /* Scan forward until a slab starts past the prefix. */
+        for (; lo < tmidx_count(&slabs); lo++) {
+            slab = tmidx_entry(&slabs, lo);
+            data = tmstat_slab_first(stat, slab, &rowno);
+            if (data == NULL) {
+                continue;
+            }
+            if (tmstat_prefix_cmp(table, qt->prefix, key, data) < 0) {
+                break;
+            }
+            ret = tmstat_query_slab(table, slab, col_count, cols, values,
+                                    fn, arg);
+            if (ret != 0) {
+                /* Stopped, or internal error; tmstat_query_slab sets errno. */
+                goto out;
+            }
+        }
+        ret = 0;
+        goto out;
     } else {
         TMIDX_FOREACH(&slabs, slab) {
-            ret = tmstat_query_slab(table, rows, slab, col_count, cols, values);
+            ret = tmstat_query_slab(table, slab, col_count, cols, values,
+                                    fn, arg);
             if (ret != 0) {
-                /* Internal error; tmstat_query_slab sets errno. */
+                /* Stopped, or internal error; tmstat_query_slab sets errno. */
                 goto out;
             }
         }
     }
 out:
-    if (table->td->is_sorted) {
-        tmstat_row_drop(row);
-    }
     tmidx_free(&slabs);
     return ret;
 }
 
 /**
- * Merge row fields.
+ * Locate rows by column values within table.
  *
- * @param[in]   dst_row     Target row and result.
- * @param[in]   src_row     Source row.
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table       Table to search.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_name    Column names to key upon.
+ * @param[in]   values      Column values to match.
+ * @param[in]   fn          Callback for each matching row.
+ * @param[in]   arg         Callback context.
+ * @return 0 on success, -1 on failure, or the callback's positive stop value.
+ */
+static int
+tmstat_query_table(TMSTAT stat, TMTABLE table,
+                   unsigned col_count, char **col_name, void **values,
+                   tmstat_scan_fn fn, void *arg)
+{
+    struct tmstat_qtable    qt;
+    uint8_t                *key = NULL;
+    signed                  ret;
+
+    /*
+     * Do this before touching any of the autos, since cols may
+     * cause a stack overflow.
+     */
+    if (col_count > table->col_count) {
+        errno = EINVAL;
+        return -1;
+    }
+    TMCOL                   cols[col_count + 1];
+
+    qt.cols = cols;
+    ret = tmstat_qtable_resolve(&qt, table, col_count, col_name);
+    if (ret != 0) {
+        /* tmstat_qtable_resolve sets errno. */
+        return ret;
+    }
+    if (qt.keyed) {
+        /* Allocate a key buffer for doing fast searches. */
+        key = (uint8_t *)malloc(table->rowsz);
+        if (key == NULL) {
+            /* Allocation failure; malloc sets errno. */
+            return -1;
+        }
+    }
+    ret = tmstat_query_resolved(stat, &qt, col_count, values, key, fn, arg);
+    free(key);
+    return ret;
+}
+
+/**
+ * Apply a merge kernel across a run of elements.
+ */
+#define TMSTAT_MERGE_RUN(type, expr)                                        \
+    do {                                                                    \
+        type           *x = (type *)a;                                      \
+        const type     *y = (const type *)b;                                \
+        for (unsigned j = 0; j < step->count; j++) {                        \
+            x[j] = (expr);                                                  \
+        }                                                                   \
+    } while (0)
+
+/**
+ * Merge row data fields, following a merge plan.
+ *
+ * @param[in]   table       Table describing both rows.
+ * @param[in]   plan        Merge steps.
+ * @param[in]   count       Number of steps.
+ * @param[in]   dst         Target row data and result.
+ * @param[in]   src         Source row data.
  * @return 0 on success, -1 on failure.
  */
-int
-tmstat_merge_row(TMROW dst_row, TMROW src_row)
+static int
+tmstat_merge_plan(TMTABLE table, const struct tmstat_mstep *plan,
+                  unsigned count, uint8_t *dst, const uint8_t *src)
 {
-    TMTABLE         table = dst_row->table;
+    const struct tmstat_mstep *step, *end;
     TMCOL           col;
-    signed          match;
-    void           *a, *b;
+    void           *a;
+    const void     *b;
     int             ret = 0;
 
-    for (unsigned i = 0; i < table->col_count; i++) {
-        col = &table->col[i];
-        a = (void *)&dst_row->data[col->offset];
-        b = (void *)&src_row->data[col->offset];
-        switch (col->rule) {
-        case TMSTAT_R_KEY:
-            /* This column stores row identity; ignore. */
+    end = plan + count;
+    for (step = plan; step < end; step++) {
+        a = (void *)&dst[step->offset];
+        b = (const void *)&src[step->offset];
+        if (step->vkernel != NULL) {
+            /* Long run; merge it a vector at a time. */
+            step->vkernel(a, b, step->count);
+            continue;
+        }
+        switch (step->op) {
+        case TMSTAT_MOP_SUM8:   TMSTAT_MERGE_RUN(uint8_t,  x[j] + y[j]); break;
+        case TMSTAT_MOP_SUM16:  TMSTAT_MERGE_RUN(uint16_t, x[j] + y[j]); break;
+        case TMSTAT_MOP_SUM32:  TMSTAT_MERGE_RUN(uint32_t, x[j] + y[j]); break;
+        case TMSTAT_MOP_SUM64:  TMSTAT_MERGE_RUN(uint64_t, x[j] + y[j]); break;
+        case TMSTAT_MOP_MIN_U8:
+            TMSTAT_MERGE_RUN(uint8_t, TMSTAT_MIN(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MIN_U16:
+            TMSTAT_MERGE_RUN(uint16_t, TMSTAT_MIN(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MIN_U32:
+            TMSTAT_MERGE_RUN(uint32_t, TMSTAT_MIN(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MIN_U64:
+            TMSTAT_MERGE_RUN(uint64_t, TMSTAT_MIN(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MIN_S8:
+            TMSTAT_MERGE_RUN(int8_t, TMSTAT_MIN(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MIN_S16:
+            TMSTAT_MERGE_RUN(int16_t, TMSTAT_MIN(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MIN_S32:
+            TMSTAT_MERGE_RUN(int32_t, TMSTAT_MIN(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MIN_S64:
+            TMSTAT_MERGE_RUN(int64_t, TMSTAT_MIN(x[j], y[j]));
             break;
-        case TMSTAT_R_OR:
+        case TMSTAT_MOP_MAX_U8:
+            TMSTAT_MERGE_RUN(uint8_t, TMSTAT_MAX(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MAX_U16:
+            TMSTAT_MERGE_RUN(uint16_t, TMSTAT_MAX(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MAX_U32:
+            TMSTAT_MERGE_RUN(uint32_t, TMSTAT_MAX(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MAX_U64:
+            TMSTAT_MERGE_RUN(uint64_t, TMSTAT_MAX(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MAX_S8:
+            TMSTAT_MERGE_RUN(int8_t, TMSTAT_MAX(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MAX_S16:
+            TMSTAT_MERGE_RUN(int16_t, TMSTAT_MAX(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MAX_S32:
+            TMSTAT_MERGE_RUN(int32_t, TMSTAT_MAX(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_MAX_S64:
+            TMSTAT_MERGE_RUN(int64_t, TMSTAT_MAX(x[j], y[j]));
+            break;
+        case TMSTAT_MOP_OR:
             /* Logical or (useful for bit sets). */
-            for (unsigned j = col->offset; j < col->offset + col->size; j++) {
-                dst_row->data[j] |= src_row->data[j];
-            }
+            TMSTAT_MERGE_RUN(uint8_t, x[j] | y[j]);
             break;
-        case TMSTAT_R_SUM:
-            /* Sum fields. */
-            switch (col->size) {
-            case sizeof(uint8_t):   *(uint8_t *)a += *(uint8_t *)b;     break;
-            case sizeof(uint16_t):  *(uint16_t *)a += *(uint16_t *)b;   break;
-            case sizeof(uint32_t):  *(uint32_t *)a += *(uint32_t *)b;   break;
-            case sizeof(uint64_t):  *(uint64_t *)a += *(uint64_t *)b;   break;
-            default:
-                warnx("%s(%d): unsupported size %d for column `%s' in"
-                      " table `%s' with sum rule",
-                      __func__, __LINE__, col->name, table->td->name);
-                errno = EINVAL;
-                ret = -1;
-                break;
+        case TMSTAT_MOP_MIN_MEM:
+            if (memcmp(a, b, step->count) > 0) {
+                memcpy(a, b, step->count);
             }
             break;
-        case TMSTAT_R_MIN:
-            /* Select smallest. */
-            if (col->type == TMSTAT_T_UNSIGNED) {
-                switch (col->size) {
-                case sizeof(int8_t):
-                    *(uint8_t *)a = TMSTAT_MIN(*(uint8_t *)a, *(uint8_t *)b);
-                    break;
-                case sizeof(int16_t):
-                    *(uint16_t *)a = TMSTAT_MIN(*(uint16_t *)a, *(uint16_t *)b);
-                    break;
-                case sizeof(int32_t):
-                    *(uint32_t *)a = TMSTAT_MIN(*(uint32_t *)a, *(uint32_t *)b);
-                    break;
-                case sizeof(int64_t):
-                    *(uint64_t *)a = TMSTAT_MIN(*(uint64_t *)a, *(uint64_t *)b);
-                    break;
-                default:
-                    warnx("%s(%d): unsupported size %d for column `%s' in"
-                          " table `%s' with min rule",
-                          __func__, __LINE__, col->name, table->td->name);
-                    errno = EINVAL;
-                    ret = -1;
-                    break;
-                }
-            } else if (col->type == TMSTAT_T_SIGNED) {
-                switch (col->size) {
-                case sizeof(int8_t):
-                    *(int8_t *)a = TMSTAT_MIN(*(int8_t *)a, *(int8_t *)b);
-                    break;
-                case sizeof(int16_t):
-                    *(int16_t *)a = TMSTAT_MIN(*(int16_t *)a, *(int16_t *)b);
-                    break;
-                case sizeof(int32_t):
-                    *(int32_t *)a = TMSTAT_MIN(*(int32_t *)a, *(int32_t *)b);
-                    break;
-                case sizeof(int64_t):
-                    *(int64_t *)a = TMSTAT_MIN(*(int64_t *)a, *(int64_t *)b);
-                    break;
-                default:
-                    warnx("%s(%d): unsupported size %d for column `%s' in"
-                          " table `%s' with min rule",
-                          __func__, __LINE__, col->name, table->td->name);
-                    errno = EINVAL;
-                    ret = -1;
-                    break;
-                }
-            } else {
-                match = memcmp(a, b, col->size);
-                if (match > 0) {
-                    memcpy(a, b, col->size);
-                }
+        case TMSTAT_MOP_MAX_MEM:
+            if (memcmp(a, b, step->count) < 0) {
+                memcpy(a, b, step->count);
             }
             break;
-        case TMSTAT_R_MAX:
-            /* Select largest. */
-            if (col->type == TMSTAT_T_UNSIGNED) {
-                switch (col->size) {
-                case sizeof(uint8_t):
-                    *(uint8_t *)a = TMSTAT_MAX(*(uint8_t *)a, *(uint8_t *)b);
-                    break;
-                case sizeof(uint16_t):
-                    *(uint16_t *)a = TMSTAT_MAX(*(uint16_t *)a, *(uint16_t *)b);
-                    break;
-                case sizeof(uint32_t):
-                    *(uint32_t *)a = TMSTAT_MAX(*(uint32_t *)a, *(uint32_t *)b);
-                    break;
-                case sizeof(uint64_t):
-                    *(uint64_t *)a = TMSTAT_MAX(*(uint64_t *)a, *(uint64_t *)b);
-                    break;
-                default:
-                    warnx("%s(%d): unsupported size %d for column `%s' in"
-                          " table `%s' with max rule",
-                          __func__, __LINE__, col->name, table->td->name);
-                    errno = EINVAL;
-                    ret = -1;
-                    break;
-                }
-            } else if (col->type == TMSTAT_T_SIGNED) {
-                switch (col->size) {
-                case sizeof(int8_t):
-                    *(int8_t *)a = TMSTAT_MAX(*(int8_t *)a, *(int8_t *)b);
-                    break;
-                case sizeof(int16_t):
-                    *(int16_t *)a = TMSTAT_MAX(*(int16_t *)a, *(int16_t *)b);
-                    break;
-                case sizeof(int32_t):
-                    *(int32_t *)a = TMSTAT_MAX(*(int32_t *)a, *(int32_t *)b);
-                    break;
-                case sizeof(int64_t):
-                    *(int64_t *)a = TMSTAT_MAX(*(int64_t *)a, *(int64_t *)b);
-                    break;
-                default:
-                    warnx("%s(%d): unsupported size %d for column `%s' in"
-                          " table `%s' with max rule",
-                          __func__, __LINE__, col->name, table->td->name);
-                    errno = EINVAL;
-                    ret = -1;
-                    break;
-                }
-            } else {
-                match = memcmp(a, b, col->size);
-                if (match < 0) {
-                    memcpy(a, b, col->size);
-                }
-            }
+        case TMSTAT_MOP_BAD:
+        default:
+            col = &table->col[step->count];
+            warnx("%s(%d): unsupported size %d for column `%s' in"
+                  " table `%s' with merge rule %d",
+                  __func__, __LINE__, col->size, col->name,
+                  table->td->name, col->rule);
+            errno = EINVAL;
+            ret = -1;
             break;
         }
     }
@@ -3962,177 +4859,583 @@ tmstat_merge_row(TMROW dst_row, TMROW src_row)
 }
 
 /**
- * Produce merged result set.
+ * Merge row data fields, following the table's compiled merge plan.
  *
- * This is a common operation for readers, so it is performance
- * critical.  It is assumed that the incoming rows are unsorted (which
- * is almost always the case), so we do what we can to reduce merge
- * time via a red-black tree and obtain something like O(n log n).
+ * @param[in]   table       Table describing both rows.
+ * @param[in]   dst         Target row data and result.
+ * @param[in]   src         Source row data.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_merge_data(TMTABLE table, uint8_t *dst, const uint8_t *src)
+{
+    return tmstat_merge_plan(table, table->merge, table->merge_count,
+                             dst, src);
+}
+
+/**
+ * Merge one column of a lazily merged row, unless already done.
  *
- * @param[in]   table       Table whose rows we are merging.
- * @param       rows        On entry, contains source rows.
- *                          On return, contains merged rows.
- *                          Regardless of success, the original index is freed
- *                          and all the original rows are dropped.
- *                          The returned rows are pseudo rows.
- * @param[out]  treep       If non-null, on success it will point to
- *                          a red-black tree containing all the merged
- *                          rows.  On failure, its contents are unchanged.
+ * @param[in]   row         Row.
+ * @param[in]   i           Column index.
  * @return 0 on success, -1 on failure.
  */
 static int
-tmstat_merge_rows(TMTABLE table, struct tmidx *rows, tmrbt *treep)
+tmstat_row_resolve(TMROW row, unsigned i)
 {
-    struct tmidx    src;
-    TMROW           src_row, row;
-    signed          ret = 0;
-    tmrbt           tree;
-    unsigned        i;
+    struct tmstat_lazy *lazy = row->lazy;
+    TMCOL               col;
+    struct tmstat_mstep step;
+    signed              ret = 0;
 
-    tree = tmrbt_alloc();
-    if (tree == NULL) {
-        return -1;
-    }
-    /* Move results into source index. */
-    memcpy(&src, rows, sizeof(struct tmidx));
-    tmidx_init(rows);
-    /* Copy into results, merging as we find identical entries. */
-    ret = 0;
-    for (i = 0; i < tmidx_count(&src); i++) {
-        src_row = tmidx_entry(&src, i);
-        /* Look for row with identical key. */
-        row = tmrbt_find(tree, src_row);
-        if (row) {
-            /* Found.  Merge rows. */
-           tmstat_merge_row(row, src_row);
-        } else {
-            /* Not found.  Create a new pseudo row, copy data, insert. */
-            ret = tmstat_pseudo_row_create(table, &row);
-            if (ret < 0) {
-                break;
-            }
-            memcpy(row->data, src_row->data, table->rowsz);
-            ret = tmrbt_insert(tree, row);
-            if (ret < 0) {
-                tmstat_row_drop(row);
-                break;
-            }
-            ret = tmidx_add(rows, row);
-            ret = (ret < 0) ? -1 : 0;
-            if (ret < 0) {
-                tmstat_row_drop(row);
-                break;
-            }
-        }
-        /* Free source row. */
-        tmstat_row_drop(src_row);
+    if ((lazy == NULL) || lazy->ready[i]) {
+        return 0;
     }
-    /* Free any unprocessed source rows in the event of an error. */
-    for (; i < tmidx_count(&src); i++) {
-        tmstat_row_drop(tmidx_entry(&src, i));
+    /* A plan of one step, laid out as tmstat_compile_merge would. */
+    col = &row->table->col[i];
+    step.op = tmstat_col_mop(col);
+    step.vkernel = NULL;
+    step.offset = col->offset;
+    if (step.op == TMSTAT_MOP_BAD) {
+        step.count = i;
+    } else if (step.op < TMSTAT_MOP_OR) {
+        step.count = 1;
+    } else {
+        step.count = col->size;
     }
-    tmidx_free(&src);
-    if (ret != 0) {
-        /* Failure.  Clean up partial results. */
-        TMIDX_FOREACH(rows, row) {
-            tmstat_row_drop(row);
+    for (unsigned k = 1; (ret == 0) && (k < lazy->src_count); k++) {
+        if (tmstat_data_cmp(row->table, row->data, lazy->src[k]) != 0) {
+            /* Retired since, and its slot reused for another key. */
+            continue;
         }
-        tmidx_free(rows);
-        tmidx_init(rows);
-    }
-    /* Save tree if caller asked for it and all went well; otherwise, free. */
-    if ((ret == 0) && (treep != NULL)) {
-        *treep = tree;
-    } else {
-        tmrbt_free(tree);
+        ret = tmstat_merge_plan(row->table, &step, 1, row->data,
+                                lazy->src[k]);
     }
+    lazy->ready[i] = (ret == 0);
     return ret;
 }
 
 /**
- * Produce merged result set from child query.
+ * Merge every column of a lazily merged row not yet merged.
  *
- * @param[in]   stat        Associated segment.
- * @param[in]   table_name  Table name to put the merged rows into.
- * @param[in]   rows        Array containing source row indexes.
+ * @param[in]   row         Row.
  * @return 0 on success, -1 on failure.
  */
 static int
-tmstat_query_rollup_merge(TMSTAT stat, char *table_name, struct tmidx *rows)
+tmstat_row_resolve_all(TMROW row)
 {
-    struct tmidx    src;
-    TMROW           src_row, row;
-    TMTABLE         table;
-    signed          idx, ret;
-
-    if (tmidx_count(rows) < 2) {
-        /* No need to merge. */
+    if (row->lazy == NULL) {
         return 0;
     }
+    for (unsigned i = 0; i < row->table->col_count; i++) {
+        if (tmstat_row_resolve(row, i) != 0) {
+            /* tmstat_row_resolve sets errno. */
+            return -1;
+        }
+    }
+    return 0;
+}
 
-    /* Find the table. */
-    table = tmstat_table(stat, table_name);
-    if (table == NULL) {
-        /* If not found, we must still free the source rows. */
-        errno = EINVAL;
-        ret = -1;
-    } else {
-        ret = 0;
+/**
+ * Merge row fields.
+ *
+ * @param[in]   dst_row     Target row and result.
+ * @param[in]   src_row     Source row.
+ * @return 0 on success, -1 on failure.
+ */
+int
+tmstat_merge_row(TMROW dst_row, TMROW src_row)
+{
+    if ((tmstat_row_resolve_all(dst_row) != 0) ||
+        (tmstat_row_resolve_all(src_row) != 0)) {
+        /* tmstat_row_resolve_all sets errno. */
+        return -1;
     }
+    return tmstat_merge_data(dst_row->table, dst_row->data, src_row->data);
+}
+
+static inline uint64_t tmstat_key_hash(TMTABLE table, const uint8_t *data);
+
+/**
+ * Produce merged result set, in no particular order, by hashing keys
+ * into an open-addressed table.  Each slot holds the index (plus one)
+ * of a merged row; the key hash of every merged row is kept alongside
+ * so that most mismatches are rejected without comparing keys.
+ *
+ * @param[in]   table       Table whose rows we are merging.
+ * @param       rows        As for tmstat_merge_rows.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_merge_rows_hash(TMTABLE table, struct tmidx *rows)
+{
+    struct tmidx    src;
+    TMROW           src_row, row;
+    uint64_t       *hash = NULL;
+    unsigned       *slot = NULL;
+    uint64_t        h;
+    unsigned        i, j, size;
+    signed          idx, ret = 0;
+
     /* Move results into source index. */
     memcpy(&src, rows, sizeof(struct tmidx));
     tmidx_init(rows);
+    /* Keep the load factor at or below one half. */
+    size = 16;
+    while (size < 2 * tmidx_count(&src)) {
+        size <<= 1;
+    }
+    slot = (unsigned *)calloc(size, sizeof(*slot));
+    hash = (uint64_t *)malloc((tmidx_count(&src) + 1) * sizeof(*hash));
+    if ((slot == NULL) || (hash == NULL)) {
+        /* Memory exhaustion; calloc/malloc set errno. */
+        ret = -1;
+        i = 0;
+        goto out;
+    }
     /* Copy into results, merging as we find identical entries. */
-    TMIDX_FOREACH(&src, src_row) {
-        if (ret == -1) {
-            /* We had a problem; just free. */
-            goto next_row;
+    for (i = 0; i < tmidx_count(&src); i++) {
+        src_row = tmidx_entry(&src, i);
+        h = tmstat_key_hash(table, src_row->data);
+        for (j = h & (size - 1); slot[j] != 0; j = (j + 1) & (size - 1)) {
+            row = tmidx_entry(rows, slot[j] - 1);
+            if ((hash[slot[j] - 1] == h) &&
+                (tmstat_data_cmp(table, row->data, src_row->data) == 0)) {
+                break;
+            }
         }
-        /*
-         * We are ignoring keys, because this was called
-         * from tmstat_query_rollup which means the caller
-         * wants all rows merged, regardless of keys.
-         */
+        if (slot[j] != 0) {
+            /* Found.  Merge rows. */
+            tmstat_merge_row(row, src_row);
+        } else {
+            /* Not found.  Create a new pseudo row, copy data, insert. */
+            ret = tmstat_pseudo_row_create(table, &row);
+            if (ret < 0) {
+                break;
+            }
+            memcpy(row->data, src_row->data, table->rowsz);
+            idx = tmidx_add(rows, row);
+            if (idx < 0) {
+                tmstat_row_drop(row);
+                ret = -1;
+                break;
+            }
+            hash[idx] = h;
+            slot[j] = idx + 1;
+        }
+        /* Free source row. */
+        tmstat_row_drop(src_row);
+    }
+out:
+    /* Free any unprocessed source rows in the event of an error. */
+    for (; i < tmidx_count(&src); i++) {
+        tmstat_row_drop(tmidx_entry(&src, i));
+    }
+    tmidx_free(&src);
+    if (ret != 0) {
+        /* Failure.  Clean up partial results. */
         TMIDX_FOREACH(rows, row) {
-            /* Merge rows. */
-            ret = tmstat_merge_row(row, src_row);
-            goto next_row;
+            tmstat_row_drop(row);
         }
-        /* Create new row. */
-        ret = tmstat_row_create(stat, table, &row);
-        if (ret == -1) {
-            /* Creation error; continue but report error upon completion. */
-            goto next_row;
+        tmidx_free(rows);
+        tmidx_init(rows);
+    }
+    free(hash);
+    free(slot);
+    return ret;
+}
+
+/**
+ * Group result set rows by key, in order of first appearance, without
+ * merging their non-key columns yet.  Each group becomes a pseudo row
+ * holding a copy of its first source; a group of several sources also
+ * records where the rest lie, and tmstat_row_resolve merges a column
+ * from them when it is first read.
+ *
+ * @param[in]   table       Table whose rows we are merging.
+ * @param       rows        As for tmstat_merge_rows.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_merge_rows_lazy(TMTABLE table, struct tmidx *rows)
+{
+    struct tmidx    src;
+    struct tmstat_lazy *lazy;
+    TMROW           src_row, row;
+    uint64_t       *hash = NULL;
+    unsigned       *slot = NULL, *group = NULL, *count = NULL;
+    uint64_t        h;
+    unsigned        i, j, n, size;
+    signed          idx, ret = 0;
+
+    /* Move results into source index. */
+    memcpy(&src, rows, sizeof(struct tmidx));
+    tmidx_init(rows);
+    n = tmidx_count(&src);
+    /* Keep the load factor at or below one half. */
+    size = 16;
+    while (size < 2 * n) {
+        size <<= 1;
+    }
+    slot = (unsigned *)calloc(size, sizeof(*slot));
+    hash = (uint64_t *)malloc((n + 1) * sizeof(*hash));
+    group = (unsigned *)malloc((n + 1) * sizeof(*group));
+    count = (unsigned *)calloc(n + 1, sizeof(*count));
+    if ((slot == NULL) || (hash == NULL) || (group == NULL) ||
+        (count == NULL)) {
+        /* Memory exhaustion; calloc/malloc set errno. */
+        ret = -1;
+        goto out;
+    }
+    /* Assign each source row to the group of its key. */
+    for (i = 0; i < n; i++) {
+        src_row = tmidx_entry(&src, i);
+        h = tmstat_key_hash(table, src_row->data);
+        for (j = h & (size - 1); slot[j] != 0; j = (j + 1) & (size - 1)) {
+            row = tmidx_entry(rows, slot[j] - 1);
+            if ((hash[slot[j] - 1] == h) &&
+                (tmstat_data_cmp(table, row->data, src_row->data) == 0)) {
+                break;
+            }
         }
-        memcpy(row->data, src_row->data, table->rowsz);
-        idx = tmidx_add(rows, row);
-        if (idx == -1) {
-            /* Insertion error; continue but report error upon completion. */
-            tmstat_row_drop(row);
-            ret = -1;
-            goto next_row;
+        if (slot[j] == 0) {
+            /* New key.  Create a pseudo row from its first source. */
+            ret = tmstat_pseudo_row_create(table, &row);
+            if (ret < 0) {
+                goto out;
+            }
+            memcpy(row->data, src_row->data, table->rowsz);
+            idx = tmidx_add(rows, row);
+            if (idx < 0) {
+                tmstat_row_drop(row);
+                ret = -1;
+                goto out;
+            }
+            hash[idx] = h;
+            slot[j] = idx + 1;
+        }
+        group[i] = slot[j] - 1;
+        count[group[i]]++;
+    }
+    /* Record the sources of each group that needs merging. */
+    for (i = 0; i < n; i++) {
+        row = tmidx_entry(rows, group[i]);
+        if (count[group[i]] < 2) {
+            continue;
+        }
+        if (row->lazy == NULL) {
+            lazy = (struct tmstat_lazy *)malloc(
+                sizeof(struct tmstat_lazy) +
+                count[group[i]] * sizeof(lazy->src[0]) +
+                table->col_count * sizeof(bool));
+            if (lazy == NULL) {
+                /* Memory exhaustion; malloc sets errno. */
+                ret = -1;
+                goto out;
+            }
+            lazy->ready = (bool *)&lazy->src[count[group[i]]];
+            lazy->src_count = 0;
+            for (j = 0; j < table->col_count; j++) {
+                /* Keys are alike, and unknown rules are not merged. */
+                lazy->ready[j] = ((table->col[j].rule == TMSTAT_R_KEY) ||
+                                  (table->col[j].rule > TMSTAT_R_MAX));
+            }
+            row->lazy = lazy;
         }
-next_row:
+        src_row = tmidx_entry(&src, i);
+        row->lazy->src[row->lazy->src_count++] = src_row->data;
+    }
+out:
+    /* Source data stay mapped for as long as the pseudo rows live. */
+    TMIDX_FOREACH(&src, src_row) {
         tmstat_row_drop(src_row);
     }
     tmidx_free(&src);
+    if (ret != 0) {
+        /* Failure.  Clean up partial results. */
+        TMIDX_FOREACH(rows, row) {
+            tmstat_row_drop(row);
+        }
+        tmidx_free(rows);
+        tmidx_init(rows);
+    }
+    free(count);
+    free(group);
+    free(hash);
+    free(slot);
+    return ret;
+}
+
+/**
+ * Parallel merge job.  Hashing jobs fill in hash for source rows
+ * [first, last); partition jobs then merge the source rows listed in
+ * member, all of which hash to the partition.
+ */
+struct tmstat_merge_job {
+    TMTABLE             table;          //!< Table whose rows we merge.
+    struct tmidx       *src;            //!< Source rows.
+    uint64_t           *hash;           //!< Key hash of each source row.
+    unsigned            first;          //!< First source row to hash.
+    unsigned            last;           //!< End of source rows to hash.
+    const unsigned     *member;         //!< Source rows in partition.
+    unsigned            member_count;   //!< Number of members.
+    uint8_t            *acc;            //!< Merged row data.
+    unsigned           *origin;         //!< First source row of each.
+    uint64_t           *acc_hash;       //!< Key hash of each.
+    unsigned            count;          //!< Merged rows.
+    signed              ret;            //!< Result.
+    int                 err;            //!< errno on failure.
+};
+
+/**
+ * Pool job: hash the keys of a run of source rows.
+ *
+ * @param[in]   arg         struct tmstat_merge_job.
+ */
+static void
+tmstat_merge_hash(void *arg)
+{
+    struct tmstat_merge_job *job = (struct tmstat_merge_job *)arg;
+    TMROW           row;
+
+    for (unsigned i = job->first; i < job->last; i++) {
+        row = tmidx_entry(job->src, i);
+        job->hash[i] = tmstat_key_hash(job->table, row->data);
+    }
+}
+
+/**
+ * Pool job: merge the rows of one partition, in source order, into
+ * private buffers.  Nothing shared is written.
+ *
+ * @param[in]   arg         struct tmstat_merge_job.
+ */
+static void
+tmstat_merge_partition(void *arg)
+{
+    struct tmstat_merge_job *job = (struct tmstat_merge_job *)arg;
+    size_t          rowsz = job->table->rowsz;
+    unsigned       *slot;
+    const uint8_t  *data;
+    uint64_t        h;
+    unsigned        i, j, size = 16;
+
+    while (size < 2 * job->member_count) {
+        size <<= 1;
+    }
+    slot = (unsigned *)calloc(size, sizeof(*slot));
+    job->acc = (uint8_t *)malloc(job->member_count * rowsz + 1);
+    job->origin = (unsigned *)malloc((job->member_count + 1) *
+                                     sizeof(unsigned));
+    job->acc_hash = (uint64_t *)malloc((job->member_count + 1) *
+                                       sizeof(uint64_t));
+    if ((slot == NULL) || (job->acc == NULL) || (job->origin == NULL) ||
+        (job->acc_hash == NULL)) {
+        job->ret = -1;
+        job->err = errno;
+        free(slot);
+        return;
+    }
+    for (i = 0; i < job->member_count; i++) {
+        h = job->hash[job->member[i]];
+        data = ((TMROW)tmidx_entry(job->src, job->member[i]))->data;
+        for (j = h & (size - 1); slot[j] != 0; j = (j + 1) & (size - 1)) {
+            if ((job->acc_hash[slot[j] - 1] == h) &&
+                (tmstat_data_cmp(job->table,
+                                 &job->acc[(slot[j] - 1) * rowsz],
+                                 data) == 0)) {
+                break;
+            }
+        }
+        if (slot[j] != 0) {
+            /* Found.  Merge rows. */
+            if (tmstat_merge_data(job->table,
+                                  &job->acc[(slot[j] - 1) * rowsz],
+                                  data) != 0) {
+                job->ret = -1;
+                job->err = errno;
+                break;
+            }
+        } else {
+            /* Not found.  Start a new merged row. */
+            memcpy(&job->acc[job->count * rowsz], data, rowsz);
+            job->origin[job->count] = job->member[i];
+            job->acc_hash[job->count] = h;
+            slot[j] = ++job->count;
+        }
+    }
+    free(slot);
+}
+
+/**
+ * Merge rows across the segment's worker threads.  Keys are hashed in
+ * parallel, the source rows are split by hash into one partition per
+ * thread (keeping source order within each), and every partition is
+ * merged on its own.  Merged rows are then emitted in order of their
+ * first source row, so the result, order included, is exactly that of
+ * tmstat_merge_rows_hash.
+ *
+ * @param[in]   table       Table whose rows we are merging.
+ * @param       rows        As for tmstat_merge_rows.
+ * @param[in]   pool        Worker threads.
+ * @return 0 on success, 1 if there are too few rows to bother (rows is
+ *         untouched), or -1 on failure.
+ */
+static int
+tmstat_merge_rows_parallel(TMTABLE table, struct tmidx *rows,
+                           struct tmstat_pool *pool)
+{
+    struct tmstat_merge_job *job = NULL;
+    struct tmidx    src;
+    uint64_t       *hash = NULL;
+    unsigned       *member = NULL, *offset = NULL;
+    uint8_t       **merged = NULL;
+    TMROW           row;
+    unsigned        i, p, n, job_count;
+    signed          ret = -1;
+
+    n = tmidx_count(rows);
+    if (n < TMSTAT_PARALLEL_ROWS) {
+        /* Not worth the handoff. */
+        return 1;
+    }
+    /* Move results into source index. */
+    memcpy(&src, rows, sizeof(struct tmidx));
+    tmidx_init(rows);
+    job_count = pool->thread_count + 1;
+    job = (struct tmstat_merge_job *)calloc(job_count, sizeof(*job));
+    hash = (uint64_t *)malloc(n * sizeof(*hash));
+    member = (unsigned *)malloc(n * sizeof(*member));
+    offset = (unsigned *)calloc(job_count + 1, sizeof(*offset));
+    merged = (uint8_t **)calloc(n, sizeof(*merged));
+    if ((job == NULL) || (hash == NULL) || (member == NULL) ||
+        (offset == NULL) || (merged == NULL)) {
+        /* Allocation failure; calloc/malloc set errno. */
+        goto out;
+    }
+    for (i = 0; i < job_count; i++) {
+        job[i].table = table;
+        job[i].src = &src;
+        job[i].hash = hash;
+        job[i].first = (unsigned)((uint64_t)n * i / job_count);
+        job[i].last = (unsigned)((uint64_t)n * (i + 1) / job_count);
+    }
+    tmstat_pool_run(pool, tmstat_merge_hash, job, sizeof(*job), job_count);
+    /* Partition by hash, keeping source order within each partition. */
+    for (i = 0; i < n; i++) {
+        offset[(hash[i] >> 32) % job_count + 1]++;
+    }
+    for (p = 0; p < job_count; p++) {
+        offset[p + 1] += offset[p];
+        job[p].member = &member[offset[p]];
+        job[p].member_count = offset[p + 1] - offset[p];
+    }
+    for (i = 0; i < n; i++) {
+        p = (hash[i] >> 32) % job_count;
+        member[offset[p]++] = i;
+    }
+    tmstat_pool_run(pool, tmstat_merge_partition, job, sizeof(*job),
+                    job_count);
+    for (p = 0; p < job_count; p++) {
+        if (job[p].ret != 0) {
+            errno = job[p].err;
+            goto out;
+        }
+        for (i = 0; i < job[p].count; i++) {
+            merged[job[p].origin[i]] = &job[p].acc[i * table->rowsz];
+        }
+    }
+    /* Emit merged rows in order of first appearance. */
+    for (i = 0; i < n; i++) {
+        if (merged[i] == NULL) {
+            continue;
+        }
+        if (tmstat_pseudo_row_create(table, &row) != 0) {
+            goto out;
+        }
+        memcpy(row->data, merged[i], table->rowsz);
+        if (tmidx_add(rows, row) < 0) {
+            tmstat_row_drop(row);
+            goto out;
+        }
+    }
+    ret = 0;
+out:
+    TMIDX_FOREACH(&src, row) {
+        tmstat_row_drop(row);
+    }
+    tmidx_free(&src);
+    if (ret != 0) {
+        /* Failure.  Clean up partial results. */
+        TMIDX_FOREACH(rows, row) {
+            tmstat_row_drop(row);
+        }
+        tmidx_free(rows);
+        tmidx_init(rows);
+    }
+    if (job != NULL) {
+        for (p = 0; p < job_count; p++) {
+            free(job[p].acc);
+            free(job[p].origin);
+            free(job[p].acc_hash);
+        }
+    }
+    free(merged);
+    free(offset);
+    free(member);
+    free(hash);
+    free(job);
     return ret;
 }
 
+/**
+ * Produce merged result set.
+ *
+ * This is a common operation for readers, so it is performance
+ * critical.  It is assumed that the incoming rows are unsorted (which
+ * is almost always the case).  Rows are merged by hashing keys (see
+ * tmstat_merge_rows_hash), so the result is in no particular order;
+ * tmstat_merge, which wants order, sorts for itself.
+ *
+ * @param[in]   table       Table whose rows we are merging.
+ * @param       rows        On entry, contains source rows.
+ *                          On return, contains merged rows.
+ *                          Regardless of success, the original index is freed
+ *                          and all the original rows are dropped.
+ *                          The returned rows are pseudo rows.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_merge_rows(TMTABLE table, struct tmidx *rows)
+{
+    signed          ret;
+
+    if (table->stat->pool != NULL) {
+        /* Big merges are shared with the worker threads. */
+        ret = tmstat_merge_rows_parallel(table, rows, table->stat->pool);
+        if (ret != 1) {
+            return ret;
+        }
+    }
+    return tmstat_merge_rows_hash(table, rows);
+}
+
 /**
  * Locate rows by column values among children segments.
  *
  * @param[in]   stat        Segment to search.
- * @param[out]  rows        Array containing result row indexes.
  * @param[in]   table_name  Table name.
  * @param[in]   col_count   Number of columns to key on.
  * @param[in]   col_name    Column names to key upon.
  * @param[in]   col_value   Column values to match.
- * @return 0 on success, -1 on failure.
+ * @param[in]   fn          Callback for each matching row.
+ * @param[in]   arg         Callback context.
+ * @return 0 on success, -1 on failure, or the callback's positive stop value.
  */
 static int
-tmstat_query_children(TMSTAT stat, struct tmidx *rows, char *table_name,
-                      unsigned col_count, char **col_name, void **col_value)
+tmstat_query_children(TMSTAT stat, char *table_name,
+                      unsigned col_count, char **col_name, void **col_value,
+                      tmstat_scan_fn fn, void *arg)
 {
     TMSTAT          child;
     TMTABLE         table;
@@ -4145,10 +5448,10 @@ tmstat_query_children(TMSTAT stat, struct tmidx *rows, char *table_name,
             /* Table doesn't exist in child; try other children. */
             continue;
         }
-        ret = tmstat_query_table(stat, table, rows,
-                                 col_count, col_name, col_value);
-        if (ret == -1) {
-            /* Internal failure; tmstat_query_table sets errno. */
+        ret = tmstat_query_table(stat, table, col_count, col_name, col_value,
+                                 fn, arg);
+        if (ret != 0) {
+            /* Stopped, or internal failure; tmstat_query_table sets errno. */
             goto out;
         }
     }
@@ -4167,6 +5470,10 @@ tmstat_is_directly_unreferenced(TMSTAT stat)
 {
     TMTABLE         table;
 
+    if (stat->pin_count != 0) {
+        /* A scan is walking this segment's slabs. */
+        return false;
+    }
     TMIDX_FOREACH(&stat->table_idx, table) {
         if (table->row_list.lh_first != NULL) {
             return false;
@@ -4229,8 +5536,9 @@ tmstat_is_subscription_unfresh(TMSTAT tmstat)
 
 /*
  * Reread the files in the directory to which stat is subscribed.
+ * Returns 0 on success, -1 (leaving stat untouched) on failure.
  */
-static void
+static int
 tmstat_freshen_subscription(TMSTAT stat)
 {
     struct TMSTAT       old;
@@ -4246,7 +5554,7 @@ tmstat_freshen_subscription(TMSTAT stat)
     /* Save the old guts. */
     memcpy(&old, stat, sizeof(struct TMSTAT));
     /* Re-subscribe, creating new guts. */
-    ret = _tmstat_subscribe(stat, old.directory);
+    ret = _tmstat_subscribe(stat, old.directory, old.select);
     /* Save new guts (or maybe nothing if we failed). */
     memcpy(&new, stat, sizeof(struct TMSTAT));
     /*
@@ -4256,24 +5564,69 @@ tmstat_freshen_subscription(TMSTAT stat)
     memcpy(stat, &old, sizeof(struct TMSTAT));
     if (ret != 0) {
         /* We failed.  Return old guts. */
-        return;
+        return -1;
     }
     /* Success!  Free the old guts. */
     _tmstat_dealloc(stat);
+    /* Every table has moved; let prepared queries know. */
+    new.generation = old.generation + 1;
+    /* Worker threads outlive the guts. */
+    new.pool = old.pool;
     /* Swap in the new guts. */
     memcpy(stat, &new, sizeof(struct TMSTAT));
+    return 0;
 }
 
-/**
- * Reread data if possible and appropriate.  If force is true, the
- * data will be reread even if they appear to be up-to-date.
- * If this fails, it does so silently and leaves stat untouched.
- *
- * @param[in]   stat        Stat handle to refresh.
- * @param[in]   force       Force refresh?
+/*
+ * Change the child pattern of a subscription and reread its directory.
  */
-void
-tmstat_refresh(TMSTAT stat, int force)
+int
+tmstat_select(TMSTAT stat, const char *pattern)
+{
+    char           *copy = NULL;
+    char           *old;
+    int             ret;
+
+    if (stat->origin != SUBSCRIBE) {
+        /* Only subscriptions know where to find other children. */
+        errno = EINVAL;
+        return -1;
+    }
+    if (!tmstat_is_unreferenced(stat)) {
+        /* Outstanding rows point into the current children. */
+        errno = EBUSY;
+        return -1;
+    }
+    if (pattern != NULL) {
+        copy = strdup(pattern);
+        if (copy == NULL) {
+            /* Memory exhaustion; strdup sets errno. */
+            return -1;
+        }
+    }
+    old = stat->select;
+    stat->select = copy;
+    ret = tmstat_freshen_subscription(stat);
+    if (ret != 0) {
+        /* Failure; _tmstat_subscribe sets errno. */
+        stat->select = old;
+        free(copy);
+        return -1;
+    }
+    free(old);
+    return 0;
+}
+
+/**
+ * Reread data if possible and appropriate.  If force is true, the
+ * data will be reread even if they appear to be up-to-date.
+ * If this fails, it does so silently and leaves stat untouched.
+ *
+ * @param[in]   stat        Stat handle to refresh.
+ * @param[in]   force       Force refresh?
+ */
+void
+tmstat_refresh(TMSTAT stat, int force)
 {
     switch (stat->origin) {
     case SUBSCRIBE:
@@ -4291,16 +5644,17 @@ tmstat_refresh(TMSTAT stat, int force)
  * Locate rows by column values.
  */
 static int
-_tmstat_query(TMSTAT stat, struct tmidx *rows, char *table_name,
-              unsigned col_count, char **col_name, void **col_value)
+_tmstat_query(TMSTAT stat, char *table_name,
+              unsigned col_count, char **col_name, void **col_value,
+              tmstat_scan_fn fn, void *arg)
 {
     TMTABLE             table;
     signed              ret;
 
     if (stat->origin != CREATE) {
         /* We are querying the child(ren), not this segment itself. */
-        ret = tmstat_query_children(stat, rows, table_name,
-            col_count, col_name, col_value);
+        ret = tmstat_query_children(stat, table_name,
+            col_count, col_name, col_value, fn, arg);
     } else {
         /* This segment is the one we're interested in. */
         table = tmstat_table(stat, table_name);
@@ -4309,77 +5663,3649 @@ _tmstat_query(TMSTAT stat, struct tmidx *rows, char *table_name,
             ret = 0;
         } else {
             /* Locate rows. */
-            ret = tmstat_query_table(stat, table, rows, col_count,
-                                     col_name, col_value);
+            ret = tmstat_query_table(stat, table, col_count,
+                                     col_name, col_value, fn, arg);
         }
     }
     return ret;
 }
 
-/*
- * Locate rows by column values.
+/**
+ * Prepared query.
  */
-int
-tmstat_query(TMSTAT stat, char *table_name,
-             unsigned col_count, char **col_name, void **col_value,
-             TMROW **row_handle, unsigned *match_count)
+struct TMQUERY {
+    TMSTAT              stat;           //!< Segment to search.
+    char               *table_name;     //!< Table name.
+    unsigned            col_count;      //!< Number of columns to key on.
+    char              **col_name;       //!< Column names to key upon.
+    bool                resolved;       //!< Resolution below is current.
+    uint64_t            generation;     //!< Generation resolved against.
+    TMTABLE             table;          //!< Result table, or NULL.
+    unsigned            qtable_count;   //!< Tables to search.
+    struct tmstat_qtable *qtable;       //!< Per-table resolution.
+    TMCOL              *cols;           //!< Storage for resolved columns.
+    uint8_t            *key;            //!< Key scratch buffer.
+};
+
+/**
+ * Obtain a segment's generation, first bumping it if any child's has
+ * moved since last seen, so that a change anywhere beneath a union is
+ * seen.  A new set of children comes with new guts, whose generation
+ * has already been bumped.
+ *
+ * @param[in]   stat        Segment.
+ * @return generation.
+ */
+static uint64_t
+tmstat_generation(TMSTAT stat)
 {
-    struct tmidx        rows;
-    TMROW               row;
-    TMTABLE             table;
-    signed              ret;
+    unsigned            count = tmidx_count(&stat->child_idx);
+    uint64_t            generation;
+    bool                moved = false;
+    unsigned            i;
 
-    *match_count = 0;
-    if (row_handle != NULL) {
-        *row_handle = NULL;
+    if (count == 0) {
+        return stat->generation;
     }
-    tmstat_refresh(stat, false);
-    tmidx_init(&rows);
-    ret = _tmstat_query(stat, &rows, table_name, col_count,
-                        col_name, col_value);
-    if (ret != 0) {
-        goto end;
+    if (stat->child_gen == NULL) {
+        stat->child_gen = (uint64_t *)calloc(count, sizeof(uint64_t));
+        if (stat->child_gen == NULL) {
+            /* Memory exhaustion; assume that something has moved. */
+            return ++stat->generation;
+        }
     }
-    table = tmstat_table(stat, table_name);
-    if (table == NULL) {
+    for (i = 0; i < count; i++) {
+        generation = tmstat_generation(tmidx_entry(&stat->child_idx, i));
+        if (stat->child_gen[i] != generation) {
+            stat->child_gen[i] = generation;
+            moved = true;
+        }
+    }
+    if (moved) {
+        stat->generation++;
+    }
+    return stat->generation;
+}
+
+/**
+ * Discard a prepared query's resolution.
+ *
+ * @param[in]   query       Prepared query.
+ */
+static void
+tmstat_query_unresolve(TMQUERY query)
+{
+    free(query->qtable);
+    free(query->cols);
+    free(query->key);
+    query->qtable = NULL;
+    query->cols = NULL;
+    query->key = NULL;
+    query->qtable_count = 0;
+    query->table = NULL;
+    query->resolved = false;
+}
+
+/**
+ * Resolve a prepared query against its segment's current tables, unless
+ * the existing resolution is still current.
+ *
+ * @param[in]   query       Prepared query.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_query_freshen(TMQUERY query)
+{
+    TMSTAT              stat = query->stat;
+    TMSTAT              child;
+    TMTABLE             table;
+    struct tmidx        tables;
+    unsigned            i, rowsz = 0;
+    bool                keyed = false;
+    signed              ret = -1;
+
+    if (query->resolved &&
+        (query->generation == tmstat_generation(stat))) {
+        /* Nothing has moved. */
+        return 0;
+    }
+    tmstat_query_unresolve(query);
+    query->table = tmstat_table(stat, query->table_name);
+    /* Find the tables a scan would visit. */
+    tmidx_init(&tables);
+    if (query->table == NULL) {
         /* No matching table; treat as if the table were empty. */
-        /* match_count and row_handle already cleared above. */
-        ret = 0;
-        goto end;
+    } else if (stat->origin != CREATE) {
+        TMIDX_FOREACH(&stat->child_idx, child) {
+            table = tmstat_table(child, query->table_name);
+            if ((table != NULL) && (tmidx_add(&tables, table) < 0)) {
+                /* Allocation failure; tmidx_add sets errno. */
+                goto out;
+            }
+        }
+    } else if (tmidx_add(&tables, query->table) < 0) {
+        /* Allocation failure; tmidx_add sets errno. */
+        goto out;
+    }
+    query->qtable_count = tmidx_count(&tables);
+    query->qtable = (struct tmstat_qtable *)calloc(query->qtable_count + 1,
+        sizeof(struct tmstat_qtable));
+    query->cols = (TMCOL *)calloc(
+        query->qtable_count * query->col_count + 1, sizeof(TMCOL));
+    if ((query->qtable == NULL) || (query->cols == NULL)) {
+        /* Allocation failure; calloc sets errno. */
+        goto out;
+    }
+    for (i = 0; i < query->qtable_count; i++) {
+        table = tmidx_entry(&tables, i);
+        query->qtable[i].cols = &query->cols[i * query->col_count];
+        if (tmstat_qtable_resolve(&query->qtable[i], table,
+                                  query->col_count, query->col_name) != 0) {
+            /* tmstat_qtable_resolve sets errno. */
+            goto out;
+        }
+        keyed |= query->qtable[i].keyed;
+        rowsz = TMSTAT_MAX(rowsz, table->rowsz);
+    }
+    if (keyed) {
+        query->key = (uint8_t *)calloc(1, rowsz);
+        if (query->key == NULL) {
+            /* Allocation failure; calloc sets errno. */
+            goto out;
+        }
+    }
+    query->generation = tmstat_generation(stat);
+    query->resolved = true;
+    ret = 0;
+out:
+    if (ret != 0) {
+        tmstat_query_unresolve(query);
+    }
+    tmidx_free(&tables);
+    return ret;
+}
+
+/**
+ * Locate rows for a resolved prepared query.
+ *
+ * @param[in]   query       Prepared query.
+ * @param[in]   col_value   Column values to match.
+ * @param[in]   fn          Callback for each matching row.
+ * @param[in]   arg         Callback context.
+ * @return 0 on success, -1 on failure, or the callback's positive stop value.
+ */
+static int
+tmstat_query_scan(TMQUERY query, void **col_value, tmstat_scan_fn fn,
+                  void *arg)
+{
+    signed              ret = 0;
+
+    for (unsigned i = 0; (ret == 0) && (i < query->qtable_count); i++) {
+        ret = tmstat_query_resolved(query->stat, &query->qtable[i],
+                                    query->col_count, col_value, query->key,
+                                    fn, arg);
     }
-    if (table->want_merge) {
-        ret = tmstat_merge_rows(table, &rows, NULL);
+    return ret;
+}
+
+/**
+ * Merge collected rows if need be and hand them to the caller.
+ *
+ * @param[in]   table       Result table.
+ * @param       rows        Collected rows; freed.
+ * @param[in]   merge       Merge rows by key if the table wants it.
+ * @param[out]  row_handle  Array containing result rows.
+ * @param[out]  match_count Number of result rows.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_query_finish(TMTABLE table, struct tmidx *rows, bool merge,
+                    TMROW **row_handle, unsigned *match_count)
+{
+    TMROW               row;
+    signed              ret = 0;
+
+    if (merge && table->want_merge) {
+        ret = tmstat_merge_rows(table, rows);
     }
     if (ret != 0) {
         goto end;
     }
-    *match_count = tmidx_count(&rows);
-    if (row_handle == NULL) {
-        /*
-         * Caller doesn't care about result rows, only the count, so
-         * free row handles.
-         */
-        TMIDX_FOREACH(&rows, row) {
+    *match_count = tmidx_count(rows);
+    /* Allocate and populate result array. */
+    *row_handle = (TMROW *)calloc(*match_count, sizeof(TMROW));
+    if (*row_handle != NULL) {
+        unsigned i = 0;
+        TMIDX_FOREACH(rows, row) {
+            (*row_handle)[i++] = row;
+        }
+    } else {
+        /* Out of memory.  Free row handles. */
+        TMIDX_FOREACH(rows, row) {
             tmstat_row_drop(row);
         }
-    } else {
-        /* Allocate and populate result array. */
-        *row_handle = (TMROW *)calloc(*match_count, sizeof(TMROW));
-        if (*row_handle != NULL) {
-            unsigned i = 0;
-            TMIDX_FOREACH(&rows, row) {
-                (*row_handle)[i++] = row;
-            }
-        } else {
-            /* Out of memory.  Free row handles. */
-            TMIDX_FOREACH(&rows, row) {
-                tmstat_row_drop(row);
-            }
-            ret = -1;
+        *match_count = 0;
+        ret = -1;
+    }
+end:
+    tmidx_free(rows);
+    return ret;
+}
+
+/**
+ * Rows merged by key, as kept by a cached view.  Rows are never
+ * unhashed: one whose sources have all gone keeps its slot with a zero
+ * count, ready for the key to come back, and the map is compacted once
+ * such rows outnumber the live ones.
+ */
+struct tmstat_vmap {
+    uint8_t            *data;           //!< Row data, rowsz apart.
+    unsigned           *count;          //!< Sources merged into each row.
+    uint64_t           *hash;           //!< Key hash of each row.
+    unsigned           *slot;           //!< Row index plus one, or 0.
+    unsigned            n;              //!< Rows.
+    unsigned            live;           //!< Rows with a nonzero count.
+    unsigned            cap;            //!< Row capacity.
+    unsigned            size;           //!< Slots; a power of two.
+};
+
+/**
+ * One child's share of a cached view.
+ */
+struct tmstat_vchild {
+    TMSTAT              child;          //!< Child segment.
+    struct tmstat_label *label;         //!< Commit counter, or NULL.
+    bool                current;        //!< part is as of commits.
+    uint64_t            commits;        //!< Child's commit count at scan.
+    struct tmstat_vmap  part;           //!< Child's rows, merged by key.
+};
+
+/**
+ * Cached merged view of one of a union's tables.
+ */
+struct tmstat_view {
+    TMTABLE             table;          //!< Union table.
+    bool                invertible;     //!< Merge plan is all sums.
+    uint64_t            generation;     //!< tmstat_generation when built.
+    struct tmstat_vchild *child;        //!< Children, or NULL if unbuilt.
+    unsigned            child_count;    //!< Number of children.
+    struct tmstat_vmap  merged;         //!< Rows merged across children.
+};
+
+/**
+ * Scan context for filling a child's share of a view.
+ */
+struct tmstat_vscan {
+    TMTABLE             table;          //!< Union table.
+    struct tmstat_vmap *map;            //!< Map to fill.
+};
+
+/**
+ * Free a view map.
+ *
+ * @param       m           Map; left empty.
+ */
+static void
+tmstat_vmap_free(struct tmstat_vmap *m)
+{
+    free(m->data);
+    free(m->count);
+    free(m->hash);
+    free(m->slot);
+    memset(m, 0, sizeof(*m));
+}
+
+/**
+ * Find the slot holding a key, or the empty slot where it belongs.
+ *
+ * @param[in]   table       Table describing the rows.
+ * @param[in]   m           Map; must have slots.
+ * @param[in]   data        Row data holding the key.
+ * @param[in]   h           tmstat_key_hash of data.
+ * @return slot.
+ */
+static unsigned *
+tmstat_vmap_slot(TMTABLE table, struct tmstat_vmap *m, const uint8_t *data,
+                 uint64_t h)
+{
+    unsigned            i, e;
+
+    for (i = h & (m->size - 1); m->slot[i] != 0; i = (i + 1) & (m->size - 1)) {
+        e = m->slot[i] - 1;
+        if ((m->hash[e] == h) &&
+            (tmstat_data_cmp(table, &m->data[e * table->rowsz], data) == 0)) {
+            break;
+        }
+    }
+    return &m->slot[i];
+}
+
+/**
+ * Find the row holding a key.
+ *
+ * @param[in]   table       Table describing the rows.
+ * @param[in]   m           Map.
+ * @param[in]   data        Row data holding the key.
+ * @return row index, or -1 if the key has never been added.
+ */
+static signed
+tmstat_vmap_find(TMTABLE table, struct tmstat_vmap *m, const uint8_t *data)
+{
+    if (m->size == 0) {
+        return -1;
+    }
+    return (signed)*tmstat_vmap_slot(table, m, data,
+                                     tmstat_key_hash(table, data)) - 1;
+}
+
+/**
+ * Make room in a map for one more row, dropping rows with a zero count
+ * if they have come to outnumber the live ones.  Row indices are only
+ * stable until the next call.
+ *
+ * @param[in]   table       Table describing the rows.
+ * @param       m           Map.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_vmap_reserve(TMTABLE table, struct tmstat_vmap *m)
+{
+    size_t              rowsz = table->rowsz;
+    bool                compact = (m->n - m->live > m->live + 16);
+    unsigned            need = (compact ? m->live : m->n) + 1;
+    unsigned            cap, size, i, j, n;
+    unsigned           *slot;
+    void               *p;
+
+    if (need > m->cap) {
+        cap = TMSTAT_MAX(16, 2 * m->cap);
+        /* Each array is kept on success, so failure leaves m intact. */
+        if ((p = realloc(m->data, cap * rowsz)) == NULL) {
+            return -1;
+        }
+        m->data = p;
+        if ((p = realloc(m->count, cap * sizeof(*m->count))) == NULL) {
+            return -1;
+        }
+        m->count = p;
+        if ((p = realloc(m->hash, cap * sizeof(*m->hash))) == NULL) {
+            return -1;
+        }
+        m->hash = p;
+        m->cap = cap;
+    }
+    if (!compact && (2 * need <= m->size)) {
+        return 0;
+    }
+    size = 16;
+    while (size < 2 * need) {
+        size <<= 1;
+    }
+    slot = (unsigned *)calloc(size, sizeof(*slot));
+    if (slot == NULL) {
+        /* Memory exhaustion; calloc sets errno. */
+        return -1;
+    }
+    if (compact) {
+        for (i = n = 0; i < m->n; i++) {
+            if (m->count[i] == 0) {
+                continue;
+            }
+            if (i != n) {
+                memcpy(&m->data[n * rowsz], &m->data[i * rowsz], rowsz);
+                m->count[n] = m->count[i];
+                m->hash[n] = m->hash[i];
+            }
+            n++;
+        }
+        m->n = n;
+    }
+    for (i = 0; i < m->n; i++) {
+        j = m->hash[i] & (size - 1);
+        while (slot[j] != 0) {
+            j = (j + 1) & (size - 1);
+        }
+        slot[j] = i + 1;
+    }
+    free(m->slot);
+    m->slot = slot;
+    m->size = size;
+    return 0;
+}
+
+/**
+ * Merge a row into a map, adding it if its key is new (or gone).
+ *
+ * @param[in]   table       Table describing the rows.
+ * @param       m           Map.
+ * @param[in]   data        Row data.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_vmap_add(TMTABLE table, struct tmstat_vmap *m, const uint8_t *data)
+{
+    uint64_t            h = tmstat_key_hash(table, data);
+    unsigned           *slot;
+    unsigned            e;
+
+    if (tmstat_vmap_reserve(table, m) != 0) {
+        /* tmstat_vmap_reserve sets errno. */
+        return -1;
+    }
+    slot = tmstat_vmap_slot(table, m, data, h);
+    if (*slot == 0) {
+        e = m->n++;
+        *slot = e + 1;
+        m->hash[e] = h;
+        m->count[e] = 0;
+    }
+    e = *slot - 1;
+    if (m->count[e]++ == 0) {
+        memcpy(&m->data[e * table->rowsz], data, table->rowsz);
+        m->live++;
+        return 0;
+    }
+    return tmstat_merge_data(table, &m->data[e * table->rowsz], data);
+}
+
+/**
+ * Take a row previously merged by tmstat_vmap_add back out of a map.
+ * Only sums can be taken back out; see tmstat_merge_invertible.
+ *
+ * @param[in]   table       Table describing the rows.
+ * @param       m           Map.
+ * @param[in]   data        Row data.
+ */
+static void
+tmstat_vmap_sub(TMTABLE table, struct tmstat_vmap *m, const uint8_t *data)
+{
+    const struct tmstat_mstep *step, *end;
+    void               *a;
+    const void         *b;
+    signed              e;
+
+    e = tmstat_vmap_find(table, m, data);
+    if ((e < 0) || (m->count[e] == 0)) {
+        return;
+    }
+    end = table->merge + table->merge_count;
+    for (step = table->merge; step < end; step++) {
+        a = (void *)&m->data[e * table->rowsz + step->offset];
+        b = (const void *)&data[step->offset];
+        switch (step->op) {
+        case TMSTAT_MOP_SUM8:   TMSTAT_MERGE_RUN(uint8_t,  x[j] - y[j]); break;
+        case TMSTAT_MOP_SUM16:  TMSTAT_MERGE_RUN(uint16_t, x[j] - y[j]); break;
+        case TMSTAT_MOP_SUM32:  TMSTAT_MERGE_RUN(uint32_t, x[j] - y[j]); break;
+        case TMSTAT_MOP_SUM64:  TMSTAT_MERGE_RUN(uint64_t, x[j] - y[j]); break;
+        default:
+            break;
+        }
+    }
+    if (--m->count[e] == 0) {
+        m->live--;
+    }
+}
+
+/**
+ * Determine whether every merged column of a table is a sum, so that
+ * rows can be taken back out of a merged row.
+ *
+ * @param[in]   table       Table.
+ * @return true if so.
+ */
+static bool
+tmstat_merge_invertible(TMTABLE table)
+{
+    for (unsigned i = 0; i < table->merge_count; i++) {
+        if (table->merge[i].op > TMSTAT_MOP_SUM64) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Discard everything a view holds, so that it is rebuilt on next use.
+ *
+ * @param       view        View.
+ */
+static void
+tmstat_view_reset(struct tmstat_view *view)
+{
+    for (unsigned i = 0; i < view->child_count; i++) {
+        tmstat_vmap_free(&view->child[i].part);
+    }
+    free(view->child);
+    view->child = NULL;
+    view->child_count = 0;
+    tmstat_vmap_free(&view->merged);
+}
+
+/**
+ * Free a view.
+ *
+ * @param       view        View.
+ */
+static void
+tmstat_view_free(struct tmstat_view *view)
+{
+    tmstat_view_reset(view);
+    free(view);
+}
+
+/**
+ * Scan callback which merges each row into a view map.
+ */
+static int
+tmstat_view_row(void *arg, TMTABLE table, uint8_t *row,
+                struct tmstat_slab *slab, unsigned rowno)
+{
+    struct tmstat_vscan *scan = arg;
+
+    return tmstat_vmap_add(scan->table, scan->map, row);
+}
+
+/**
+ * Recompute one key of a view's merged rows from every child's share.
+ *
+ * @param       view        View.
+ * @param[in]   key         Row data holding the key; must not point into
+ *                          view->merged.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_view_remerge(struct tmstat_view *view, const uint8_t *key)
+{
+    TMTABLE             table = view->table;
+    struct tmstat_vmap *part;
+    signed              e;
+
+    e = tmstat_vmap_find(table, &view->merged, key);
+    if ((e >= 0) && (view->merged.count[e] != 0)) {
+        view->merged.count[e] = 0;
+        view->merged.live--;
+    }
+    for (unsigned i = 0; i < view->child_count; i++) {
+        part = &view->child[i].part;
+        e = tmstat_vmap_find(table, part, key);
+        if ((e >= 0) &&
+            (tmstat_vmap_add(table, &view->merged,
+                             &part->data[e * table->rowsz]) != 0)) {
+            /* tmstat_vmap_add sets errno. */
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Rescan one child of a view and bring the merged rows up to date.
+ *
+ * Sums are adjusted by taking the child's old rows out and adding its
+ * new ones.  Any other rule cannot be undone, so each key the child
+ * held before or holds now is merged afresh from every child.
+ *
+ * @param       view        View.
+ * @param       vc          Child to rescan.
+ * @return 0 on success, -1 on failure (leaving the view inconsistent).
+ */
+static int
+tmstat_view_update(struct tmstat_view *view, struct tmstat_vchild *vc)
+{
+    TMTABLE             table = view->table;
+    TMTABLE             child_table;
+    struct tmstat_vmap  old = vc->part;
+    struct tmstat_vscan scan = { .table = table, .map = &vc->part };
+    size_t              rowsz = table->rowsz;
+    unsigned            i;
+    signed              ret = 0;
+
+    memset(&vc->part, 0, sizeof(vc->part));
+    child_table = tmstat_table(vc->child, table->td->name);
+    if (child_table != NULL) {
+        ret = tmstat_query_table(vc->child, child_table, 0, NULL, NULL,
+                                 tmstat_view_row, &scan);
+    }
+    if (ret != 0) {
+        /* Failure; tmstat_query_table sets errno. */
+        goto out;
+    }
+    if (view->invertible) {
+        for (i = 0; i < old.n; i++) {
+            tmstat_vmap_sub(table, &view->merged, &old.data[i * rowsz]);
+        }
+        for (i = 0; (ret == 0) && (i < vc->part.n); i++) {
+            ret = tmstat_vmap_add(table, &view->merged,
+                                  &vc->part.data[i * rowsz]);
+        }
+    } else {
+        for (i = 0; (ret == 0) && (i < old.n); i++) {
+            ret = tmstat_view_remerge(view, &old.data[i * rowsz]);
+        }
+        for (i = 0; (ret == 0) && (i < vc->part.n); i++) {
+            if (tmstat_vmap_find(table, &old, &vc->part.data[i * rowsz]) < 0) {
+                ret = tmstat_view_remerge(view, &vc->part.data[i * rowsz]);
+            }
+        }
+    }
+out:
+    tmstat_vmap_free(&old);
+    return ret;
+}
+
+/**
+ * Find or make the cached view of a union's table.
+ *
+ * @param[in]   stat        Union segment.
+ * @param[in]   table       Union table.
+ * @return view, or NULL on failure.
+ */
+static struct tmstat_view *
+tmstat_view(TMSTAT stat, TMTABLE table)
+{
+    struct tmstat_view *view;
+
+    TMIDX_FOREACH(&stat->view_idx, view) {
+        if (view->table == table) {
+            return view;
+        }
+    }
+    view = (struct tmstat_view *)calloc(1, sizeof(*view));
+    if (view == NULL) {
+        /* Memory exhaustion; calloc sets errno. */
+        return NULL;
+    }
+    view->table = table;
+    view->invertible = tmstat_merge_invertible(table);
+    if (tmidx_add(&stat->view_idx, view) < 0) {
+        /* Insertion failure; tmidx_add sets errno. */
+        free(view);
+        return NULL;
+    }
+    return view;
+}
+
+/**
+ * Bring a view up to date, rescanning only the children that have
+ * committed since they were last scanned (or that do not count their
+ * commits at all, or have never committed).
+ *
+ * @param[in]   stat        Union segment.
+ * @param       view        View.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_view_refresh(TMSTAT stat, struct tmstat_view *view)
+{
+    struct tmstat_vchild *vc;
+    uint64_t            generation = tmstat_generation(stat);
+    uint64_t            commits = 0;
+    bool                known;
+    unsigned            i;
+
+    if ((view->child != NULL) && (view->generation != generation)) {
+        /* Tables have come or gone; start afresh. */
+        tmstat_view_reset(view);
+    }
+    if (view->child == NULL) {
+        view->child = (struct tmstat_vchild *)calloc(
+            tmidx_count(&stat->child_idx) + 1, sizeof(*view->child));
+        if (view->child == NULL) {
+            /* Memory exhaustion; calloc sets errno. */
+            return -1;
+        }
+        view->child_count = tmidx_count(&stat->child_idx);
+        for (i = 0; i < view->child_count; i++) {
+            view->child[i].child = tmidx_entry(&stat->child_idx, i);
+            view->child[i].label = tmstat_label_counter(view->child[i].child);
+        }
+        view->generation = generation;
+    }
+    for (i = 0; i < view->child_count; i++) {
+        vc = &view->child[i];
+        /* Read the count first, so that a racing commit is not lost. */
+        commits = (vc->label != NULL) ? vc->label->commits : 0;
+        /* A count of zero may be a publisher that never commits. */
+        known = (commits != 0);
+        __sync_synchronize();
+        if (vc->current && known && (vc->commits == commits)) {
+            continue;
+        }
+        if (tmstat_view_update(view, vc) != 0) {
+            /* Failure; the view is now of no use. */
+            tmstat_view_reset(view);
+            return -1;
+        }
+        vc->current = known;
+        vc->commits = commits;
+    }
+    return 0;
+}
+
+/**
+ * Locate rows by column values in the cached merged view of a union's
+ * table.
+ *
+ * @param[in]   stat        Union segment.
+ * @param[in]   table       Union table; must want merging.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_name    Column names to key upon.
+ * @param[in]   col_value   Column values to match.
+ * @param[out]  row_handle  Array containing result rows, or NULL to
+ *                          count them only.
+ * @param[out]  match_count Number of result rows; zero on entry.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_query_cached(TMSTAT stat, TMTABLE table,
+                    unsigned col_count, char **col_name, void **col_value,
+                    TMROW **row_handle, unsigned *match_count)
+{
+    struct tmstat_qtable qt;
+    struct tmstat_view *view;
+    struct tmidx        rows;
+    TMROW               row;
+    uint8_t            *data;
+
+    if (col_count > table->col_count) {
+        errno = EINVAL;
+        return -1;
+    }
+    TMCOL               cols[col_count + 1];
+
+    qt.cols = cols;
+    if (tmstat_qtable_resolve(&qt, table, col_count, col_name) != 0) {
+        /* tmstat_qtable_resolve sets errno. */
+        return -1;
+    }
+    if (qt.path == TMSTAT_PATH_NONE) {
+        /* Column does not exist; treat as if no rows match. */
+        return 0;
+    }
+    view = tmstat_view(stat, table);
+    if ((view == NULL) || (tmstat_view_refresh(stat, view) != 0)) {
+        /* tmstat_view or tmstat_view_refresh sets errno. */
+        return -1;
+    }
+    tmidx_init(&rows);
+    for (unsigned i = 0; i < view->merged.n; i++) {
+        data = &view->merged.data[i * table->rowsz];
+        if ((view->merged.count[i] == 0) ||
+            !tmstat_values_match(col_count, cols, col_value, data)) {
+            continue;
+        }
+        if (row_handle == NULL) {
+            (*match_count)++;
+            continue;
+        }
+        if (tmstat_pseudo_row_create(table, &row) != 0) {
+            /* Allocation failure; tmstat_pseudo_row_create sets errno. */
+            goto fail;
+        }
+        memcpy(row->data, data, table->rowsz);
+        if (tmidx_add(&rows, row) < 0) {
+            /* Insertion failure; tmidx_add sets errno. */
+            tmstat_row_drop(row);
+            goto fail;
+        }
+    }
+    if (row_handle == NULL) {
+        tmidx_free(&rows);
+        return 0;
+    }
+    return tmstat_query_finish(table, &rows, false, row_handle, match_count);
+fail:
+    TMIDX_FOREACH(&rows, row) {
+        tmstat_row_drop(row);
+    }
+    tmidx_free(&rows);
+    return -1;
+}
+
+/**
+ * Check that no two matching rows of a table declared disjoint share a
+ * key.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table       Result table.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_name    Column names to key upon.
+ * @param[in]   col_value   Column values to match.
+ * @return 0 if none do (or the table makes no promise), -1 on failure.
+ */
+static int
+tmstat_verify_disjoint(TMSTAT stat, TMTABLE table,
+                       unsigned col_count, char **col_name, void **col_value)
+{
+    struct tmstat_vmap  keys;
+    struct tmstat_vscan scan = { .table = table, .map = &keys };
+    signed              ret;
+
+    if (!table->disjoint) {
+        return 0;
+    }
+    memset(&keys, 0, sizeof(keys));
+    ret = _tmstat_query(stat, table->td->name, col_count, col_name,
+                        col_value, tmstat_view_row, &scan);
+    for (unsigned i = 0; (ret == 0) && (i < keys.n); i++) {
+        if (keys.count[i] > 1) {
+            warnx("BUG: rows of disjoint table %s share a key",
+                  table->td->name);
+            errno = EEXIST;
+            ret = -1;
+        }
+    }
+    tmstat_vmap_free(&keys);
+    return ret;
+}
+
+/*
+ * Locate rows by column values.
+ */
+int
+tmstat_query(TMSTAT stat, char *table_name,
+             unsigned col_count, char **col_name, void **col_value,
+             TMROW **row_handle, unsigned *match_count)
+{
+    return tmstat_query_flags(stat, table_name, col_count, col_name,
+                              col_value, 0, row_handle, match_count);
+}
+
+/*
+ * Locate rows by column values, as modified by flags.
+ */
+int
+tmstat_query_flags(TMSTAT stat, char *table_name,
+                   unsigned col_count, char **col_name, void **col_value,
+                   unsigned flags, TMROW **row_handle, unsigned *match_count)
+{
+    struct tmidx        rows;
+    TMTABLE             table;
+    TMROW               row;
+    signed              ret;
+
+    if (flags & TMSTAT_QUERY_VERIFY) {
+        tmstat_refresh(stat, false);
+        table = tmstat_table(stat, table_name);
+        if ((table != NULL) &&
+            (tmstat_verify_disjoint(stat, table, col_count, col_name,
+                                    col_value) != 0)) {
+            /* Broken promise; tmstat_verify_disjoint sets errno. */
+            return -1;
+        }
+    }
+    if (flags & TMSTAT_QUERY_CACHED) {
+        if (flags & TMSTAT_QUERY_UNMERGED) {
+            /* There is no merged view of unmerged rows. */
+            errno = EINVAL;
+            return -1;
+        }
+        *match_count = 0;
+        if (row_handle != NULL) {
+            *row_handle = NULL;
+        }
+        tmstat_refresh(stat, false);
+        table = tmstat_table(stat, table_name);
+        if ((stat->origin != CREATE) && (table != NULL) &&
+            table->want_merge) {
+            return tmstat_query_cached(stat, table, col_count, col_name,
+                                       col_value, row_handle, match_count);
+        }
+        /* Nothing worth caching; query as usual. */
+    }
+    if ((row_handle == NULL) && !(flags & TMSTAT_QUERY_UNMERGED)) {
+        /* Caller only wants the count; don't build row handles. */
+        return tmstat_query_count(stat, table_name, col_count, col_name,
+                                  col_value, match_count);
+    }
+    *match_count = 0;
+    if (row_handle != NULL) {
+        *row_handle = NULL;
+    }
+    tmstat_refresh(stat, false);
+    tmidx_init(&rows);
+    ret = _tmstat_query(stat, table_name, col_count, col_name, col_value,
+                        tmstat_collect_row, &rows);
+    if (ret != 0) {
+        goto end;
+    }
+    table = tmstat_table(stat, table_name);
+    if (table == NULL) {
+        /* No matching table; treat as if the table were empty. */
+        /* match_count and row_handle already cleared above. */
+        ret = 0;
+        goto end;
+    }
+    if (row_handle == NULL) {
+        /* Caller only wants the count of unmerged rows. */
+        *match_count = tmidx_count(&rows);
+        TMIDX_FOREACH(&rows, row) {
+            tmstat_row_drop(row);
+        }
+        goto end;
+    }
+    if ((flags & TMSTAT_QUERY_LAZY) && !(flags & TMSTAT_QUERY_UNMERGED) &&
+        table->want_merge) {
+        /* Group now; merge each column when it is first read. */
+        ret = tmstat_merge_rows_lazy(table, &rows);
+        if (ret != 0) {
+            goto end;
+        }
+        return tmstat_query_finish(table, &rows, false, row_handle,
+                                   match_count);
+    }
+    return tmstat_query_finish(table, &rows,
+                               !(flags & TMSTAT_QUERY_UNMERGED),
+                               row_handle, match_count);
+end:
+    tmidx_free(&rows);
+    return ret;
+}
+
+/**
+ * Determine whether a deadline has passed.
+ *
+ * @param[in]   deadline    CLOCK_MONOTONIC time.
+ * @return true if it has.
+ */
+static bool
+tmstat_deadline_passed(const struct timespec *deadline)
+{
+    struct timespec     now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec > deadline->tv_sec) ||
+            ((now.tv_sec == deadline->tv_sec) &&
+             (now.tv_nsec >= deadline->tv_nsec)));
+}
+
+/*
+ * Locate rows by column values, giving up on further children once the
+ * time budget has been spent.
+ */
+int
+tmstat_query_deadline(TMSTAT stat, char *table_name,
+                      unsigned col_count, char **col_name, void **col_value,
+                      unsigned budget_ms, TMROW **row_handle,
+                      unsigned *match_count, unsigned *covered,
+                      unsigned *child_count)
+{
+    struct timespec     deadline;
+    struct tmidx        rows;
+    TMSTAT              child;
+    TMTABLE             table;
+    TMROW               row;
+    signed              ret = 0;
+
+    /* The budget covers the refresh, too. */
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += budget_ms / 1000;
+    deadline.tv_nsec += (budget_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    *match_count = 0;
+    *row_handle = NULL;
+    *covered = 0;
+    tmstat_refresh(stat, false);
+    tmidx_init(&rows);
+    if (stat->origin == CREATE) {
+        /* A lone segment cannot be split; query it whole. */
+        *child_count = 1;
+        ret = _tmstat_query(stat, table_name, col_count, col_name,
+                            col_value, tmstat_collect_row, &rows);
+        if (ret != 0) {
+            goto fail;
+        }
+        *covered = 1;
+    } else {
+        *child_count = tmidx_count(&stat->child_idx);
+        TMIDX_FOREACH(&stat->child_idx, child) {
+            if (tmstat_deadline_passed(&deadline)) {
+                /* Out of time; merge what we have. */
+                break;
+            }
+            table = tmstat_table(child, table_name);
+            if (table != NULL) {
+                ret = tmstat_query_table(stat, table, col_count, col_name,
+                                         col_value, tmstat_collect_row,
+                                         &rows);
+                if (ret != 0) {
+                    /* Failure; tmstat_query_table sets errno. */
+                    goto fail;
+                }
+            }
+            (*covered)++;
+        }
+    }
+    table = tmstat_table(stat, table_name);
+    if (table == NULL) {
+        /* No matching table; treat as if the table were empty. */
+        tmidx_free(&rows);
+        return 0;
+    }
+    return tmstat_query_finish(table, &rows, true, row_handle, match_count);
+fail:
+    TMIDX_FOREACH(&rows, row) {
+        tmstat_row_drop(row);
+    }
+    tmidx_free(&rows);
+    *covered = 0;
+    return -1;
+}
+
+/**
+ * Compiled predicate node.
+ */
+struct tmstat_pred {
+    enum tmstat_op      op;             //!< Operator.
+    TMCOL               col;            //!< Column compared.
+    const uint8_t      *value;          //!< Value compared against.
+    struct tmstat_pred *left;           //!< First operand (AND/OR).
+    struct tmstat_pred *right;          //!< Second operand (AND/OR).
+    bool                key_only;       //!< Refers only to key columns.
+};
+
+/**
+ * Compiled predicate, split into the conjuncts that can be tested
+ * against source rows during the scan and those that must wait until
+ * rows have been merged.
+ */
+struct tmstat_filter {
+    struct tmstat_pred *node;           //!< Node storage.
+    unsigned            node_count;     //!< Nodes used.
+    struct tmidx        scan;           //!< Conjuncts for source rows.
+    struct tmidx        merged;         //!< Conjuncts for merged rows.
+};
+
+static void tmstat_filter_free(struct tmstat_filter *filter);
+
+/*
+ * Count the nodes in a predicate tree.
+ */
+static unsigned
+tmstat_pred_count(struct TMPRED *pred)
+{
+    if (pred == NULL) {
+        return 0;
+    }
+    return 1 + tmstat_pred_count(pred->left) + tmstat_pred_count(pred->right);
+}
+
+/**
+ * Compile a predicate tree against a table.
+ *
+ * @param       filter      Filter whose node storage receives the tree.
+ * @param[in]   table       Table the predicate refers to.
+ * @param[in]   pred        Predicate to compile.
+ * @return compiled node on success, NULL on failure.
+ */
+static struct tmstat_pred *
+tmstat_pred_compile(struct tmstat_filter *filter, TMTABLE table,
+                    struct TMPRED *pred)
+{
+    struct tmstat_pred *node;
+    unsigned            i;
+
+    if (pred == NULL) {
+        /* Missing operand. */
+        errno = EINVAL;
+        return NULL;
+    }
+    node = &filter->node[filter->node_count++];
+    node->op = pred->op;
+    switch (pred->op) {
+    case TMSTAT_OP_AND:
+    case TMSTAT_OP_OR:
+        node->left = tmstat_pred_compile(filter, table, pred->left);
+        if (node->left == NULL) {
+            return NULL;
+        }
+        node->right = tmstat_pred_compile(filter, table, pred->right);
+        if (node->right == NULL) {
+            return NULL;
+        }
+        node->key_only = node->left->key_only && node->right->key_only;
+        return node;
+    case TMSTAT_OP_EQ:
+    case TMSTAT_OP_NE:
+    case TMSTAT_OP_LT:
+    case TMSTAT_OP_LE:
+    case TMSTAT_OP_GT:
+    case TMSTAT_OP_GE:
+        break;
+    default:
+        /* Unknown operator. */
+        errno = EINVAL;
+        return NULL;
+    }
+    if ((pred->name == NULL) || (pred->value == NULL)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    for (i = 0; i < table->col_count; i++) {
+        if (strcmp(table->col[i].name, pred->name) == 0) {
+            break;
+        }
+    }
+    if (i == table->col_count) {
+        /* No such column. */
+        errno = ENOENT;
+        return NULL;
+    }
+    node->col = &table->col[i];
+    node->value = (const uint8_t *)pred->value;
+    node->key_only = (node->col->rule == TMSTAT_R_KEY);
+    return node;
+}
+
+/**
+ * Compile a predicate and sort its top-level conjuncts by when they can
+ * be evaluated.  Conjuncts over key columns only have the same value in
+ * every row that merges into a given result row, so they are pushed down
+ * into the scan; the rest are tested after merging.
+ *
+ * @param[out]  filter      Filter to initialize.
+ * @param[in]   table       Table the predicate refers to.
+ * @param[in]   pred        Predicate to compile.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_filter_init(struct tmstat_filter *filter, TMTABLE table,
+                   struct TMPRED *pred)
+{
+    struct tmstat_pred *root, *node;
+    struct tmidx        todo;
+    signed              ret = 0;
+
+    memset(filter, 0, sizeof(struct tmstat_filter));
+    filter->node = (struct tmstat_pred *)calloc(tmstat_pred_count(pred) + 1,
+                                                sizeof(struct tmstat_pred));
+    if (filter->node == NULL) {
+        /* Allocation failure; calloc sets errno. */
+        return -1;
+    }
+    root = tmstat_pred_compile(filter, table, pred);
+    if (root == NULL) {
+        /* Bad predicate; tmstat_pred_compile sets errno. */
+        tmstat_filter_free(filter);
+        return -1;
+    }
+    /* Flatten the top-level AND chain. */
+    tmidx_init(&todo);
+    ret = (tmidx_add(&todo, root) >= 0) ? 0 : -1;
+    while ((ret == 0) && (tmidx_count(&todo) != 0)) {
+        node = tmidx_entry(&todo, tmidx_count(&todo) - 1);
+        tmidx_remove(&todo, tmidx_count(&todo) - 1);
+        if (node->op == TMSTAT_OP_AND) {
+            ret = ((tmidx_add(&todo, node->right) >= 0) &&
+                   (tmidx_add(&todo, node->left) >= 0)) ? 0 : -1;
+        } else if (node->key_only || !table->want_merge) {
+            ret = (tmidx_add(&filter->scan, node) >= 0) ? 0 : -1;
+        } else {
+            ret = (tmidx_add(&filter->merged, node) >= 0) ? 0 : -1;
+        }
+    }
+    tmidx_free(&todo);
+    if (ret != 0) {
+        /* Allocation failure; tmidx_add sets errno. */
+        tmstat_filter_free(filter);
+    }
+    return ret;
+}
+
+/**
+ * Free a compiled predicate.
+ *
+ * @param[in]   filter      Filter to free.
+ */
+static void
+tmstat_filter_free(struct tmstat_filter *filter)
+{
+    free(filter->node);
+    tmidx_free(&filter->scan);
+    tmidx_free(&filter->merged);
+    memset(filter, 0, sizeof(struct tmstat_filter));
+}
+
+/**
+ * Evaluate a compiled predicate against row data.
+ *
+ * @param[in]   pred        Predicate.
+ * @param[in]   row         Row data.
+ * @return true if the row satisfies the predicate.
+ */
+static bool
+tmstat_pred_eval(struct tmstat_pred *pred, const uint8_t *row)
+{
+    int64_t             cmp;
+
+    switch (pred->op) {
+    case TMSTAT_OP_AND:
+        return tmstat_pred_eval(pred->left, row) &&
+               tmstat_pred_eval(pred->right, row);
+    case TMSTAT_OP_OR:
+        return tmstat_pred_eval(pred->left, row) ||
+               tmstat_pred_eval(pred->right, row);
+    default:
+        break;
+    }
+    cmp = tmstat_field_cmp(pred->col, &row[pred->col->offset], pred->value);
+    switch (pred->op) {
+    case TMSTAT_OP_EQ:  return cmp == 0;
+    case TMSTAT_OP_NE:  return cmp != 0;
+    case TMSTAT_OP_LT:  return cmp < 0;
+    case TMSTAT_OP_LE:  return cmp <= 0;
+    case TMSTAT_OP_GT:  return cmp > 0;
+    case TMSTAT_OP_GE:  return cmp >= 0;
+    default:            return false;
+    }
+}
+
+/**
+ * Test row data against a list of conjuncts.
+ *
+ * @param[in]   conj        Conjuncts.
+ * @param[in]   row         Row data.
+ * @return true if the row satisfies every conjunct.
+ */
+static bool
+tmstat_filter_match(struct tmidx *conj, const uint8_t *row)
+{
+    struct tmstat_pred *pred;
+
+    TMIDX_FOREACH(conj, pred) {
+        if (!tmstat_pred_eval(pred, row)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Visitor scan state.
+ */
+struct tmstat_visit {
+    tmstat_visit_fn     visit;          //!< Caller's visitor, or NULL.
+    void               *arg;            //!< Visitor context.
+    struct TMPRED      *pred;           //!< Row filter, or NULL.
+    TMQUERY             query;          //!< Prepared query, or NULL.
+    TMTABLE             table;          //!< Table describing merged rows.
+    struct tmstat_filter filter;        //!< Compiled pred.
+    struct tmidx        rows;           //!< Row data awaiting merge.
+    unsigned            count;          //!< Rows visited.
+    int                 stop;           //!< Visitor's stop value.
+};
+
+/*
+ * Scan callback which visits a row in place.
+ */
+static int
+tmstat_visit_row(void *arg, TMTABLE table, uint8_t *row,
+                 struct tmstat_slab *slab, unsigned rowno)
+{
+    struct tmstat_visit *v = (struct tmstat_visit *)arg;
+
+    if (!tmstat_filter_match(&v->filter.scan, row)) {
+        /* Filtered out. */
+        return 0;
+    }
+    v->count++;
+    if (v->visit == NULL) {
+        /* Counting only. */
+        return 0;
+    }
+    v->stop = v->visit(v->arg, row, table->col, table->col_count);
+    return (v->stop != 0) ? 1 : 0;
+}
+
+/*
+ * Scan callback which collects row data for a later merge.
+ */
+static int
+tmstat_visit_collect(void *arg, TMTABLE table, uint8_t *row,
+                     struct tmstat_slab *slab, unsigned rowno)
+{
+    struct tmstat_visit *v = (struct tmstat_visit *)arg;
+
+    if (!tmstat_filter_match(&v->filter.scan, row)) {
+        /* Filtered out before it costs a merge. */
+        return 0;
+    }
+    return (tmidx_add(&v->rows, row) >= 0) ? 0 : -1;
+}
+
+/*
+ * qsort_r comparator for row data pointers.
+ */
+static int
+tmstat_visit_cmp(const void *a, const void *b, void *arg)
+{
+    int64_t         cmp = tmstat_data_cmp((TMTABLE)arg,
+                                          *(uint8_t * const *)a,
+                                          *(uint8_t * const *)b);
+
+    return (cmp > 0) - (cmp < 0);
+}
+
+/**
+ * Count the distinct keys among collected row data by hashing them into
+ * an open-addressed table, as tmstat_merge_rows_hash does.  Each slot
+ * holds the index (plus one) of the first row seen with its key.
+ *
+ * @param[in]   v           Visitor state.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_visit_distinct(struct tmstat_visit *v)
+{
+    TMTABLE         table = v->table;
+    uint8_t       **data = (uint8_t **)v->rows.a;
+    unsigned        count = tmidx_count(&v->rows);
+    uint64_t       *hash;
+    unsigned       *slot;
+    uint64_t        h;
+    unsigned        i, j, size;
+
+    /* Keep the load factor at or below one half. */
+    size = 16;
+    while (size < 2 * count) {
+        size <<= 1;
+    }
+    slot = (unsigned *)calloc(size, sizeof(*slot));
+    hash = (uint64_t *)malloc((count + 1) * sizeof(*hash));
+    if ((slot == NULL) || (hash == NULL)) {
+        /* Memory exhaustion; calloc/malloc set errno. */
+        free(slot);
+        free(hash);
+        return -1;
+    }
+    for (i = 0; i < count; i++) {
+        h = tmstat_key_hash(table, data[i]);
+        for (j = h & (size - 1); slot[j] != 0; j = (j + 1) & (size - 1)) {
+            if ((hash[slot[j] - 1] == h) &&
+                (tmstat_data_cmp(table, data[slot[j] - 1], data[i]) == 0)) {
+                break;
+            }
+        }
+        if (slot[j] == 0) {
+            /* First row with this key. */
+            hash[i] = h;
+            slot[j] = i + 1;
+            v->count++;
+        }
+    }
+    free(hash);
+    free(slot);
+    return 0;
+}
+
+/**
+ * Sort collected row data by key and visit each merged row.
+ *
+ * A key found in only one row is visited in place; otherwise its rows
+ * are merged into a single scratch buffer that is reused for every key.
+ *
+ * @param[in]   v           Visitor state.
+ * @return 0 on success, -1 on failure, 1 if the visitor stopped.
+ */
+static int
+tmstat_visit_merged(struct tmstat_visit *v)
+{
+    TMTABLE         table = v->table;
+    uint8_t       **data = (uint8_t **)v->rows.a;
+    unsigned        count = tmidx_count(&v->rows);
+    bool            need_merge = (v->visit != NULL) ||
+                                 (tmidx_count(&v->filter.merged) != 0);
+    uint8_t        *merged = NULL;
+    uint8_t        *row;
+    unsigned        i, j, k;
+    int             ret = 0;
+
+    if (!need_merge) {
+        /* Counting only; no need to sort or merge. */
+        return tmstat_visit_distinct(v);
+    }
+    qsort_r(data, count, sizeof(uint8_t *), tmstat_visit_cmp, table);
+    for (i = 0; i < count; i = j) {
+        /* Find the run of rows sharing this key. */
+        for (j = i + 1; j < count; j++) {
+            if (tmstat_data_cmp(table, data[i], data[j]) != 0) {
+                break;
+            }
+        }
+        if (j - i == 1) {
+            /* Sole instance of this key; use it in place. */
+            row = data[i];
+        } else {
+            if (merged == NULL) {
+                merged = (uint8_t *)malloc(table->rowsz);
+                if (merged == NULL) {
+                    /* Allocation failure; malloc sets errno. */
+                    ret = -1;
+                    goto out;
+                }
+            }
+            memcpy(merged, data[i], table->rowsz);
+            for (k = i + 1; k < j; k++) {
+                ret = tmstat_merge_data(table, merged, data[k]);
+                if (ret != 0) {
+                    /* Unsupported column; tmstat_merge_data sets errno. */
+                    goto out;
+                }
+            }
+            row = merged;
+        }
+        if (!tmstat_filter_match(&v->filter.merged, row)) {
+            /* Filtered out. */
+            continue;
+        }
+        v->count++;
+        if (v->visit == NULL) {
+            continue;
+        }
+        v->stop = v->visit(v->arg, row, table->col, table->col_count);
+        if (v->stop != 0) {
+            ret = 1;
+            goto out;
+        }
+    }
+out:
+    free(merged);
+    return ret;
+}
+
+/**
+ * Walk rows matching column values, visiting or merely counting them.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_name    Column names to key upon.
+ * @param[in]   col_value   Column values to match.
+ * @param       v           Visitor state; visit NULL to count only.
+ * @return 0 on success, -1 on failure, 1 if the visitor stopped.
+ */
+static int
+tmstat_visit(TMSTAT stat, char *table_name,
+             unsigned col_count, char **col_name, void **col_value,
+             struct tmstat_visit *v)
+{
+    signed              ret;
+
+    tmstat_refresh(stat, false);
+    if (v->query != NULL) {
+        if (tmstat_query_freshen(v->query) != 0) {
+            /* tmstat_query_freshen sets errno. */
+            return -1;
+        }
+        v->table = v->query->table;
+    } else {
+        v->table = tmstat_table(stat, table_name);
+    }
+    if (v->table == NULL) {
+        /* No matching table; treat as if the table were empty. */
+        return 0;
+    }
+    if ((v->pred != NULL) &&
+        (tmstat_filter_init(&v->filter, v->table, v->pred) != 0)) {
+        /* Bad predicate; tmstat_filter_init sets errno. */
+        return -1;
+    }
+    /* Keep the slabs mapped while the visitor runs. */
+    stat->pin_count++;
+    if (v->table->want_merge) {
+        tmidx_init(&v->rows);
+        ret = (v->query != NULL) ?
+            tmstat_query_scan(v->query, col_value, tmstat_visit_collect, v) :
+            _tmstat_query(stat, table_name, col_count, col_name, col_value,
+                          tmstat_visit_collect, v);
+        if (ret == 0) {
+            ret = tmstat_visit_merged(v);
+        }
+        tmidx_free(&v->rows);
+    } else {
+        ret = (v->query != NULL) ?
+            tmstat_query_scan(v->query, col_value, tmstat_visit_row, v) :
+            _tmstat_query(stat, table_name, col_count, col_name, col_value,
+                          tmstat_visit_row, v);
+    }
+    stat->pin_count--;
+    tmstat_filter_free(&v->filter);
+    return ret;
+}
+
+/*
+ * Visit rows matching column values without allocating row handles.
+ */
+int
+tmstat_query_visit(TMSTAT stat, char *table_name,
+                   unsigned col_count, char **col_name, void **col_value,
+                   tmstat_visit_fn visit, void *arg)
+{
+    struct tmstat_visit v;
+    signed              ret;
+
+    memset(&v, 0, sizeof(v));
+    v.visit = visit;
+    v.arg = arg;
+    ret = tmstat_visit(stat, table_name, col_count, col_name, col_value, &v);
+    return (ret == 1) ? v.stop : ret;
+}
+
+/*
+ * Count rows matching column values without allocating row handles.
+ */
+int
+tmstat_query_count(TMSTAT stat, char *table_name,
+                   unsigned col_count, char **col_name, void **col_value,
+                   unsigned *match_count)
+{
+    struct tmstat_visit v;
+    signed              ret;
+
+    memset(&v, 0, sizeof(v));
+    ret = tmstat_visit(stat, table_name, col_count, col_name, col_value, &v);
+    *match_count = (ret == 0) ? v.count : 0;
+    return ret;
+}
+
+/*
+ * Prepare a query for repeated execution.
+ */
+int
+tmstat_query_prepare(TMSTAT stat, char *table_name,
+                     unsigned col_count, char **col_name, TMQUERY *queryp)
+{
+    TMQUERY             query;
+    unsigned            i;
+
+    *queryp = NULL;
+    query = (TMQUERY)calloc(1, sizeof(struct TMQUERY));
+    if (query == NULL) {
+        /* Allocation failure; calloc sets errno. */
+        return -1;
+    }
+    query->stat = stat;
+    query->col_count = col_count;
+    query->table_name = strdup(table_name);
+    query->col_name = (char **)calloc(col_count + 1, sizeof(char *));
+    if ((query->table_name == NULL) || (query->col_name == NULL)) {
+        /* Allocation failure; strdup or calloc sets errno. */
+        goto fail;
+    }
+    for (i = 0; i < col_count; i++) {
+        query->col_name[i] = strdup(col_name[i]);
+        if (query->col_name[i] == NULL) {
+            /* Allocation failure; strdup sets errno. */
+            goto fail;
+        }
+    }
+    tmstat_refresh(stat, false);
+    if (tmstat_query_freshen(query) != 0) {
+        /* tmstat_query_freshen sets errno. */
+        goto fail;
+    }
+    *queryp = query;
+    return 0;
+fail:
+    tmstat_query_free(query);
+    return -1;
+}
+
+/*
+ * Execute a prepared query.
+ */
+int
+tmstat_query_exec(TMQUERY query, void **col_value,
+                  TMROW **row_handle, unsigned *match_count)
+{
+    struct tmstat_visit v;
+    struct tmidx        rows;
+    signed              ret;
+
+    *match_count = 0;
+    if (row_handle == NULL) {
+        /* Caller only wants the count; don't build row handles. */
+        memset(&v, 0, sizeof(v));
+        v.query = query;
+        ret = tmstat_visit(query->stat, query->table_name, query->col_count,
+                           query->col_name, col_value, &v);
+        if (ret == 0) {
+            *match_count = v.count;
+        }
+        return ret;
+    }
+    *row_handle = NULL;
+    tmstat_refresh(query->stat, false);
+    ret = tmstat_query_freshen(query);
+    if ((ret != 0) || (query->table == NULL)) {
+        /* Failure, or no matching table. */
+        return ret;
+    }
+    tmidx_init(&rows);
+    ret = tmstat_query_scan(query, col_value, tmstat_collect_row, &rows);
+    if (ret != 0) {
+        TMROW row;
+        TMIDX_FOREACH(&rows, row) {
+            tmstat_row_drop(row);
+        }
+        tmidx_free(&rows);
+        return ret;
+    }
+    return tmstat_query_finish(query->table, &rows, true, row_handle,
+                               match_count);
+}
+
+/*
+ * Execute a prepared query, visiting rows without allocating handles.
+ */
+int
+tmstat_query_exec_visit(TMQUERY query, void **col_value,
+                        tmstat_visit_fn visit, void *arg)
+{
+    struct tmstat_visit v;
+    signed              ret;
+
+    memset(&v, 0, sizeof(v));
+    v.visit = visit;
+    v.arg = arg;
+    v.query = query;
+    ret = tmstat_visit(query->stat, query->table_name, query->col_count,
+                       query->col_name, col_value, &v);
+    return (ret == 1) ? v.stop : ret;
+}
+
+/*
+ * Free a prepared query.
+ */
+void
+tmstat_query_free(TMQUERY query)
+{
+    if (query == NULL) {
+        return;
+    }
+    tmstat_query_unresolve(query);
+    if (query->col_name != NULL) {
+        for (unsigned i = 0; i < query->col_count; i++) {
+            free(query->col_name[i]);
+        }
+    }
+    free(query->col_name);
+    free(query->table_name);
+    free(query);
+}
+
+/**
+ * Describe the access path chosen for one table.
+ *
+ * @param[in]   f           Stream to describe it on.
+ * @param[in]   qt          Resolved table.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_qtable_explain(FILE *f, struct tmstat_qtable *qt)
+{
+    TMTABLE             table = qt->table;
+    struct tmidx        slabs;
+    unsigned            slab_count, probes;
+
+    tmidx_init(&slabs);
+    if (tmstat_slab_idx(table->stat, table->td, &slabs) != 0) {
+        /* tmstat_slab_idx sets errno. */
+        tmidx_free(&slabs);
+        return -1;
+    }
+    slab_count = tmidx_count(&slabs);
+    tmidx_free(&slabs);
+    for (probes = 0; (1u << probes) < slab_count; probes++);
+    fprintf(f, "  %s: %u rows in %u slabs, %s; ", table->stat->name,
+            table->td->rows, slab_count,
+            table->td->is_sorted ? "sorted" : "unsorted");
+    switch (qt->path) {
+    case TMSTAT_PATH_NONE:
+        fprintf(f, "missing a query column, skipped\n");
+        break;
+    case TMSTAT_PATH_SCAN:
+        fprintf(f, "scan all %u slabs\n", slab_count);
+        break;
+    case TMSTAT_PATH_PREFIX:
+        fprintf(f, "binary search on %u of %u key columns (~%u probes), "
+                "then scan matching slabs\n", qt->prefix,
+                table->key_col_count, probes);
+        break;
+    case TMSTAT_PATH_SEARCH:
+        fprintf(f, "binary search on full key (~%u probes)\n", probes);
+        break;
+    }
+    return 0;
+}
+
+/*
+ * Describe how a query would run.
+ */
+int
+tmstat_query_explain(TMSTAT stat, char *table_name,
+                     unsigned col_count, char **col_name, char **text)
+{
+    TMQUERY             query;
+    FILE               *f;
+    size_t              len;
+    signed              ret = 0;
+
+    *text = NULL;
+    if (tmstat_query_prepare(stat, table_name, col_count, col_name,
+                             &query) != 0) {
+        /* tmstat_query_prepare sets errno. */
+        return -1;
+    }
+    f = open_memstream(text, &len);
+    if (f == NULL) {
+        /* Allocation failure; open_memstream sets errno. */
+        tmstat_query_free(query);
+        return -1;
+    }
+    if (query->table == NULL) {
+        fprintf(f, "%s: no such table, no rows\n", table_name);
+    } else {
+        fprintf(f, "%s: %u table%s, %s\n", table_name, query->qtable_count,
+                (query->qtable_count == 1) ? "" : "s",
+                query->table->want_merge ? "rows merged by key" :
+                                           "rows not merged");
+    }
+    for (unsigned i = 0; (ret == 0) && (i < query->qtable_count); i++) {
+        ret = tmstat_qtable_explain(f, &query->qtable[i]);
+    }
+    if ((fclose(f) != 0) || (ret != 0)) {
+        /* Failure; fclose or tmstat_qtable_explain sets errno. */
+        free(*text);
+        *text = NULL;
+        ret = -1;
+    }
+    tmstat_query_free(query);
+    return ret;
+}
+
+/**
+ * Batch lookup state.
+ *
+ * Each distinct probe key owns a row-sized accumulator, which starts out
+ * holding just the key and receives every matching source row.
+ */
+struct tmstat_batch {
+    TMTABLE             table;          //!< Table describing rows.
+    unsigned            distinct;       //!< Distinct probe keys.
+    uint8_t            *acc;            //!< Accumulators, one per key.
+    bool               *found;          //!< Accumulator holds a row.
+    unsigned           *slot;           //!< Hash slots; key index + 1.
+    unsigned            mask;           //!< Hash slot mask.
+    unsigned           *order;          //!< Key indexes in key order.
+    TMTABLE             cur;            //!< Table being scanned.
+    bool                join;           //!< Merge-joining cur.
+    unsigned            cursor;         //!< Merge-join position in order.
+    const uint8_t      *prev;           //!< Previous row of cur.
+};
+
+#define BATCH_ACC(b, d)     (&(b)->acc[(size_t)(d) * (b)->table->rowsz])
+
+/**
+ * Hash several fields of a row.  Fields that compare equal under
+ * tmstat_fields_cmp hash equally.
+ *
+ * @param[in]   cols        Columns describing the fields.
+ * @param[in]   count       Number of columns.
+ * @param[in]   data        Row data.
+ * @return hash value.
+ */
+static uint64_t
+tmstat_fields_hash(TMCOL cols, unsigned count, const uint8_t *data)
+{
+    uint64_t            h = 14695981039346656037ULL;   /* FNV-1a */
+    TMCOL               col;
+    const uint8_t      *p;
+    unsigned            i, j, len;
+
+    for (i = 0; i < count; i++) {
+        col = &cols[i];
+        p = &data[col->offset];
+        len = (col->type == TMSTAT_T_TEXT) ?
+            strnlen((const char *)p, col->size - 1) : col->size;
+        for (j = 0; j < len; j++) {
+            h = (h ^ p[j]) * 1099511628211ULL;
+        }
+        /* Terminate each field so adjacent text keys can't run together. */
+        h = (h ^ 0xff) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * Hash the key columns of a row.  Keys that compare equal under
+ * tmstat_data_cmp hash equally.
+ *
+ * @param[in]   table       Table describing the row.
+ * @param[in]   data        Row data.
+ * @return hash value.
+ */
+static inline uint64_t
+tmstat_key_hash(TMTABLE table, const uint8_t *data)
+{
+    return tmstat_fields_hash(table->key_col, table->key_col_count, data);
+}
+
+/**
+ * Find the probe key matching a row's key.
+ *
+ * @param[in]   b           Batch state.
+ * @param[in]   data        Row data.
+ * @param[in]   h           tmstat_key_hash of data.
+ * @return pointer to the hash slot holding the key, or the empty slot
+ * where it belongs.
+ */
+static unsigned *
+tmstat_batch_slot(struct tmstat_batch *b, const uint8_t *data, uint64_t h)
+{
+    unsigned            i;
+
+    for (i = h & b->mask; b->slot[i] != 0; i = (i + 1) & b->mask) {
+        if (tmstat_data_cmp(b->table, BATCH_ACC(b, b->slot[i] - 1),
+                            data) == 0) {
+            break;
+        }
+    }
+    return &b->slot[i];
+}
+
+/*
+ * qsort_r comparator for probe key indexes.
+ */
+static int
+tmstat_batch_cmp(const void *a, const void *b, void *arg)
+{
+    struct tmstat_batch *batch = (struct tmstat_batch *)arg;
+    int64_t             cmp;
+
+    cmp = tmstat_data_cmp(batch->table,
+                          BATCH_ACC(batch, *(const unsigned *)a),
+                          BATCH_ACC(batch, *(const unsigned *)b));
+    return (cmp > 0) - (cmp < 0);
+}
+
+/*
+ * Scan callback which folds a row into its probe key's accumulator.
+ * Sorted tables are merge-joined against the sorted probe keys; others
+ * (and sorted ones found to be out of order) are probed by hash.
+ */
+static int
+tmstat_batch_row(void *arg, TMTABLE table, uint8_t *row,
+                 struct tmstat_slab *slab, unsigned rowno)
+{
+    struct tmstat_batch *b = (struct tmstat_batch *)arg;
+    unsigned           *slot;
+    unsigned            d;
+    int64_t             cmp = 0;
+
+    if (table != b->cur) {
+        /* Starting on another child's table. */
+        b->cur = table;
+        b->join = (b->order != NULL) && table->td->is_sorted;
+        b->cursor = 0;
+        b->prev = NULL;
+    }
+    if (b->join && (b->prev != NULL) &&
+        (tmstat_data_cmp(b->table, b->prev, row) > 0)) {
+        /* Not sorted after all; fall back to hashing. */
+        b->join = false;
+    }
+    if (b->join) {
+        b->prev = row;
+        while ((b->cursor < b->distinct) &&
+               ((cmp = tmstat_data_cmp(b->table,
+                    BATCH_ACC(b, b->order[b->cursor]), row)) < 0)) {
+            b->cursor++;
+        }
+        if ((b->cursor == b->distinct) || (cmp != 0)) {
+            /* Not a key we want. */
+            return 0;
+        }
+        d = b->order[b->cursor];
+    } else {
+        slot = tmstat_batch_slot(b, row, tmstat_key_hash(b->table, row));
+        if (*slot == 0) {
+            /* Not a key we want. */
+            return 0;
+        }
+        d = *slot - 1;
+    }
+    if (!b->found[d]) {
+        memcpy(BATCH_ACC(b, d), row, b->table->rowsz);
+        b->found[d] = true;
+        return 0;
+    }
+    if (!b->table->want_merge) {
+        /* As tmstat_query_finish; keep the first row found. */
+        return 0;
+    }
+    return tmstat_merge_data(b->table, BATCH_ACC(b, d), row);
+}
+
+/*
+ * Return true if any of the tables a query would scan is sorted.
+ */
+static bool
+tmstat_any_table_sorted(TMSTAT stat, char *table_name)
+{
+    TMSTAT              child;
+    TMTABLE             table;
+
+    if (stat->origin == CREATE) {
+        table = tmstat_table(stat, table_name);
+        return (table != NULL) && table->td->is_sorted;
+    }
+    TMIDX_FOREACH(&stat->child_idx, child) {
+        table = tmstat_table(child, table_name);
+        if ((table != NULL) && table->td->is_sorted) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Locate rows by many full keys in one pass.
+ */
+int
+tmstat_query_batch(TMSTAT stat, char *table_name,
+                   unsigned col_count, char **col_name, void **col_value,
+                   unsigned key_count, TMROW *row_handle,
+                   unsigned *match_count)
+{
+    struct tmstat_batch b;
+    TMTABLE             table;
+    TMCOL              *cols = NULL;
+    unsigned           *probe = NULL;
+    TMROW              *made = NULL;
+    unsigned           *slot;
+    uint8_t            *key;
+    TMROW               row;
+    unsigned            i, j, n;
+    signed              ret = -1;
+
+    *match_count = 0;
+    memset(row_handle, 0, key_count * sizeof(TMROW));
+    memset(&b, 0, sizeof(b));
+    tmstat_refresh(stat, false);
+    table = tmstat_table(stat, table_name);
+    if ((table == NULL) || (key_count == 0)) {
+        /* No matching table; treat as if the table were empty. */
+        return 0;
+    }
+    /* The full key, and only the key, must be given. */
+    if (col_count != table->key_col_count) {
+        errno = EINVAL;
+        return -1;
+    }
+    cols = (TMCOL *)calloc(col_count + 1, sizeof(TMCOL));
+    if (cols == NULL) {
+        /* Allocation failure; calloc sets errno. */
+        return -1;
+    }
+    for (i = 0; i < col_count; i++) {
+        for (j = 0; j < table->col_count; j++) {
+            if (strcmp(col_name[i], table->col[j].name) == 0) {
+                break;
+            }
+        }
+        if ((j == table->col_count) || (table->col[j].rule != TMSTAT_R_KEY)) {
+            errno = EINVAL;
+            goto out;
+        }
+        cols[i] = &table->col[j];
+    }
+    b.table = table;
+    for (n = 1; n < 2 * key_count; n <<= 1);
+    b.mask = n - 1;
+    b.acc = (uint8_t *)calloc(key_count, table->rowsz);
+    b.found = (bool *)calloc(key_count, sizeof(bool));
+    b.slot = (unsigned *)calloc(n, sizeof(unsigned));
+    probe = (unsigned *)calloc(key_count, sizeof(unsigned));
+    if ((b.acc == NULL) || (b.found == NULL) || (b.slot == NULL) ||
+        (probe == NULL)) {
+        /* Allocation failure; calloc sets errno. */
+        goto out;
+    }
+    /* Normalize each probe key into a row image and collapse duplicates. */
+    for (i = 0; i < key_count; i++) {
+        key = BATCH_ACC(&b, b.distinct);
+        for (j = 0; j < col_count; j++) {
+            if (cols[j]->type == TMSTAT_T_TEXT) {
+                strncpy((char *)&key[cols[j]->offset],
+                        col_value[i * col_count + j], cols[j]->size);
+            } else {
+                memcpy(&key[cols[j]->offset], col_value[i * col_count + j],
+                       cols[j]->size);
+            }
+        }
+        slot = tmstat_batch_slot(&b, key, tmstat_key_hash(table, key));
+        if (*slot == 0) {
+            *slot = ++b.distinct;
+        } else {
+            memset(key, 0, table->rowsz);
+        }
+        probe[i] = *slot - 1;
+    }
+    if (tmstat_any_table_sorted(stat, table_name)) {
+        /* Sort the probe keys for merge-joining sorted tables. */
+        b.order = (unsigned *)calloc(b.distinct, sizeof(unsigned));
+        if (b.order == NULL) {
+            /* Allocation failure; calloc sets errno. */
+            goto out;
+        }
+        for (i = 0; i < b.distinct; i++) {
+            b.order[i] = i;
+        }
+        qsort_r(b.order, b.distinct, sizeof(unsigned), tmstat_batch_cmp, &b);
+    }
+    /* One pass over every table. */
+    ret = _tmstat_query(stat, table_name, 0, NULL, NULL,
+                        tmstat_batch_row, &b);
+    if (ret != 0) {
+        goto out;
+    }
+    /* Hand out one pseudo row per key found, in the caller's order. */
+    made = (TMROW *)calloc(b.distinct, sizeof(TMROW));
+    if (made == NULL) {
+        /* Allocation failure; calloc sets errno. */
+        ret = -1;
+        goto out;
+    }
+    for (i = 0; i < key_count; i++) {
+        if (!b.found[probe[i]]) {
+            continue;
+        }
+        if (made[probe[i]] != NULL) {
+            /* Repeated key; share the row. */
+            row_handle[i] = tmstat_row_ref(made[probe[i]]);
+        } else {
+            ret = tmstat_pseudo_row_create(table, &row);
+            if (ret != 0) {
+                /* tmstat_pseudo_row_create sets errno. */
+                goto out;
+            }
+            memcpy(row->data, BATCH_ACC(&b, probe[i]), table->rowsz);
+            row_handle[i] = made[probe[i]] = row;
+        }
+        ++*match_count;
+    }
+out:
+    if (ret != 0) {
+        for (i = 0; i < key_count; i++) {
+            if (row_handle[i] != NULL) {
+                tmstat_row_drop(row_handle[i]);
+                row_handle[i] = NULL;
+            }
+        }
+        *match_count = 0;
+    }
+    free(b.acc);
+    free(b.found);
+    free(b.slot);
+    free(b.order);
+    free(probe);
+    free(made);
+    free(cols);
+    return ret;
+}
+
+/**
+ * Group-by state.  Groups live in an open-addressed hash table that is
+ * kept at most half full.
+ */
+struct tmstat_group {
+    TMTABLE             table;          //!< Table describing rows.
+    TMCOL               col;            //!< Group columns.
+    unsigned            col_count;      //!< Number of group columns.
+    uint8_t            *acc;            //!< Accumulators, one per group.
+    unsigned            count;          //!< Groups found.
+    unsigned           *slot;           //!< Hash slots; group index + 1.
+    unsigned            mask;           //!< Hash slot mask.
+};
+
+#define GROUP_ACC(g, i)     (&(g)->acc[(size_t)(i) * (g)->table->rowsz])
+
+/**
+ * Find the group a row belongs to.
+ *
+ * @param[in]   g           Group state.
+ * @param[in]   data        Row data.
+ * @return pointer to the hash slot holding the group, or the empty slot
+ * where it belongs.
+ */
+static unsigned *
+tmstat_group_slot(struct tmstat_group *g, const uint8_t *data)
+{
+    unsigned            i;
+
+    i = tmstat_fields_hash(g->col, g->col_count, data) & g->mask;
+    for (; g->slot[i] != 0; i = (i + 1) & g->mask) {
+        if (tmstat_fields_cmp(g->col, g->col_count,
+                              GROUP_ACC(g, g->slot[i] - 1), data) == 0) {
+            break;
+        }
+    }
+    return &g->slot[i];
+}
+
+/**
+ * Double the group table, rehashing every group.
+ *
+ * @param       g           Group state.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_group_grow(struct tmstat_group *g)
+{
+    unsigned            size = 2 * (g->mask + 1);
+    unsigned           *slot;
+    uint8_t            *acc;
+
+    slot = (unsigned *)calloc(size, sizeof(unsigned));
+    acc = (uint8_t *)realloc(g->acc, (size_t)(size / 2) * g->table->rowsz);
+    if ((slot == NULL) || (acc == NULL)) {
+        /* Allocation failure; calloc or realloc sets errno. */
+        free(slot);
+        if (acc != NULL) {
+            g->acc = acc;
+        }
+        return -1;
+    }
+    free(g->slot);
+    g->slot = slot;
+    g->acc = acc;
+    g->mask = size - 1;
+    for (unsigned i = 0; i < g->count; i++) {
+        *tmstat_group_slot(g, GROUP_ACC(g, i)) = i + 1;
+    }
+    return 0;
+}
+
+/*
+ * Scan callback which folds a row into its group's accumulator.
+ */
+static int
+tmstat_group_row(void *arg, TMTABLE table, uint8_t *row,
+                 struct tmstat_slab *slab, unsigned rowno)
+{
+    struct tmstat_group *g = (struct tmstat_group *)arg;
+    unsigned           *slot;
+    uint8_t            *acc;
+    TMCOL               key;
+
+    slot = tmstat_group_slot(g, row);
+    if (*slot != 0) {
+        return tmstat_merge_data(g->table, GROUP_ACC(g, *slot - 1), row);
+    }
+    if (2 * (g->count + 1) > g->mask + 1) {
+        if (tmstat_group_grow(g) != 0) {
+            /* tmstat_group_grow sets errno. */
+            return -1;
+        }
+        slot = tmstat_group_slot(g, row);
+    }
+    /* New group; start from this row, clearing keys merged away. */
+    acc = GROUP_ACC(g, g->count);
+    memcpy(acc, row, g->table->rowsz);
+    for (unsigned i = 0; i < g->table->key_col_count; i++) {
+        key = &g->table->key_col[i];
+        for (unsigned j = 0; j < g->col_count; j++) {
+            if (g->col[j].offset == key->offset) {
+                goto next_key;
+            }
+        }
+        memset(&acc[key->offset], 0, key->size);
+next_key: ;
+    }
+    *slot = ++g->count;
+    return 0;
+}
+
+/*
+ * qsort_r comparator for group indexes.
+ */
+static int
+tmstat_group_cmp(const void *a, const void *b, void *arg)
+{
+    struct tmstat_group *g = (struct tmstat_group *)arg;
+    int64_t             cmp;
+
+    cmp = tmstat_fields_cmp(g->col, g->col_count,
+                            GROUP_ACC(g, *(const unsigned *)a),
+                            GROUP_ACC(g, *(const unsigned *)b));
+    return (cmp > 0) - (cmp < 0);
+}
+
+/*
+ * Locate rows by column values and roll them up by group.
+ */
+int
+tmstat_query_group(TMSTAT stat, char *table_name,
+                   unsigned col_count, char **col_name, void **col_value,
+                   unsigned group_count, char **group_name,
+                   TMROW **row_handle, unsigned *match_count)
+{
+    struct tmstat_group g;
+    struct TMCOL        group[group_count + 1];
+    unsigned           *order = NULL;
+    TMTABLE             table;
+    unsigned            i, j, n = 0;
+    signed              ret = -1;
+
+    *match_count = 0;
+    *row_handle = NULL;
+    memset(&g, 0, sizeof(g));
+    tmstat_refresh(stat, false);
+    table = tmstat_table(stat, table_name);
+    /* Group columns must be keys. */
+    for (i = 0; (table != NULL) && (i < group_count); i++) {
+        for (j = 0; j < table->col_count; j++) {
+            if (strcmp(group_name[i], table->col[j].name) == 0) {
+                break;
+            }
+        }
+        if (j == table->col_count) {
+            errno = ENOENT;
+            return -1;
+        }
+        if (table->col[j].rule != TMSTAT_R_KEY) {
+            errno = EINVAL;
+            return -1;
+        }
+        group[i] = table->col[j];
+    }
+    g.table = table;
+    g.col = group;
+    g.col_count = group_count;
+    g.mask = 15;
+    g.slot = (unsigned *)calloc(g.mask + 1, sizeof(unsigned));
+    g.acc = (uint8_t *)malloc((table != NULL) ?
+                              ((g.mask + 1) / 2) * table->rowsz : 1);
+    if ((g.slot == NULL) || (g.acc == NULL)) {
+        /* Allocation failure; calloc or malloc sets errno. */
+        goto out;
+    }
+    if (table != NULL) {
+        ret = _tmstat_query(stat, table_name, col_count, col_name, col_value,
+                            tmstat_group_row, &g);
+        if (ret != 0) {
+            /* Only tmstat_group_row stops the scan, and only on error. */
+            ret = -1;
+            goto out;
+        }
+    }
+    /* Hand groups back in group column order. */
+    order = (unsigned *)malloc((g.count + 1) * sizeof(unsigned));
+    *row_handle = (TMROW *)calloc(g.count + 1, sizeof(TMROW));
+    if ((order == NULL) || (*row_handle == NULL)) {
+        /* Allocation failure; malloc or calloc sets errno. */
+        ret = -1;
+        goto out;
+    }
+    for (i = 0; i < g.count; i++) {
+        order[i] = i;
+    }
+    qsort_r(order, g.count, sizeof(unsigned), tmstat_group_cmp, &g);
+    for (n = 0; n < g.count; n++) {
+        ret = tmstat_pseudo_row_create(table, &(*row_handle)[n]);
+        if (ret != 0) {
+            /* Allocation failure; tmstat_pseudo_row_create sets errno. */
+            goto out;
+        }
+        memcpy((*row_handle)[n]->data, GROUP_ACC(&g, order[n]), table->rowsz);
+    }
+    *match_count = n;
+    ret = 0;
+out:
+    if ((ret != 0) && (*row_handle != NULL)) {
+        for (i = 0; i < n; i++) {
+            tmstat_row_drop((*row_handle)[i]);
+        }
+        free(*row_handle);
+        *row_handle = NULL;
+    }
+    free(order);
+    free(g.acc);
+    free(g.slot);
+    return ret;
+}
+
+/**
+ * Hash join state.  Merged rows of the build side are copied into rows
+ * and chained by join column hash; the probe side streams past them.
+ */
+struct tmstat_join {
+    TMTABLE             build;          //!< Build side table.
+    TMTABLE             probe;          //!< Probe side table.
+    bool                build_left;     //!< The left table is the build side.
+    TMCOL               bcol;           //!< Join columns, build side.
+    TMCOL               pcol;           //!< Join columns, probe side.
+    unsigned            col_count;      //!< Number of join columns.
+    uint8_t            *rows;           //!< Build side row data.
+    unsigned            count;          //!< Build side rows.
+    unsigned            size;           //!< Rows rows has room for.
+    unsigned           *head;           //!< Hash chains; row index + 1.
+    unsigned           *next;           //!< Next row in chain; index + 1.
+    unsigned            mask;           //!< Hash chain mask.
+    tmstat_join_fn      fn;             //!< Caller's callback.
+    void               *arg;            //!< Callback context.
+};
+
+#define JOIN_ROW(j, i)      (&(j)->rows[(size_t)(i) * (j)->build->rowsz])
+
+/**
+ * Estimate a table's rows from its descriptors.
+ *
+ * @param[in]   stat        Segment.
+ * @param[in]   table       Table in stat.
+ * @return row count.
+ */
+static uint64_t
+tmstat_table_rows(TMSTAT stat, TMTABLE table)
+{
+    TMSTAT              child;
+    TMTABLE             t;
+    uint64_t            rows = 0;
+
+    if (stat->origin == CREATE) {
+        return table->td->rows;
+    }
+    TMIDX_FOREACH(&stat->child_idx, child) {
+        t = tmstat_table(child, table->td->name);
+        if (t != NULL) {
+            rows += t->td->rows;
+        }
+    }
+    return rows;
+}
+
+/*
+ * Visitor which copies a merged build side row.
+ */
+static int
+tmstat_join_build(void *arg, const void *data, struct TMCOL *cols,
+                  unsigned col_count)
+{
+    struct tmstat_join *j = (struct tmstat_join *)arg;
+    uint8_t            *p;
+
+    if (j->count == j->size) {
+        j->size = TMSTAT_MAX(2 * j->size, 16u);
+        p = (uint8_t *)realloc(j->rows, (size_t)j->size * j->build->rowsz);
+        if (p == NULL) {
+            /* Allocation failure; realloc sets errno. */
+            return -1;
+        }
+        j->rows = p;
+    }
+    memcpy(JOIN_ROW(j, j->count++), data, j->build->rowsz);
+    return 0;
+}
+
+/*
+ * Visitor which looks a merged probe side row up among the build rows.
+ */
+static int
+tmstat_join_probe(void *arg, const void *data, struct TMCOL *cols,
+                  unsigned col_count)
+{
+    struct tmstat_join *j = (struct tmstat_join *)arg;
+    const uint8_t      *p = (const uint8_t *)data;
+    const uint8_t      *b;
+    unsigned            i, c;
+    signed              ret;
+
+    i = j->head[tmstat_fields_hash(j->pcol, j->col_count, p) & j->mask];
+    for (; i != 0; i = j->next[i - 1]) {
+        b = JOIN_ROW(j, i - 1);
+        for (c = 0; c < j->col_count; c++) {
+            if (tmstat_field_cmp(&j->bcol[c], &b[j->bcol[c].offset],
+                                 &p[j->pcol[c].offset]) != 0) {
+                break;
+            }
+        }
+        if (c < j->col_count) {
+            continue;
+        }
+        ret = j->build_left ?
+            j->fn(j->arg, b, p, j->build->col, j->build->col_count,
+                  j->probe->col, j->probe->col_count) :
+            j->fn(j->arg, p, b, j->probe->col, j->probe->col_count,
+                  j->build->col, j->build->col_count);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Resolve join columns by name.
+ *
+ * @param[in]   table       Table.
+ * @param[in]   col_count   Number of join columns.
+ * @param[in]   col_name    Join column names.
+ * @param[out]  col         Resolved columns.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_join_resolve(TMTABLE table, unsigned col_count, char **col_name,
+                    struct TMCOL *col)
+{
+    unsigned            i, j;
+
+    for (i = 0; i < col_count; i++) {
+        for (j = 0; j < table->col_count; j++) {
+            if (strcmp(col_name[i], table->col[j].name) == 0) {
+                break;
+            }
+        }
+        if (j == table->col_count) {
+            errno = ENOENT;
+            return -1;
+        }
+        col[i] = table->col[j];
+    }
+    return 0;
+}
+
+/*
+ * Join the merged rows of two tables on shared column values.
+ */
+int
+tmstat_query_join(TMSTAT stat, char *left_name, char *right_name,
+                  unsigned col_count, char **left_col, char **right_col,
+                  tmstat_join_fn fn, void *arg)
+{
+    struct tmstat_join  j;
+    struct tmstat_visit v;
+    struct TMCOL        lcol[col_count + 1], rcol[col_count + 1];
+    TMTABLE             left, right;
+    unsigned            i, h;
+    signed              ret = -1;
+
+    memset(&j, 0, sizeof(j));
+    tmstat_refresh(stat, false);
+    left = tmstat_table(stat, left_name);
+    right = tmstat_table(stat, right_name);
+    if ((left == NULL) || (right == NULL)) {
+        /* No matching table; nothing joins. */
+        return 0;
+    }
+    if ((tmstat_join_resolve(left, col_count, left_col, lcol) != 0) ||
+        (tmstat_join_resolve(right, col_count, right_col, rcol) != 0)) {
+        /* tmstat_join_resolve sets errno. */
+        return -1;
+    }
+    for (i = 0; i < col_count; i++) {
+        if ((lcol[i].type != rcol[i].type) ||
+            (lcol[i].size != rcol[i].size)) {
+            /* Values could never compare equal. */
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    /* Build on the smaller side; probe with the larger. */
+    j.build_left = (tmstat_table_rows(stat, left) <=
+                    tmstat_table_rows(stat, right));
+    j.build = j.build_left ? left : right;
+    j.probe = j.build_left ? right : left;
+    j.bcol = j.build_left ? lcol : rcol;
+    j.pcol = j.build_left ? rcol : lcol;
+    j.col_count = col_count;
+    j.fn = fn;
+    j.arg = arg;
+    /* Keep both tables in place between the two walks. */
+    stat->pin_count++;
+    memset(&v, 0, sizeof(v));
+    v.visit = tmstat_join_build;
+    v.arg = &j;
+    ret = tmstat_visit(stat, j.build->td->name, 0, NULL, NULL, &v);
+    if (ret != 0) {
+        /* Only tmstat_join_build stops the walk, and only on error. */
+        ret = -1;
+        goto out;
+    }
+    for (h = 16; h < 2 * j.count; h *= 2);
+    j.mask = h - 1;
+    j.head = (unsigned *)calloc(h, sizeof(unsigned));
+    j.next = (unsigned *)calloc(j.count + 1, sizeof(unsigned));
+    if ((j.head == NULL) || (j.next == NULL)) {
+        /* Allocation failure; calloc sets errno. */
+        ret = -1;
+        goto out;
+    }
+    /* Chain in reverse so each chain runs in build order. */
+    for (i = j.count; i > 0; i--) {
+        h = tmstat_fields_hash(j.bcol, col_count, JOIN_ROW(&j, i - 1)) &
+            j.mask;
+        j.next[i - 1] = j.head[h];
+        j.head[h] = i;
+    }
+    memset(&v, 0, sizeof(v));
+    v.visit = tmstat_join_probe;
+    v.arg = &j;
+    ret = tmstat_visit(stat, j.probe->td->name, 0, NULL, NULL, &v);
+    ret = (ret == 1) ? v.stop : ret;
+out:
+    stat->pin_count--;
+    free(j.next);
+    free(j.head);
+    free(j.rows);
+    return ret;
+}
+
+/**
+ * tmstat_query_where result state.
+ */
+struct tmstat_where {
+    struct tmstat_visit *v;             //!< Visitor state.
+    struct tmidx        rows;           //!< Qualifying rows.
+};
+
+/*
+ * Visitor which copies each qualifying row into a pseudo row.
+ */
+static int
+tmstat_where_row(void *arg, const void *data, struct TMCOL *cols,
+                 unsigned col_count)
+{
+    struct tmstat_where *w = (struct tmstat_where *)arg;
+    TMTABLE             table = w->v->table;
+    TMROW               row;
+
+    if (tmstat_pseudo_row_create(table, &row) != 0) {
+        /* Allocation failure; tmstat_pseudo_row_create sets errno. */
+        return -1;
+    }
+    memcpy(row->data, data, table->rowsz);
+    if (tmidx_add(&w->rows, row) < 0) {
+        /* Allocation failure; tmidx_add sets errno. */
+        tmstat_row_drop(row);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Locate rows by column values and a predicate.
+ */
+int
+tmstat_query_where(TMSTAT stat, char *table_name,
+                   unsigned col_count, char **col_name, void **col_value,
+                   struct TMPRED *pred, TMROW **row_handle,
+                   unsigned *match_count)
+{
+    struct tmstat_visit v;
+    struct tmstat_where w;
+    TMROW               row;
+    signed              ret;
+
+    *match_count = 0;
+    memset(&v, 0, sizeof(v));
+    v.pred = pred;
+    if (row_handle == NULL) {
+        /* Caller only wants the count. */
+        ret = tmstat_visit(stat, table_name, col_count, col_name, col_value,
+                           &v);
+        if (ret == 0) {
+            *match_count = v.count;
+        }
+        return ret;
+    }
+    *row_handle = NULL;
+    w.v = &v;
+    tmidx_init(&w.rows);
+    v.visit = tmstat_where_row;
+    v.arg = &w;
+    ret = tmstat_visit(stat, table_name, col_count, col_name, col_value, &v);
+    if (ret == 0) {
+        *row_handle = (TMROW *)calloc(tmidx_count(&w.rows) + 1,
+                                      sizeof(TMROW));
+        if (*row_handle == NULL) {
+            /* Allocation failure; calloc sets errno. */
+            ret = -1;
+        }
+    } else {
+        /* Only tmstat_where_row stops the walk, and only on error. */
+        ret = -1;
+    }
+    if (ret == 0) {
+        memcpy(*row_handle, w.rows.a, tmidx_count(&w.rows) * sizeof(TMROW));
+        *match_count = tmidx_count(&w.rows);
+    } else {
+        TMIDX_FOREACH(&w.rows, row) {
+            tmstat_row_drop(row);
+        }
+    }
+    tmidx_free(&w.rows);
+    return ret;
+}
+
+/**
+ * tmstat_query_top state.  The kept rows form a min-heap on the sort
+ * column, so the weakest of them is always at the root.
+ */
+struct tmstat_top {
+    struct tmstat_visit *v;             //!< Visitor state.
+    char               *sort_name;      //!< Sort column name.
+    TMCOL               sort;           //!< Sort column, once resolved.
+    unsigned            k;              //!< Rows wanted.
+    unsigned            count;          //!< Rows kept.
+    unsigned            size;           //!< Rows data has room for.
+    uint8_t            *data;           //!< Kept row data.
+};
+
+/**
+ * Address of a kept row.
+ */
+#define TMSTAT_TOP_ROW(t, i)                                                \
+    (&(t)->data[(size_t)(i) * (t)->v->table->rowsz])
+
+/**
+ * Compare kept rows on the sort column.
+ *
+ * @return positive if a sorts ahead of b, negative if behind, else 0.
+ */
+static inline int64_t
+tmstat_top_cmp(struct tmstat_top *t, const uint8_t *a, const uint8_t *b)
+{
+    return tmstat_field_cmp(t->sort, &a[t->sort->offset],
+                            &b[t->sort->offset]);
+}
+
+/**
+ * Restore heap order downward from slot i.
+ *
+ * @param       t           Top-K state.
+ * @param[in]   i           Slot to sift down.
+ */
+static void
+tmstat_top_sift(struct tmstat_top *t, unsigned i)
+{
+    size_t              rowsz = t->v->table->rowsz;
+    uint8_t             tmp[rowsz];
+    unsigned            c;
+
+    for (;;) {
+        c = 2 * i + 1;
+        if (c >= t->count) {
+            break;
+        }
+        if ((c + 1 < t->count) &&
+            (tmstat_top_cmp(t, TMSTAT_TOP_ROW(t, c + 1),
+                            TMSTAT_TOP_ROW(t, c)) < 0)) {
+            c++;
+        }
+        if (tmstat_top_cmp(t, TMSTAT_TOP_ROW(t, c),
+                           TMSTAT_TOP_ROW(t, i)) >= 0) {
+            break;
+        }
+        memcpy(tmp, TMSTAT_TOP_ROW(t, i), rowsz);
+        memcpy(TMSTAT_TOP_ROW(t, i), TMSTAT_TOP_ROW(t, c), rowsz);
+        memcpy(TMSTAT_TOP_ROW(t, c), tmp, rowsz);
+        i = c;
+    }
+}
+
+/**
+ * Find the sort column in a schema.
+ *
+ * @param[in]   cols        Column descriptors.
+ * @param[in]   col_count   Number of column descriptors.
+ * @param[in]   sort_name   Sort column name.
+ * @return column, or NULL (with errno set) if there is no such numeric
+ * column.
+ */
+static TMCOL
+tmstat_top_col(struct TMCOL *cols, unsigned col_count, char *sort_name)
+{
+    unsigned            i;
+
+    for (i = 0; i < col_count; i++) {
+        if (strcmp(cols[i].name, sort_name) == 0) {
+            break;
+        }
+    }
+    if (i == col_count) {
+        errno = ENOENT;
+        return NULL;
+    }
+    if ((cols[i].type != TMSTAT_T_SIGNED) &&
+        (cols[i].type != TMSTAT_T_UNSIGNED)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return &cols[i];
+}
+
+/*
+ * Visitor which keeps the k rows with the largest sort column values.
+ */
+static int
+tmstat_top_row(void *arg, const void *data, struct TMCOL *cols,
+               unsigned col_count)
+{
+    struct tmstat_top  *t = (struct tmstat_top *)arg;
+    size_t              rowsz = t->v->table->rowsz;
+    uint8_t             tmp[rowsz];
+    unsigned            i;
+
+    if (t->sort == NULL) {
+        /* First row; find the sort column in the result schema. */
+        t->sort = tmstat_top_col(cols, col_count, t->sort_name);
+        if (t->sort == NULL) {
+            /* Bad sort column; tmstat_top_col sets errno. */
+            return -1;
+        }
+    }
+    if (t->count < t->k) {
+        if (t->count == t->size) {
+            /* Grow the heap, up to k rows. */
+            unsigned size = TMSTAT_MIN(TMSTAT_MAX(2 * t->size, 16u), t->k);
+            uint8_t *p = (uint8_t *)realloc(t->data, size * rowsz);
+            if (p == NULL) {
+                /* Allocation failure; realloc sets errno. */
+                return -1;
+            }
+            t->data = p;
+            t->size = size;
+        }
+        /* Append, then sift the new row up into place. */
+        i = t->count++;
+        memcpy(TMSTAT_TOP_ROW(t, i), data, rowsz);
+        while ((i > 0) &&
+               (tmstat_top_cmp(t, TMSTAT_TOP_ROW(t, i),
+                               TMSTAT_TOP_ROW(t, (i - 1) / 2)) < 0)) {
+            memcpy(tmp, TMSTAT_TOP_ROW(t, i), rowsz);
+            memcpy(TMSTAT_TOP_ROW(t, i), TMSTAT_TOP_ROW(t, (i - 1) / 2),
+                   rowsz);
+            memcpy(TMSTAT_TOP_ROW(t, (i - 1) / 2), tmp, rowsz);
+            i = (i - 1) / 2;
+        }
+    } else if (tmstat_top_cmp(t, data, TMSTAT_TOP_ROW(t, 0)) > 0) {
+        /* Beats the weakest kept row; replace it. */
+        memcpy(TMSTAT_TOP_ROW(t, 0), data, rowsz);
+        tmstat_top_sift(t, 0);
+    }
+    return 0;
+}
+
+/*
+ * Locate the rows with the largest values in a column.
+ */
+int
+tmstat_query_top(TMSTAT stat, char *table_name,
+                 unsigned col_count, char **col_name, void **col_value,
+                 struct TMPRED *pred, char *sort_name, unsigned k,
+                 TMROW **row_handle, unsigned *match_count)
+{
+    struct tmstat_visit v;
+    struct tmstat_top   t;
+    TMTABLE             table;
+    TMROW               row;
+    unsigned            n;
+    signed              ret = 0;
+
+    *match_count = 0;
+    *row_handle = NULL;
+    /* Check the sort column before looking at any rows. */
+    tmstat_refresh(stat, false);
+    table = tmstat_table(stat, table_name);
+    if ((table != NULL) &&
+        (tmstat_top_col(table->col, table->col_count, sort_name) == NULL)) {
+        /* Bad sort column; tmstat_top_col sets errno. */
+        return -1;
+    }
+    memset(&v, 0, sizeof(v));
+    memset(&t, 0, sizeof(t));
+    t.v = &v;
+    t.sort_name = sort_name;
+    t.k = k;
+    v.pred = pred;
+    v.visit = tmstat_top_row;
+    v.arg = &t;
+    if (k != 0) {
+        ret = tmstat_visit(stat, table_name, col_count, col_name, col_value,
+                           &v);
+        if (ret != 0) {
+            /* Only tmstat_top_row stops the walk, and only on error. */
+            ret = -1;
+            goto out;
+        }
+    }
+    *row_handle = (TMROW *)calloc(t.count + 1, sizeof(TMROW));
+    if (*row_handle == NULL) {
+        /* Allocation failure; calloc sets errno. */
+        ret = -1;
+        goto out;
+    }
+    /* Pop the heap from the weakest row, filling the result backward. */
+    for (n = t.count; t.count > 0; ) {
+        if (tmstat_pseudo_row_create(v.table, &row) != 0) {
+            /* Allocation failure; tmstat_pseudo_row_create sets errno. */
+            ret = -1;
+            break;
+        }
+        memcpy(row->data, TMSTAT_TOP_ROW(&t, 0), v.table->rowsz);
+        (*row_handle)[--t.count] = row;
+        memcpy(TMSTAT_TOP_ROW(&t, 0), TMSTAT_TOP_ROW(&t, t.count),
+               v.table->rowsz);
+        tmstat_top_sift(&t, 0);
+    }
+    if (ret != 0) {
+        for (unsigned i = t.count; i < n; i++) {
+            tmstat_row_drop((*row_handle)[i]);
+        }
+        free(*row_handle);
+        *row_handle = NULL;
+        goto out;
+    }
+    *match_count = n;
+out:
+    free(t.data);
+    return ret;
+}
+
+/**
+ * Projection state.
+ */
+struct tmstat_project {
+    struct TMPROJ      *proj;           //!< Caller's projections.
+    unsigned            proj_count;     //!< Number of projections.
+    unsigned            capacity;       //!< Rows each output array holds.
+    unsigned            count;          //!< Rows matched.
+    struct TMCOL       *cols;           //!< Schema col_idx refers to.
+    unsigned           *col_idx;        //!< Source column per projection.
+    unsigned           *size;           //!< Output size per projection.
+};
+
+/**
+ * Map each projection onto a column of the given schema.  An output
+ * size left at zero is taken from the first schema resolved against.
+ *
+ * @param       p           Projection state.
+ * @param[in]   cols        Column descriptors.
+ * @param[in]   col_count   Number of column descriptors.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_project_resolve(struct tmstat_project *p, struct TMCOL *cols,
+                       unsigned col_count)
+{
+    struct TMPROJ      *proj;
+    unsigned            i, j;
+
+    for (i = 0; i < p->proj_count; i++) {
+        proj = &p->proj[i];
+        for (j = 0; j < col_count; j++) {
+            if (strcmp(cols[j].name, proj->name) == 0) {
+                break;
+            }
+        }
+        if (j == col_count) {
+            /* No such column. */
+            errno = ENOENT;
+            return -1;
+        }
+        if (p->size[i] == 0) {
+            /* Caller wants the column as is. */
+            p->size[i] = cols[j].size;
+        }
+        if (p->size[i] < cols[j].size) {
+            /* We widen, never narrow. */
+            errno = EINVAL;
+            return -1;
+        }
+        if (((cols[j].type == TMSTAT_T_SIGNED) ||
+             (cols[j].type == TMSTAT_T_UNSIGNED)) &&
+            (p->size[i] != sizeof(uint8_t)) &&
+            (p->size[i] != sizeof(uint16_t)) &&
+            (p->size[i] != sizeof(uint32_t)) &&
+            (p->size[i] != sizeof(uint64_t))) {
+            /* Integers can only be widened to another integer size. */
+            errno = EINVAL;
+            return -1;
+        }
+        p->col_idx[i] = j;
+    }
+    p->cols = cols;
+    return 0;
+}
+
+/**
+ * Copy one field into an output element, widening integers.
+ *
+ * @param[out]  out         Output element.
+ * @param[in]   size        Output element size.
+ * @param[in]   col         Source column.
+ * @param[in]   in          Source field.
+ */
+static void
+tmstat_project_field(void *out, unsigned size, TMCOL col, const void *in)
+{
+    uint64_t            v;
+
+    switch (col->type) {
+    case TMSTAT_T_SIGNED:
+        switch (col->size) {
+        case 1:     v = (uint64_t)(int64_t)*(const int8_t *)in;     break;
+        case 2:     v = (uint64_t)(int64_t)*(const int16_t *)in;    break;
+        case 4:     v = (uint64_t)(int64_t)*(const int32_t *)in;    break;
+        default:    v = *(const uint64_t *)in;                      break;
+        }
+        break;
+    case TMSTAT_T_UNSIGNED:
+        switch (col->size) {
+        case 1:     v = *(const uint8_t *)in;                       break;
+        case 2:     v = *(const uint16_t *)in;                      break;
+        case 4:     v = *(const uint32_t *)in;                      break;
+        default:    v = *(const uint64_t *)in;                      break;
+        }
+        break;
+    default:
+        /* Byte stream; copy and zero-pad. */
+        memcpy(out, in, col->size);
+        memset((uint8_t *)out + col->size, 0, size - col->size);
+        return;
+    }
+    switch (size) {
+    case 1:     *(uint8_t *)out = (uint8_t)v;                       break;
+    case 2:     *(uint16_t *)out = (uint16_t)v;                     break;
+    case 4:     *(uint32_t *)out = (uint32_t)v;                     break;
+    default:    *(uint64_t *)out = v;                               break;
+    }
+}
+
+/*
+ * Visitor which scatters a row's projected columns into output arrays.
+ */
+static int
+tmstat_project_row(void *arg, const void *row, struct TMCOL *cols,
+                   unsigned col_count)
+{
+    struct tmstat_project *p = (struct tmstat_project *)arg;
+    TMCOL               col;
+    unsigned            i;
+
+    if (p->count >= p->capacity) {
+        /* Out of room; just count. */
+        p->count++;
+        return 0;
+    }
+    if ((cols != p->cols) &&
+        (tmstat_project_resolve(p, cols, col_count) != 0)) {
+        /* Bad projection; tmstat_project_resolve sets errno. */
+        return -1;
+    }
+    for (i = 0; i < p->proj_count; i++) {
+        col = &cols[p->col_idx[i]];
+        tmstat_project_field((uint8_t *)p->proj[i].out + p->count * p->size[i],
+                             p->size[i], col,
+                             (const uint8_t *)row + col->offset);
+    }
+    p->count++;
+    return 0;
+}
+
+/*
+ * Locate rows by column values and write selected columns to arrays.
+ */
+int
+tmstat_query_project(TMSTAT stat, char *table_name,
+                     unsigned col_count, char **col_name, void **col_value,
+                     struct TMPROJ *proj, unsigned proj_count,
+                     unsigned capacity, unsigned *row_count)
+{
+    struct tmstat_project p;
+    struct tmstat_visit v;
+    TMTABLE             table;
+    unsigned            i;
+    signed              ret = -1;
+
+    *row_count = 0;
+    memset(&p, 0, sizeof(p));
+    p.proj = proj;
+    p.proj_count = proj_count;
+    p.capacity = capacity;
+    p.col_idx = (unsigned *)calloc(proj_count + 1, sizeof(unsigned));
+    p.size = (unsigned *)calloc(proj_count + 1, sizeof(unsigned));
+    if ((p.col_idx == NULL) || (p.size == NULL)) {
+        /* Allocation failure; calloc sets errno. */
+        goto out;
+    }
+    for (i = 0; i < proj_count; i++) {
+        p.size[i] = proj[i].size;
+    }
+    /* Check every projection before looking at any rows. */
+    tmstat_refresh(stat, false);
+    table = tmstat_table(stat, table_name);
+    if ((table != NULL) &&
+        (tmstat_project_resolve(&p, table->col, table->col_count) != 0)) {
+        /* Bad projection; tmstat_project_resolve sets errno. */
+        goto out;
+    }
+    memset(&v, 0, sizeof(v));
+    v.visit = tmstat_project_row;
+    v.arg = &p;
+    ret = tmstat_visit(stat, table_name, col_count, col_name, col_value, &v);
+    if (ret == 1) {
+        /* Only tmstat_project_row stops the walk, and only on error. */
+        ret = -1;
+    }
+    if (ret == 0) {
+        *row_count = p.count;
+    }
+out:
+    free(p.col_idx);
+    free(p.size);
+    return ret;
+}
+
+/**
+ * Query result set.  Row handles, row data and a copy of the table
+ * describing them live in an arena and are freed together; none of
+ * them refers to the segment's own tables, which may be refreshed away
+ * while the result set lives.
+ */
+struct TMRESULT {
+    TMTABLE             table;          //!< Copy of the result table.
+    struct tmstat_arena arena;          //!< Row handles and data.
+    struct tmidx        rows;           //!< Result rows.
+};
+
+/**
+ * Copy the parts of a table that its rows refer to into a result set's
+ * arena.  The copy has no slabs, merge plan or rollup of its own.
+ *
+ * @param       result      Result set.
+ * @param[in]   table       Table to copy.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_result_table(TMRESULT result, TMTABLE table)
+{
+    TMTABLE             copy;
+    unsigned            i, j;
+    size_t              len;
+    char               *name;
+
+    copy = (TMTABLE)tmstat_arena_alloc(&result->arena, sizeof(*copy));
+    if (copy == NULL) {
+        /* Allocation failure; tmstat_arena_alloc sets errno. */
+        return -1;
+    }
+    memcpy(copy, table, sizeof(*copy));
+    copy->inode = NULL;
+    memset(&copy->avail_idx, 0, sizeof(copy->avail_idx));
+    copy->want_merge = false;
+    copy->rollup = NULL;
+    copy->merge = NULL;
+    copy->merge_count = 0;
+    LIST_INIT(&copy->row_list);
+    copy->td = (struct tmstat_table *)tmstat_arena_alloc(&result->arena,
+        sizeof(struct tmstat_table));
+    copy->col = (TMCOL)tmstat_arena_alloc(&result->arena,
+        (table->col_count + 1) * sizeof(struct TMCOL));
+    copy->key_col = (TMCOL)tmstat_arena_alloc(&result->arena,
+        (table->key_col_count + 1) * sizeof(struct TMCOL));
+    if ((copy->td == NULL) || (copy->col == NULL) ||
+        (copy->key_col == NULL)) {
+        /* Allocation failure; tmstat_arena_alloc sets errno. */
+        return -1;
+    }
+    memcpy(copy->td, table->td, sizeof(struct tmstat_table));
+    memcpy(copy->col, table->col, table->col_count * sizeof(struct TMCOL));
+    memcpy(copy->key_col, table->key_col,
+           table->key_col_count * sizeof(struct TMCOL));
+    for (i = 0; i < table->col_count; i++) {
+        len = strlen(table->col[i].name) + 1;
+        name = (char *)tmstat_arena_alloc(&result->arena, len);
+        if (name == NULL) {
+            /* Allocation failure; tmstat_arena_alloc sets errno. */
+            return -1;
+        }
+        memcpy(name, table->col[i].name, len);
+        copy->col[i].name = name;
+        for (j = 0; j < table->key_col_count; j++) {
+            if (strcmp(table->key_col[j].name, name) == 0) {
+                copy->key_col[j].name = name;
+            }
+        }
+    }
+    result->table = copy;
+    return 0;
+}
+
+/*
+ * Visitor which copies each row into a result set.
+ */
+static int
+tmstat_result_add(void *arg, const void *data, struct TMCOL *cols,
+                  unsigned col_count)
+{
+    TMRESULT            result = (TMRESULT)arg;
+    TMROW               row;
+    signed              ret;
+
+    ret = tmstat_arena_row_create(&result->arena, result->table, &row);
+    if (ret != 0) {
+        /* Allocation failure; tmstat_arena_row_create sets errno. */
+        return -1;
+    }
+    memcpy(row->data, data, result->table->rowsz);
+    return (tmidx_add(&result->rows, row) >= 0) ? 0 : -1;
+}
+
+/*
+ * Locate rows by column values, returning an arena-backed result set.
+ */
+int
+tmstat_query_result(TMSTAT stat, char *table_name,
+                    unsigned col_count, char **col_name, void **col_value,
+                    TMRESULT *resultp)
+{
+    struct tmstat_visit v;
+    TMRESULT            result;
+    TMTABLE             table;
+    signed              ret;
+
+    *resultp = NULL;
+    result = (TMRESULT)calloc(1, sizeof(struct TMRESULT));
+    if (result == NULL) {
+        /* Allocation failure; calloc sets errno. */
+        return -1;
+    }
+    tmstat_arena_init(&result->arena);
+    tmidx_init(&result->rows);
+    tmstat_refresh(stat, false);
+    table = tmstat_table(stat, table_name);
+    if (table != NULL) {
+        if (tmstat_result_table(result, table) != 0) {
+            /* Allocation failure; tmstat_result_table sets errno. */
+            tmstat_result_free(result);
+            return -1;
+        }
+        memset(&v, 0, sizeof(v));
+        v.visit = tmstat_result_add;
+        v.arg = result;
+        ret = tmstat_visit(stat, table_name, col_count, col_name, col_value,
+                           &v);
+        if (ret != 0) {
+            /* tmstat_visit or tmstat_result_add set errno. */
+            tmstat_result_free(result);
+            return -1;
+        }
+    }
+    *resultp = result;
+    return 0;
+}
+
+/*
+ * Return number of rows in result set.
+ */
+unsigned
+tmstat_result_count(TMRESULT result)
+{
+    return tmidx_count(&result->rows);
+}
+
+/*
+ * Return row from result set.
+ */
+TMROW
+tmstat_result_row(TMRESULT result, unsigned i)
+{
+    return (TMROW)tmidx_entry(&result->rows, i);
+}
+
+/*
+ * Free result set and all its rows.
+ */
+void
+tmstat_result_free(TMRESULT result)
+{
+    if (result == NULL) {
+        return;
+    }
+    tmidx_free(&result->rows);
+    tmstat_arena_free(&result->arena);
+    free(result);
+}
+
+/**
+ * One slab of a parallel scan.
+ */
+struct tmstat_unit {
+    struct tmstat_qtable *qt;           //!< Table the slab belongs to.
+    struct tmstat_slab *slab;           //!< Slab to scan.
+};
+
+/**
+ * Partial rollup over a contiguous run of slabs.
+ */
+struct tmstat_rollup_job {
+    TMTABLE             table;          //!< Table describing the result.
+    struct tmstat_unit *unit;           //!< Slabs to scan.
+    unsigned            unit_count;     //!< Number of slabs.
+    unsigned            col_count;      //!< Number of columns to key on.
+    void              **col_value;      //!< Column values to match.
+    uint8_t            *acc;            //!< Partial result row data.
+    bool                found;          //!< acc holds at least one row.
+    uint64_t            rows;           //!< Rows folded into acc.
+    signed              ret;            //!< Scan result.
+    signed              err;            //!< errno on failure.
+};
+
+/**
+ * Fold a matching row into a partial rollup.
+ *
+ * @return 0 to continue, -1 on failure.
+ */
+static int
+tmstat_rollup_row(void *arg, TMTABLE table, uint8_t *row,
+                  struct tmstat_slab *slab, unsigned rowno)
+{
+    struct tmstat_rollup_job *job = (struct tmstat_rollup_job *)arg;
+
+    job->rows++;
+    if (!job->found) {
+        memcpy(job->acc, row, job->table->rowsz);
+        job->found = true;
+        return 0;
+    }
+    return tmstat_merge_data(job->table, job->acc, row);
+}
+
+/**
+ * Pool job: roll up one run of slabs.
+ *
+ * @param[in]   arg         struct tmstat_rollup_job.
+ */
+static void
+tmstat_rollup_slabs(void *arg)
+{
+    struct tmstat_rollup_job *job = (struct tmstat_rollup_job *)arg;
+    struct tmstat_unit *u;
+
+    for (unsigned i = 0; (job->ret == 0) && (i < job->unit_count); i++) {
+        u = &job->unit[i];
+        job->ret = tmstat_query_slab(u->qt->table, u->slab, job->col_count,
+                                     u->qt->cols, job->col_value,
+                                     tmstat_rollup_row, job);
+    }
+    job->err = (job->ret != 0) ? errno : 0;
+}
+
+/**
+ * Roll up a table across the segment's worker threads.  The slabs of
+ * every table the scan would visit are split into contiguous runs, each
+ * run is rolled up separately, and the partials are combined in slab
+ * order with the table's merge rules, so the result matches a serial
+ * rollup.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table       Table describing the result.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_name    Column names to key upon.
+ * @param[in]   col_value   Column values to match.
+ * @param[out]  data        Result row data, if anything matched.
+ * @param[out]  found       Whether anything matched.
+ * @return 0 on success, 1 if the scan is not worth parallelizing,
+ *         or -1 on failure.
+ */
+static int
+tmstat_query_rollup_parallel(TMSTAT stat, TMTABLE table,
+                             unsigned col_count, char **col_name,
+                             void **col_value, uint8_t *data, bool *found)
+{
+    struct tmstat_rollup_job *job = NULL;
+    struct tmstat_qtable *qt = NULL;
+    struct tmstat_unit *unit = NULL;
+    struct tmstat_slab *slab;
+    struct tmidx        tables, slabs;
+    TMCOL              *cols = NULL;
+    TMSTAT              child;
+    TMTABLE             t;
+    unsigned            i, qt_count, unit_count = 0, job_count;
+    uint8_t            *acc = NULL;
+    signed              ret = -1;
+
+    tmidx_init(&tables);
+    tmidx_init(&slabs);
+    if (stat->origin == CREATE) {
+        ret = tmidx_add(&tables, table);
+    } else {
+        ret = 0;
+        TMIDX_FOREACH(&stat->child_idx, child) {
+            t = tmstat_table(child, table->td->name);
+            if ((t != NULL) && ((ret = tmidx_add(&tables, t)) < 0)) {
+                break;
+            }
+        }
+    }
+    if (ret < 0) {
+        /* Allocation failure; tmidx_add sets errno. */
+        ret = -1;
+        goto out;
+    }
+    qt_count = tmidx_count(&tables);
+    qt = (struct tmstat_qtable *)calloc(qt_count + 1, sizeof(*qt));
+    cols = (TMCOL *)calloc(qt_count * col_count + 1, sizeof(TMCOL));
+    if ((qt == NULL) || (cols == NULL)) {
+        /* Allocation failure; calloc sets errno. */
+        ret = -1;
+        goto out;
+    }
+    /* Gather the slabs of every table that can match. */
+    for (i = 0; i < qt_count; i++) {
+        qt[i].cols = &cols[i * col_count];
+        ret = tmstat_qtable_resolve(&qt[i], tmidx_entry(&tables, i),
+                                    col_count, col_name);
+        if (ret != 0) {
+            /* tmstat_qtable_resolve sets errno. */
+            goto out;
+        }
+        if (qt[i].keyed) {
+            /* A sorted key lookup touches few slabs; stay serial. */
+            ret = 1;
+            goto out;
+        }
+        if (qt[i].path == TMSTAT_PATH_NONE) {
+            continue;
+        }
+        ret = tmstat_slab_idx(qt[i].table->stat, qt[i].table->td, &slabs);
+        if (ret != 0) {
+            /* tmstat_slab_idx sets errno. */
+            goto out;
+        }
+        unit = (struct tmstat_unit *)realloc(unit,
+            (unit_count + tmidx_count(&slabs) + 1) * sizeof(*unit));
+        if (unit == NULL) {
+            /* Allocation failure; realloc sets errno. */
+            ret = -1;
+            goto out;
+        }
+        TMIDX_FOREACH(&slabs, slab) {
+            unit[unit_count].qt = &qt[i];
+            unit[unit_count].slab = slab;
+            unit_count++;
+        }
+        tmidx_free(&slabs);
+        tmidx_init(&slabs);
+    }
+    if (unit_count < TMSTAT_PARALLEL_SLABS) {
+        /* Not worth the handoff. */
+        ret = 1;
+        goto out;
+    }
+    /* One run per thread, the caller included. */
+    job_count = TMSTAT_MIN(stat->pool->thread_count + 1, unit_count);
+    job = (struct tmstat_rollup_job *)calloc(job_count, sizeof(*job));
+    acc = (uint8_t *)calloc(job_count, table->rowsz);
+    if ((job == NULL) || (acc == NULL)) {
+        /* Allocation failure; calloc sets errno. */
+        ret = -1;
+        goto out;
+    }
+    for (i = 0; i < job_count; i++) {
+        unsigned first = (unsigned)((uint64_t)unit_count * i / job_count);
+        unsigned last = (unsigned)((uint64_t)unit_count * (i + 1) /
+                                   job_count);
+        job[i].table = table;
+        job[i].unit = &unit[first];
+        job[i].unit_count = last - first;
+        job[i].col_count = col_count;
+        job[i].col_value = col_value;
+        job[i].acc = &acc[i * table->rowsz];
+    }
+    tmstat_pool_run(stat->pool, tmstat_rollup_slabs, job, sizeof(*job),
+                    job_count);
+    /* Combine partials in slab order. */
+    for (i = 1; i < job_count; i++) {
+        if (job[i].ret != 0) {
+            errno = job[i].err;
+            ret = -1;
+            goto out;
+        }
+        if (!job[i].found) {
+            continue;
+        }
+        if (!job[0].found) {
+            memcpy(job[0].acc, job[i].acc, table->rowsz);
+            job[0].found = true;
+        } else if (tmstat_merge_data(table, job[0].acc, job[i].acc) != 0) {
+            /* tmstat_merge_data sets errno. */
+            ret = -1;
+            goto out;
+        }
+    }
+    if (job[0].ret != 0) {
+        errno = job[0].err;
+        ret = -1;
+        goto out;
+    }
+    ret = 0;
+    *found = job[0].found;
+    if (job[0].found) {
+        memcpy(data, job[0].acc, table->rowsz);
+    }
+out:
+    free(acc);
+    free(job);
+    free(unit);
+    free(cols);
+    free(qt);
+    tmidx_free(&slabs);
+    tmidx_free(&tables);
+    return ret;
+}
+
+/**
+ * Overwrite a maintained aggregate row.
+ *
+ * @return 0 to continue.
+ */
+static int
+tmstat_rollup_store(void *arg, TMTABLE table, uint8_t *row,
+                    struct tmstat_slab *slab, unsigned rowno)
+{
+    memcpy(row, arg, table->rowsz);
+    return 0;
+}
+
+/**
+ * Fold every table that maintains an aggregate into its aggregate row.
+ *
+ * @param[in]   stat        Segment made with tmstat_create.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_rollup_fold(TMSTAT stat)
+{
+    struct tmstat_rollup_job job;
+    TMTABLE             table;
+    signed              ret = 0;
+
+    TMIDX_FOREACH(&stat->table_idx, table) {
+        if (table->rollup == NULL) {
+            continue;
+        }
+        uint8_t acc[table->rollup->rowsz];
+
+        memset(&job, 0, sizeof(job));
+        memset(acc, 0, table->rollup->rowsz);
+        job.table = table;
+        job.acc = acc;
+        ret = tmstat_query_table(stat, table, 0, NULL, NULL,
+                                 tmstat_rollup_row, &job);
+        if (ret == 0) {
+            memcpy(&acc[ROUND_UP(table->rowsz, ROW_ALIGN)], &job.rows,
+                   sizeof(job.rows));
+            ret = tmstat_query_table(stat, table->rollup, 0, NULL, NULL,
+                                     tmstat_rollup_store, acc);
+        }
+        if (ret != 0) {
+            /* tmstat_query_table sets errno. */
+            break;
+        }
+    }
+    return ret;
+}
+
+/**
+ * A child's maintained aggregate, as seen by tmstat_rollup_maintained.
+ */
+struct tmstat_rollup_agg {
+    struct tmstat_rollup_job *job;      //!< Rollup to fold it into.
+    TMCOL               rows;           //!< Its row count column.
+    bool                used;           //!< It stood for some rows.
+};
+
+/**
+ * Fold a child's aggregate row into a rollup, unless it stands for no
+ * rows at all.
+ *
+ * @return 0 to continue, -1 on failure.
+ */
+static int
+tmstat_rollup_agg_row(void *arg, TMTABLE table, uint8_t *row,
+                      struct tmstat_slab *slab, unsigned rowno)
+{
+    struct tmstat_rollup_agg *agg = (struct tmstat_rollup_agg *)arg;
+
+    if (*(const uint64_t *)&row[agg->rows->offset] == 0) {
+        /* Empty, or never folded. */
+        return 0;
+    }
+    agg->used = true;
+    return tmstat_rollup_row(agg->job, table, row, slab, rowno);
+}
+
+/**
+ * Roll up a whole table across a union's children, taking each child's
+ * maintained aggregate where it has one and scanning the rest.
+ *
+ * @param[in]   stat        Union segment.
+ * @param[in]   table       Table describing the result.
+ * @param[out]  data        Result row data, if anything matched.
+ * @param[out]  found       Whether anything matched.
+ * @return 0 on success, 1 if no child maintains an aggregate,
+ *         or -1 on failure.
+ */
+static int
+tmstat_rollup_maintained(TMSTAT stat, TMTABLE table, uint8_t *data,
+                         bool *found)
+{
+    struct tmstat_rollup_job job;
+    struct tmstat_rollup_agg agg;
+    char                rollup_name[TM_MAX_NAME + 1];
+    TMSTAT              child;
+    TMTABLE             t, a;
+    bool                any = false;
+    signed              ret = 0;
+
+    if (!tmstat_rollup_name(rollup_name, table->td->name)) {
+        return 1;
+    }
+    TMIDX_FOREACH(&stat->child_idx, child) {
+        if (tmstat_table(child, rollup_name) != NULL) {
+            any = true;
+            break;
+        }
+    }
+    if (!any) {
+        return 1;
+    }
+    memset(&job, 0, sizeof(job));
+    job.table = table;
+    job.acc = data;
+    TMIDX_FOREACH(&stat->child_idx, child) {
+        t = tmstat_table(child, table->td->name);
+        if (t == NULL) {
+            /* Table doesn't exist in child; try other children. */
+            continue;
+        }
+        /* Take the aggregate if it stands for rows; otherwise scan. */
+        memset(&agg, 0, sizeof(agg));
+        agg.job = &job;
+        a = tmstat_table(child, rollup_name);
+        if (a != NULL) {
+            for (unsigned i = 0; i < a->col_count; i++) {
+                if (strcmp(a->col[i].name, TMSTAT_ROLLUP_ROWS) == 0) {
+                    agg.rows = &a->col[i];
+                }
+            }
+        }
+        if ((agg.rows != NULL) && (agg.rows->size == sizeof(uint64_t))) {
+            ret = tmstat_query_table(stat, a, 0, NULL, NULL,
+                                     tmstat_rollup_agg_row, &agg);
+        }
+        if ((ret == 0) && !agg.used) {
+            ret = tmstat_query_table(stat, t, 0, NULL, NULL,
+                                     tmstat_rollup_row, &job);
+        }
+        if (ret != 0) {
+            /* tmstat_query_table sets errno. */
+            return -1;
+        }
+    }
+    *found = job.found;
+    return 0;
+}
+
+/**
+ * Roll up matching rows straight into a row data buffer, merging each
+ * one into the buffer as the scan finds it.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table       Table describing the result.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_name    Column names to key upon.
+ * @param[in]   col_value   Column values to match.
+ * @param[out]  data        Result row data, if anything matched.
+ * @param[out]  found       Whether anything matched.
+ * @return 0 on success, -1 on failure.
+ */
+static int
+tmstat_rollup(TMSTAT stat, TMTABLE table,
+              unsigned col_count, char **col_name, void **col_value,
+              uint8_t *data, bool *found)
+{
+    struct tmstat_rollup_job job;
+    signed              ret;
+
+    *found = false;
+    if ((col_count == 0) && (stat->origin != CREATE)) {
+        /* Children may have done the work for us. */
+        ret = tmstat_rollup_maintained(stat, table, data, found);
+        if (ret != 1) {
+            return ret;
+        }
+    }
+    if (stat->pool != NULL) {
+        /* Large tables are rolled up by the worker threads. */
+        ret = tmstat_query_rollup_parallel(stat, table, col_count, col_name,
+                                           col_value, data, found);
+        if (ret != 1) {
+            return ret;
         }
     }
-end:
-    tmidx_free(&rows);
+    memset(&job, 0, sizeof(job));
+    job.table = table;
+    job.acc = data;
+    ret = _tmstat_query(stat, table->td->name, col_count, col_name,
+                        col_value, tmstat_rollup_row, &job);
+    *found = job.found;
     return ret;
 }
 
@@ -4391,176 +9317,651 @@ tmstat_query_rollup(TMSTAT stat, char *table_name,
                     unsigned col_count, char **col_name, void **col_value,
                     TMROW *row_handle)
 {
-    struct tmidx        rows;
-    TMROW               row;
     TMTABLE             table;
+    TMROW               row;
+    bool                found;
     signed              ret;
-    TMROW               src;
 
     tmstat_refresh(stat, false);
     *row_handle = NULL;
-    tmidx_init(&rows);
-    if (stat->origin != CREATE) {
-        ret = tmstat_query_children(stat, &rows, table_name,
-            col_count, col_name, col_value);
-        if (ret != 0) {
-            goto out;
-        }
-        goto merge;
+    table = tmstat_table(stat, table_name);
+    if (table == NULL) {
+        /* No matching table; nothing to roll up. */
+        return -1;
+    }
+    /* The result lives in a pseudo row, not in the segment. */
+    ret = tmstat_pseudo_row_create(table, &row);
+    if (ret != 0) {
+        /* tmstat_pseudo_row_create sets errno. */
+        return -1;
     }
-    /* Locate table. */
+    ret = tmstat_rollup(stat, table, col_count, col_name, col_value,
+                        row->data, &found);
+    if ((ret != 0) || !found) {
+        tmstat_row_drop(row);
+        return -1;
+    }
+    *row_handle = row;
+    return 0;
+}
+
+/*
+ * Locate rows by column values and rollup all values into a buffer.
+ */
+int
+tmstat_query_rollup_data(TMSTAT stat, char *table_name,
+                         unsigned col_count, char **col_name,
+                         void **col_value, void *data, unsigned size)
+{
+    TMTABLE             table;
+    bool                found;
+
+    tmstat_refresh(stat, false);
     table = tmstat_table(stat, table_name);
     if (table == NULL) {
-        /* No matching table; treat as if the table were empty. */
-        ret = 0;
-        goto out;
+        /* No matching table; nothing to roll up. */
+        errno = ENOENT;
+        return -1;
     }
-    /* Locate rows. */
-    ret = tmstat_query_table(stat, table, &rows,
-                             col_count, col_name, col_value);
-    if (ret) {
-        goto out;
+    if (size < table->rowsz) {
+        /* Caller's buffer cannot hold a row. */
+        errno = EINVAL;
+        return -1;
+    }
+    if (tmstat_rollup(stat, table, col_count, col_name, col_value,
+                      (uint8_t *)data, &found) != 0) {
+        /* tmstat_rollup sets errno. */
+        return -1;
+    }
+    if (!found) {
+        errno = ENOENT;
+        return -1;
     }
+    return 0;
+}
 
-merge:
-    /* Merge rows, but don't check indices. */
-    ret = tmstat_query_rollup_merge(stat, table_name, &rows);
+/**
+ * A source row awaiting ordering by tmstat_table_copy_rows.
+ */
+struct tmstat_skey {
+    uint64_t            prefix;         //!< Normalized leading key bytes.
+    unsigned            idx;            //!< Source row index.
+};
 
-    /* Return results. */
-    if (tmidx_count(&rows) != 1) {
-        ret = -1;
-    } else {
-        /* Return result row. Increment ref counter. */
-        src = TMIDX_ROW(&rows, 0);
-        if (src == NULL) {
-            ret = -1;
-        } else {
-            tmstat_row_ref(src);
-            *row_handle = src;
+/**
+ * Share of a radix sort.  Prefix jobs normalize the keys of source rows
+ * [first, last) into tmp; bucket jobs then sort buckets [first, last)
+ * of skey, each a run of rows agreeing on all but the low shift bits.
+ */
+struct tmstat_sort_job {
+    TMTABLE             table;          //!< Table whose rows we sort.
+    struct tmidx       *src;            //!< Source rows.
+    struct tmstat_skey *skey;           //!< Keys, bucketed then sorted.
+    struct tmstat_skey *tmp;            //!< Scratch, as long as skey.
+    const unsigned     *bucket;         //!< Start of each bucket in skey.
+    unsigned            shift;          //!< Bits below the bucket byte.
+    bool                exact;          //!< Prefixes hold entire keys.
+    unsigned            first;          //!< First row or bucket.
+    unsigned            last;           //!< End of rows or buckets.
+};
+
+/**
+ * Normalize the leading key bytes of a row, so that comparing them as
+ * integers agrees with tmstat_data_cmp as far as they go: integers are
+ * stored big-endian (signed ones with the sign bit flipped), text is
+ * zero past its terminator, and anything else is compared bytewise.
+ *
+ * @param[in]   table       Table describing the row.
+ * @param[in]   data        Row data.
+ * @param[out]  exact       Whether the whole key fit.
+ * @return the prefix, its first byte most significant.
+ */
+static uint64_t
+tmstat_key_prefix(TMTABLE table, const uint8_t *data, bool *exact)
+{
+    uint64_t        prefix = 0, v;
+    unsigned        bytes = 0, k, n, size;
+    const uint8_t  *f;
+    TMCOL           col;
+    bool            text_end;
+
+    *exact = true;
+    for (k = 0; k < table->key_col_count; k++) {
+        col = &table->key_col[k];
+        f = &data[col->offset];
+        size = (col->type == TMSTAT_T_TEXT) ? col->size - 1 : col->size;
+        if (bytes + size > sizeof(prefix)) {
+            *exact = false;
+        }
+        if ((col->type == TMSTAT_T_SIGNED) ||
+            (col->type == TMSTAT_T_UNSIGNED)) {
+            switch (size) {
+            case 1: v = *(const uint8_t *)f; break;
+            case 2: v = *(const uint16_t *)f; break;
+            case 4: v = *(const uint32_t *)f; break;
+            case 8: v = *(const uint64_t *)f; break;
+            default: goto bytewise;
+            }
+            if (col->type == TMSTAT_T_SIGNED) {
+                v ^= 1ull << (8 * size - 1);
+            }
+            for (n = size; (n > 0) && (bytes < sizeof(prefix)); n--) {
+                prefix = (prefix << 8) | ((v >> (8 * (n - 1))) & 0xff);
+                bytes++;
+            }
+            continue;
+        }
+bytewise:
+        text_end = false;
+        for (n = 0; (n < size) && (bytes < sizeof(prefix)); n++) {
+            /* strncmp stops at the terminator; so do we. */
+            text_end |= (col->type == TMSTAT_T_TEXT) && (f[n] == '\0');
+            prefix = (prefix << 8) | (text_end ? 0 : f[n]);
+            bytes++;
         }
     }
+    if ((bytes > 0) && (bytes < sizeof(prefix))) {
+        prefix <<= 8 * (sizeof(prefix) - bytes);
+    }
+    return prefix;
+}
 
-out:
-    TMIDX_FOREACH(&rows, row) {
-        tmstat_row_drop(row);
+/*
+ * qsort_r comparator for sort keys sharing a prefix: by key, then by
+ * source order so that equal keys merge in the order they were found.
+ */
+static int
+tmstat_skey_cmp(const void *a, const void *b, void *arg)
+{
+    struct tmstat_sort_job *job = (struct tmstat_sort_job *)arg;
+    const struct tmstat_skey *ka = (const struct tmstat_skey *)a;
+    const struct tmstat_skey *kb = (const struct tmstat_skey *)b;
+    TMROW           ra = tmidx_entry(job->src, ka->idx);
+    TMROW           rb = tmidx_entry(job->src, kb->idx);
+    int64_t         cmp = tmstat_data_cmp(job->table, ra->data, rb->data);
+
+    if (cmp == 0) {
+        cmp = (int64_t)ka->idx - (int64_t)kb->idx;
+    }
+    return (cmp > 0) - (cmp < 0);
+}
+
+/**
+ * Pool job: normalize the keys of a run of source rows.
+ *
+ * @param[in]   arg         struct tmstat_sort_job.
+ */
+static void
+tmstat_sort_prefix(void *arg)
+{
+    struct tmstat_sort_job *job = (struct tmstat_sort_job *)arg;
+    TMROW           row;
+    bool            exact;
+
+    for (unsigned i = job->first; i < job->last; i++) {
+        row = tmidx_entry(job->src, i);
+        job->tmp[i].prefix = tmstat_key_prefix(job->table, row->data,
+                                                &exact);
+        job->tmp[i].idx = i;
+        job->exact &= exact;
     }
-    tmidx_free(&rows);
-    return ret;
 }
 
 /**
- * Perform an in-order tree walk of a tree of pseudo-rows, creating
- * real rows as we go, thereby producing sorted output.
+ * Pool job: sort a run of buckets.  Each bucket is radix sorted, least
+ * significant byte first, on the bytes below the one it was bucketed
+ * by, skipping bytes on which its rows all agree; rows whose prefixes
+ * tie are then ordered by comparison, unless the prefixes are exact.
+ * Every step is stable, so equal keys stay in source order.
  *
- * Regardless of success, the entire tree under this node will be
- * walked and the row at each node will be dropped.
+ * @param[in]   arg         struct tmstat_sort_job.
+ */
+static void
+tmstat_sort_buckets(void *arg)
+{
+    struct tmstat_sort_job *job = (struct tmstat_sort_job *)arg;
+    struct tmstat_skey *a, *t, *swap;
+    unsigned        count[256];
+    unsigned        b, lo, hi, n, i, j, d, sum;
+
+    for (b = job->first; b < job->last; b++) {
+        lo = job->bucket[b];
+        hi = job->bucket[b + 1];
+        n = hi - lo;
+        if (n < 2) {
+            continue;
+        }
+        a = &job->skey[lo];
+        t = &job->tmp[lo];
+        for (d = 0; d < job->shift; d += 8) {
+            memset(count, 0, sizeof(count));
+            for (i = 0; i < n; i++) {
+                count[(a[i].prefix >> d) & 0xff]++;
+            }
+            if (count[(a[0].prefix >> d) & 0xff] == n) {
+                /* All alike in this byte. */
+                continue;
+            }
+            for (i = 0, sum = 0; i < 256; i++) {
+                sum += count[i];
+                count[i] = sum - count[i];
+            }
+            for (i = 0; i < n; i++) {
+                t[count[(a[i].prefix >> d) & 0xff]++] = a[i];
+            }
+            swap = a;
+            a = t;
+            t = swap;
+        }
+        if (a != &job->skey[lo]) {
+            memcpy(&job->skey[lo], a, n * sizeof(*a));
+            a = &job->skey[lo];
+        }
+        if (job->exact) {
+            continue;
+        }
+        for (i = 0; i < n; i = j) {
+            for (j = i + 1; (j < n) && (a[j].prefix == a[i].prefix); j++) {
+                ;
+            }
+            if (j - i > 1) {
+                qsort_r(&a[i], j - i, sizeof(*a), tmstat_skey_cmp, job);
+            }
+        }
+    }
+}
+
+/**
+ * Order source rows by key.  The keys are normalized into fixed-width
+ * prefixes and bucketed on the most significant byte that differs
+ * among them; the buckets are then sorted independently, so that they
+ * can be shared among the worker threads, and concatenated.
  *
- * @param[in]   stat        Associated segment.
- * @param[in]   table       Table to put sorted rows into.
- * @param[out]  rows        Index to put sorted rows into.
- * @param       node        Tree node to walk; will be freed.
- * @param[in]   good        If false, node is freed and no other work is done.
+ * @param[in]   table       Table describing the rows.
+ * @param[in]   src         Source rows.
+ * @param[in]   pool        Worker threads, or NULL.
+ * @param[out]  order       Source row indexes, in key order.
  * @return 0 on success, -1 on failure.
  */
 static int
-tmstat_sort_walk(TMSTAT stat, TMTABLE table, struct tmidx *rows,
-    tmrbt_node node, int good)
+tmstat_sort_rows(TMTABLE table, struct tmidx *src, struct tmstat_pool *pool,
+                 unsigned *order)
 {
-    signed idx = 0, ret = 0;
-    TMROW row;
-    
-    if (node->link[0] != NULL) {
-        ret = tmstat_sort_walk(stat, table, rows, node->link[0], good);
-    }
-    /*
-     * Don't make new rows if everything isn't okay - but continue
-     * to traverse to free the pseudo rows.
-     */
-    if (ret == -1 || good == -1) {
-        ret = -1;
+    struct tmstat_sort_job *job = NULL;
+    struct tmstat_skey *skey = NULL, *tmp = NULL;
+    unsigned        bucket[257];
+    unsigned        i, b, n, job_count, shift;
+    uint64_t        diff = 0;
+    bool            exact = true;
+    signed          ret = -1;
+
+    n = tmidx_count(src);
+    job_count = ((pool != NULL) && (n >= TMSTAT_PARALLEL_ROWS)) ?
+        pool->thread_count + 1 : 1;
+    job = (struct tmstat_sort_job *)calloc(job_count, sizeof(*job));
+    skey = (struct tmstat_skey *)malloc((n + 1) * sizeof(*skey));
+    tmp = (struct tmstat_skey *)malloc((n + 1) * sizeof(*tmp));
+    if ((job == NULL) || (skey == NULL) || (tmp == NULL)) {
+        /* Allocation failure; calloc/malloc set errno. */
         goto out;
     }
-    /* Create a real row in order. */
-    ret = tmstat_row_create(stat, table, &row);
-    if (ret == -1) {
-        /* Creation error; continue but report error upon completion. */
-        goto out;
+    for (i = 0; i < job_count; i++) {
+        job[i].table = table;
+        job[i].src = src;
+        job[i].skey = skey;
+        job[i].tmp = tmp;
+        job[i].bucket = bucket;
+        job[i].exact = true;
+        job[i].first = (unsigned)((uint64_t)n * i / job_count);
+        job[i].last = (unsigned)((uint64_t)n * (i + 1) / job_count);
+    }
+    if (job_count > 1) {
+        tmstat_pool_run(pool, tmstat_sort_prefix, job, sizeof(*job),
+                        job_count);
+    } else {
+        tmstat_sort_prefix(&job[0]);
     }
-    memcpy(row->data, node->key->data, table->rowsz);
-    idx = tmidx_add(rows, row);
-    if (idx == -1) {
-        /* Insertion error; continue but report error upon completion. */
-        tmstat_row_drop(row);
-        ret = -1;
-        goto out;
+    /* Bucket on the most significant byte in which any two differ. */
+    for (i = 0; i < job_count; i++) {
+        exact &= job[i].exact;
     }
-out:
-    tmstat_row_drop(node->key);
-    if (node->link[1] != NULL) {
-        /* ret will always be -1 if good is -1 */
-        ret = tmstat_sort_walk(stat, table, rows, node->link[1], ret);
+    for (i = 1; i < n; i++) {
+        diff |= tmp[i].prefix ^ tmp[0].prefix;
+    }
+    shift = 0;
+    while ((shift < 56) && ((diff >> (shift + 8)) != 0)) {
+        shift += 8;
+    }
+    memset(bucket, 0, sizeof(bucket));
+    for (i = 0; i < n; i++) {
+        bucket[((tmp[i].prefix >> shift) & 0xff) + 1]++;
+    }
+    for (b = 0; b < 256; b++) {
+        bucket[b + 1] += bucket[b];
+    }
+    for (i = 0; i < n; i++) {
+        skey[bucket[(tmp[i].prefix >> shift) & 0xff]++] = tmp[i];
     }
+    /* Scattering advanced each start to the next; step back. */
+    memmove(&bucket[1], &bucket[0], 256 * sizeof(bucket[0]));
+    bucket[0] = 0;
+    /* Hand out runs of buckets of roughly equal size. */
+    for (i = 0, b = 0; i < job_count; i++) {
+        job[i].shift = shift;
+        job[i].exact = exact;
+        job[i].first = b;
+        while ((b < 256) &&
+               (bucket[b + 1] <= (uint64_t)n * (i + 1) / job_count)) {
+            b++;
+        }
+        if (i == job_count - 1) {
+            b = 256;
+        }
+        job[i].last = b;
+    }
+    if (job_count > 1) {
+        tmstat_pool_run(pool, tmstat_sort_buckets, job, sizeof(*job),
+                        job_count);
+    } else {
+        tmstat_sort_buckets(&job[0]);
+    }
+    for (i = 0; i < n; i++) {
+        order[i] = skey[i].idx;
+    }
+    ret = 0;
+out:
+    free(tmp);
+    free(skey);
+    free(job);
     return ret;
 }
 
 /**
  * Merge all the rows from child segments into a new table, writing
- * them in sorted order.
+ * them in sorted order.  Rows are ordered by tmstat_sort_rows; those
+ * with equal keys then lie side by side and are merged as they are
+ * copied out.
  *
  * @param[in]   stat        Associated segment.
  * @param[in]   table       Table to put the merged rows in.
- * @param[in]   rows        Source rows, which are freed.
+ * @param[in]   rows        Source rows; left for the caller to drop.
+ * @param[in]   pool        Worker threads to sort with, or NULL.
  * @return 0 on success, -1 on failure.
  */
 static int
-tmstat_table_copy_rows(TMSTAT stat, TMTABLE table, struct tmidx *rows)
+tmstat_table_copy_rows(TMSTAT stat, TMTABLE table, struct tmidx *rows,
+                       struct tmstat_pool *pool)
 {
-    signed          ret;
-    tmrbt           tree;
+    signed          ret = -1;
     struct tmidx    dest;
-    TMROW           row;
+    TMROW           row = NULL, src_row;
+    unsigned       *order = NULL;
+    unsigned        i;
 
     /* We must own a segment if we're going to add rows to it. */
     if (stat->origin != CREATE) {
         errno = EINVAL;
         return -1;
     }
+    tmidx_init(&dest);
     /* Change page allocation policy to reduce frequency of mmap calls. */
     stat->alloc_policy = PREALLOCATE;
-    /* Perform a merge.  This creates pseudo-rows and puts them in a tree. */
-    ret = tmstat_merge_rows(table, rows, &tree);
-    /* tmstat_merge_rows has freed our source rows no matter its success. */
-    if (ret != 0) {
+    order = (unsigned *)malloc((tmidx_count(rows) + 1) * sizeof(*order));
+    if (order == NULL) {
+        /* Allocation failure; malloc sets errno. */
         goto out;
     }
-    /* In any event, we don't need this index because we have the tree. */
-    tmidx_free(rows);
-    tmidx_init(rows);
-    /* Walk tree in order, creating real rows and freeing pseudo-rows. */
-    tmidx_init(&dest);
-    ret = tmstat_sort_walk(stat, table, &dest, tree->root, 0);
-    if (ret != 0) {
-        /* tmstat_sort_walk freed source rows but not its partial results. */
-        TMIDX_FOREACH(&dest, row) {
+    if (tmstat_sort_rows(table, rows, pool, order) != 0) {
+        /* tmstat_sort_rows sets errno. */
+        goto out;
+    }
+    /* Copy rows out in order, merging runs of equal keys. */
+    for (i = 0; i < tmidx_count(rows); i++) {
+        src_row = tmidx_entry(rows, order[i]);
+        if ((row != NULL) &&
+            (tmstat_data_cmp(table, row->data, src_row->data) == 0)) {
+            if (tmstat_merge_data(table, row->data, src_row->data) != 0) {
+                /* tmstat_merge_data sets errno. */
+                goto out;
+            }
+            continue;
+        }
+        if (tmstat_row_create(stat, table, &row) != 0) {
+            /* tmstat_row_create sets errno. */
+            goto out;
+        }
+        memcpy(row->data, src_row->data, table->rowsz);
+        if (tmidx_add(&dest, row) < 0) {
+            /* Insertion failure; tmidx_add sets errno. */
             tmstat_row_drop(row);
+            goto out;
         }
-        tmidx_free(&dest);
-        goto out;
     }
     table->td->is_sorted = true;
-    /* Clean up. Now that the rows are in the new table, we don't need them. */
-    tmrbt_free(tree);
+    ret = 0;
+out:
+    /* Keep the new rows on success; remove them otherwise. */
     TMIDX_FOREACH(&dest, row) {
-        tmstat_row_preserve(row);
+        if (ret == 0) {
+            tmstat_row_preserve(row);
+        }
         tmstat_row_drop(row);
     }
     tmidx_free(&dest);
-out:
+    free(order);
     /* Don't need to prealloc anymore. */
     stat->alloc_policy = AS_NEEDED;
     return ret;
 }
 
+/*
+ * Scan callback which collects row data pointers.
+ */
+static int
+tmstat_collect_data(void *arg, TMTABLE table, uint8_t *row,
+                    struct tmstat_slab *slab, unsigned rowno)
+{
+    return (tmidx_add((struct tmidx *)arg, row) >= 0) ? 0 : -1;
+}
+
+/**
+ * Cursor over one sorted child table, for tmstat_table_copy_sorted.
+ */
+struct tmstat_kcursor {
+    struct tmidx        rows;           //!< Row data, in key order.
+    unsigned            next;           //!< Next row to merge.
+};
+
+/*
+ * Order two cursors by their next row's key, then by child order so
+ * that equal keys always merge in the same order.
+ */
+static bool
+tmstat_kcursor_less(TMTABLE table, struct tmstat_kcursor *cursor,
+                    unsigned a, unsigned b)
+{
+    int64_t         cmp;
+
+    cmp = tmstat_data_cmp(table,
+        tmidx_entry(&cursor[a].rows, cursor[a].next),
+        tmidx_entry(&cursor[b].rows, cursor[b].next));
+    return (cmp < 0) || ((cmp == 0) && (a < b));
+}
+
+/*
+ * Restore heap order below heap[i].
+ */
+static void
+tmstat_kheap_down(TMTABLE table, struct tmstat_kcursor *cursor,
+                  unsigned *heap, unsigned n, unsigned i)
+{
+    unsigned        child, tmp;
+
+    while ((child = 2 * i + 1) < n) {
+        if ((child + 1 < n) &&
+            tmstat_kcursor_less(table, cursor, heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!tmstat_kcursor_less(table, cursor, heap[child], heap[i])) {
+            break;
+        }
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+/**
+ * Copy a table whose rows are already sorted in every child (as are
+ * segments written by tmstat_merge) with a streaming k-way merge: a
+ * heap over per-child cursors yields rows in key order, rows sharing a
+ * key are merged as they arrive, and each finished row goes straight
+ * into the destination.  No tree is built.
+ *
+ * @param[in]   dest        Target segment.
+ * @param[in]   src         Source segment.
+ * @param[in]   table_name  Table name.
+ * @param[in]   col         Columns, for registering the target table.
+ * @param[in]   col_count   Number of columns.
+ * @param[in]   size        Row size.
+ * @return 0 on success, -1 on failure, or 1 if some child isn't sorted.
+ */
+static int
+tmstat_table_copy_sorted(TMSTAT dest, TMSTAT src, char *table_name,
+                         TMCOL col, unsigned col_count, unsigned size)
+{
+    TMSTAT         *child;
+    TMSTAT          self = src;
+    TMTABLE         table, child_table;
+    TMROW           row;
+    struct tmstat_kcursor *cursor = NULL;
+    unsigned       *heap = NULL;
+    uint8_t        *acc = NULL;
+    const uint8_t  *data;
+    unsigned        k, n, i, total = 0;
+    bool            have = false;
+    int             ret = -1;
+
+    if (dest->origin != CREATE) {
+        /* We must own a segment if we're going to add rows to it. */
+        errno = EINVAL;
+        return -1;
+    }
+    if (src->origin != CREATE) {
+        child = (TMSTAT *)src->child_idx.a;
+        k = tmidx_count(&src->child_idx);
+    } else {
+        child = &self;
+        k = 1;
+    }
+    for (i = 0; i < k; i++) {
+        child_table = tmstat_table(child[i], table_name);
+        if ((child[i]->origin == UNION) || (child[i]->origin == READ) ||
+            (tmidx_count(&child[i]->child_idx) != 0) ||
+            ((child_table != NULL) && !child_table->td->is_sorted)) {
+            /* Not a sorted leaf; merge the usual way. */
+            return 1;
+        }
+    }
+    cursor = (struct tmstat_kcursor *)calloc(k + 1, sizeof(*cursor));
+    heap = (unsigned *)calloc(k + 1, sizeof(*heap));
+    acc = (uint8_t *)malloc(size);
+    if ((cursor == NULL) || (heap == NULL) || (acc == NULL)) {
+        /* Memory exhaustion; calloc/malloc set errno. */
+        goto out;
+    }
+    for (i = 0; i < k; i++) {
+        tmidx_init(&cursor[i].rows);
+    }
+    for (i = 0; i < k; i++) {
+        child_table = tmstat_table(child[i], table_name);
+        if (child_table == NULL) {
+            /* Nothing to merge from this child. */
+            continue;
+        }
+        ret = tmstat_query_table(child[i], child_table, 0, NULL, NULL,
+                                 tmstat_collect_data, &cursor[i].rows);
+        if (ret != 0) {
+            /* Failure; tmstat_query_table sets errno. */
+            ret = -1;
+            goto out;
+        }
+        total += tmidx_count(&cursor[i].rows);
+    }
+    if (total == 0) {
+        /* Skip empty table. */
+        ret = 0;
+        goto out;
+    }
+    ret = tmstat_table_register(dest, &table, table_name, col, col_count,
+                                size);
+    if (ret != 0) {
+        goto out;
+    }
+    /* Change page allocation policy to reduce frequency of mmap calls. */
+    dest->alloc_policy = PREALLOCATE;
+    /* Build a heap of the cursors with rows left. */
+    n = 0;
+    for (i = 0; i < k; i++) {
+        if (tmidx_count(&cursor[i].rows) != 0) {
+            heap[n++] = i;
+        }
+    }
+    for (i = n / 2; i-- > 0; ) {
+        tmstat_kheap_down(table, cursor, heap, n, i);
+    }
+    while (n > 0) {
+        i = heap[0];
+        data = tmidx_entry(&cursor[i].rows, cursor[i].next);
+        if (have && (tmstat_data_cmp(table, acc, data) == 0)) {
+            /* Same key as the row being built; merge. */
+            ret = tmstat_merge_data(table, acc, data);
+            if (ret != 0) {
+                goto done;
+            }
+        } else {
+            if (have) {
+                /* Previous key is finished; write it out. */
+                ret = tmstat_row_create(dest, table, &row);
+                if (ret != 0) {
+                    goto done;
+                }
+                memcpy(row->data, acc, size);
+                tmstat_row_preserve(row);
+                tmstat_row_drop(row);
+            }
+            memcpy(acc, data, size);
+            have = true;
+        }
+        /* Advance the cursor, dropping it once it runs dry. */
+        if (++cursor[i].next == tmidx_count(&cursor[i].rows)) {
+            heap[0] = heap[--n];
+        }
+        tmstat_kheap_down(table, cursor, heap, n, 0);
+    }
+    ret = tmstat_row_create(dest, table, &row);
+    if (ret == 0) {
+        memcpy(row->data, acc, size);
+        tmstat_row_preserve(row);
+        tmstat_row_drop(row);
+        table->td->is_sorted = true;
+    }
+done:
+    /* Don't need to prealloc anymore. */
+    dest->alloc_policy = AS_NEEDED;
+out:
+    if (cursor != NULL) {
+        for (i = 0; i < k; i++) {
+            tmidx_free(&cursor[i].rows);
+        }
+    }
+    free(cursor);
+    free(heap);
+    free(acc);
+    return ret;
+}
+
 /**
  * Copy a table, producing sorted output in the destination.
  *
@@ -4598,8 +9999,16 @@ tmstat_table_copy(TMSTAT dest, TMSTAT src, char *table_name)
         goto out;
     }
     
+    /* Sorted children need no tree; merge them as they stream by. */
+    ret = tmstat_table_copy_sorted(dest, src, table_name, col, col_count,
+                                   size);
+    if (ret != 1) {
+        goto out;
+    }
+
     /* Obtain all of the source rows. */
-    ret = _tmstat_query(src, &rows, table_name, 0, NULL, NULL);
+    ret = _tmstat_query(src, table_name, 0, NULL, NULL,
+                        tmstat_collect_row, &rows);
     if (ret != 0) {
         goto out;
     }
@@ -4615,7 +10024,7 @@ tmstat_table_copy(TMSTAT dest, TMSTAT src, char *table_name)
     }
 
     /* Merge, sort, and copy the rows. */
-    ret = tmstat_table_copy_rows(dest, table, &rows);
+    ret = tmstat_table_copy_rows(dest, table, &rows, src->pool);
     if (ret != 0) {
         goto out;
     }
@@ -16,6 +16,25 @@ ${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=parse-print
 ${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=long-keys
 ${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=unterminated-keys
 ${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=insn
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=visit
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=result
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=project
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=where
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=batch
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=prepare
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=parallel
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=explain
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=top
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=group
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=join
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=unmerged
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=select
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=deadline
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=wide
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=disjoint
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=cached
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=lazy
+${OBJ_DIR}/tmstat_test --base=${OBJ_DIR}/test_data --test=rollup-maintained
 sh test-eval.sh ${OBJ_DIR}
 touch ${OBJ_DIR}/test_data/pass
 
@@ -82,17 +82,28 @@ static const char usage[] =
    "\n"
    "Inspect and manipulate statistics subsystem.\n"
    "\n"
+   "Rows may also be selected by comparison with COL!=VALUE, COL<VALUE,\n"
+   "COL<=VALUE, COL>VALUE and COL>=VALUE, on any column; all terms must\n"
+   "hold.  Comparisons on merged columns apply to the merged rows.\n"
+   "\n"
    "Supported options:\n"
    "   -a, --all            Display all tables.\n"
    "   -b, --base=PATH      Set segment directory base path.\n"
    "   -c, --csv            Output in CSV format.\n"
    "   -d, --directory=DIR  Subscribe to specific directory.\n"
    "   -e, --eval EXPR      Evaluate expression.\n"
+   "   -E, --explain        Describe how a query would run.\n"
    "   -f, --file=PATH      Inspect specific segment file.\n"
    "   -h, --help           Display this text.\n"
    "   -i, --internal       Include internal tables.\n"
+   "   -J, --join=TABLE:COL[=COL][,...]\n"
+   "                        Join TABLE's rows on matching column values.\n"
    "   -m, --merge=PATH     Merge subscribed segments into one segment file.\n"
    "   -r, --rollup         Merge all selected rows, ignoring keys.\n"
+   "   -S, --select=GLOB    Only subscribe to segments whose names match GLOB.\n"
+   "   -s, --sort=COL       Order rows by numeric COL, largest first.\n"
+   "   -t, --top=N          Display only the first N rows (requires --sort).\n"
+   "   -u, --unmerged       Show each segment's rows separately, by source.\n"
    "   -x, --extract=DIR    Extract segments into directory.\n"
    "   -w, --wrap=COLS      Wrap output at COLS columns.\n"
    "\n"
@@ -108,11 +119,17 @@ enum {
     OPT_DIR,
     OPT_EXTRACT,
     OPT_EVAL,
+    OPT_EXPLAIN,
     OPT_FILE,
     OPT_HELP,
     OPT_INTERNAL,
+    OPT_JOIN,
     OPT_MERGE,
     OPT_ROLLUP,
+    OPT_SELECT,
+    OPT_SORT,
+    OPT_TOP,
+    OPT_UNMERGED,
     OPT_VERBOSE,
     OPT_WRAP,
     /* This entry is always last. */
@@ -124,16 +141,22 @@ static struct option long_options[] = {
     [OPT_CSV]           = { "csv",          no_argument,        NULL, 'c' },
     [OPT_DIR]           = { "dir",          required_argument,  NULL, 'd' },
     [OPT_EVAL]          = { "eval",         required_argument,  NULL, 'e' },
+    [OPT_EXPLAIN]       = { "explain",      no_argument,        NULL, 'E' },
     [OPT_EXTRACT]       = { "extract",      required_argument,  NULL, 'x' },
     [OPT_FILE]          = { "file",         required_argument,  NULL, 'f' },
     [OPT_HELP]          = { "help",         no_argument,        NULL, 'h' },
     [OPT_INTERNAL]      = { "internal",     no_argument,        NULL, 'i' },
+    [OPT_JOIN]          = { "join",         required_argument,  NULL, 'J' },
     [OPT_MERGE]         = { "merge",        required_argument,  NULL, 'm' },
     [OPT_ROLLUP]        = { "rollup",       no_argument,        NULL, 'r' },
+    [OPT_SELECT]        = { "select",       required_argument,  NULL, 'S' },
+    [OPT_SORT]          = { "sort",         required_argument,  NULL, 's' },
+    [OPT_TOP]           = { "top",          required_argument,  NULL, 't' },
+    [OPT_UNMERGED]      = { "unmerged",     no_argument,        NULL, 'u' },
     [OPT_WRAP]          = { "wrap",         required_argument,  NULL, 'w' },
     [OPT_COUNT]         = { 0 },
 };
-static char options[] = "ab:cd:e:f:Hhijm:rx:w:";
+static char options[] = "ab:cd:Ee:f:HhiJ:jm:rS:s:t:ux:w:";
 
 /*
  * User preferences.
@@ -144,6 +167,13 @@ static bool         internal = false;       /* Include internal tables. */
 static bool         csv = false;            /* Display in csv format. */
 static char        *merge_path = NULL;      /* Path to merge into. */
 static bool         rollup = false;         /* Merge all selected rows? */
+static bool         explain = false;        /* Describe queries instead? */
+static char        *sort_col = NULL;        /* Column to order rows by. */
+static unsigned     top = UINT_MAX;         /* Most rows to display. */
+static bool         top_given = false;      /* Was --top given? */
+static char        *join_spec = NULL;       /* Table and columns to join. */
+static bool         unmerged = false;       /* Keep segments' rows apart? */
+static char        *select_glob = NULL;     /* Segment names to include. */
 
 /*
  * Format value into a text representation.
@@ -387,40 +417,33 @@ convert_pattern(void *value, TMCOL tmcol, char *pattern)
 }
 
 /*
- * Display result set.
+ * Display formatted result strings, row_count rows of col_count each;
+ * frees the strings.
  */
-void
-display(TMSTAT tmstat, TMROW *row, unsigned row_count,
-        TMCOL col, unsigned col_count, bool hide)
+static void
+display_text(char **text, unsigned row_count, TMCOL col, unsigned col_count,
+             bool hide)
 {
     unsigned    w, len, col_start, col_end, col_idx, row_idx;
-    char       *s;
     unsigned   *width;
-    char      **text;
     char      **fmt;
 
     width = malloc(sizeof(unsigned) * col_count);
     if (width == NULL) {
         err(1, NULL);
     }
-    text = malloc(sizeof(char *) * row_count * col_count);
-    if (text == NULL) {
-        err(1, NULL);
-    }
     fmt = malloc(sizeof(char *) * col_count);
     if (fmt == NULL) {
         err(1, NULL);
     }
 
     /*
-     * Generate result strings.
+     * Measure result strings.
      */
     memset(width, 0, sizeof(unsigned) * col_count);
     for (row_idx = 0; row_idx < row_count; row_idx++) {
         for (col_idx = 0; col_idx < col_count; col_idx++) {
-            s = format_value(row[row_idx], col[col_idx].name);
-            text[row_idx * col_count + col_idx] = s;
-            len = strlen(s);
+            len = strlen(text[row_idx * col_count + col_idx]);
             if (len > width[col_idx]) {
                 /* Track widest column. */
                 width[col_idx] = len;
@@ -509,10 +532,189 @@ display(TMSTAT tmstat, TMROW *row, unsigned row_count,
         }
     }
     free(width);
-    free(text);
     free(fmt);
 }
 
+/*
+ * Display result set.
+ */
+void
+display(TMSTAT tmstat, TMROW *row, unsigned row_count,
+        TMCOL col, unsigned col_count, bool hide)
+{
+    char      **text;
+
+    text = malloc(sizeof(char *) * row_count * col_count);
+    if (text == NULL) {
+        err(1, NULL);
+    }
+    /* Generate result strings. */
+    for (unsigned row_idx = 0; row_idx < row_count; row_idx++) {
+        for (unsigned col_idx = 0; col_idx < col_count; col_idx++) {
+            text[row_idx * col_count + col_idx] =
+                format_value(row[row_idx], col[col_idx].name);
+        }
+    }
+    display_text(text, row_count, col, col_count, hide);
+    free(text);
+}
+
+/*
+ * Display result set, each row prefixed by the label of the segment
+ * it came from.
+ */
+static void
+display_labeled(TMROW *row, unsigned row_count, TMCOL col,
+                unsigned col_count)
+{
+    unsigned        n = col_count + 1;
+    struct TMCOL   *lcol;
+    char          **text;
+
+    lcol = calloc(n, sizeof(struct TMCOL));
+    text = malloc(sizeof(char *) * row_count * n);
+    if ((lcol == NULL) || (text == NULL)) {
+        err(1, NULL);
+    }
+    lcol[0].name = "source";
+    lcol[0].type = TMSTAT_T_TEXT;
+    memcpy(&lcol[1], col, col_count * sizeof(struct TMCOL));
+    for (unsigned row_idx = 0; row_idx < row_count; row_idx++) {
+        text[row_idx * n] = strdup(tmstat_row_label(row[row_idx]));
+        if (text[row_idx * n] == NULL) {
+            err(1, NULL);
+        }
+        for (unsigned col_idx = 0; col_idx < col_count; col_idx++) {
+            text[row_idx * n + col_idx + 1] =
+                format_value(row[row_idx], col[col_idx].name);
+        }
+    }
+    display_text(text, row_count, lcol, n, false);
+    free(text);
+    free(lcol);
+}
+
+/*
+ * Joined rows being collected for display.
+ */
+struct join_text {
+    char          **text;           /* Result strings. */
+    unsigned        row_count;      /* Rows collected. */
+    unsigned        size;           /* Rows text has room for. */
+    unsigned        col_count;      /* Columns per row. */
+};
+
+/*
+ * Join callback: format both halves of a joined row.
+ */
+static int
+join_row(void *arg, const void *left, const void *right,
+         struct TMCOL *left_cols, unsigned left_col_count,
+         struct TMCOL *right_cols, unsigned right_col_count)
+{
+    struct join_text *j = arg;
+    char          **t;
+
+    if (j->row_count == j->size) {
+        j->size = TMCTL_MAX(2 * j->size, 16u);
+        j->text = realloc(j->text, sizeof(char *) * j->size * j->col_count);
+        if (j->text == NULL) {
+            err(EXIT_FAILURE, "realloc");
+        }
+    }
+    t = &j->text[j->row_count++ * j->col_count];
+    for (unsigned i = 0; i < left_col_count; i++) {
+        *t++ = format_column(&left_cols[i],
+                             (char *)left + left_cols[i].offset);
+    }
+    for (unsigned i = 0; i < right_col_count; i++) {
+        *t++ = format_column(&right_cols[i],
+                             (char *)right + right_cols[i].offset);
+    }
+    return 0;
+}
+
+/*
+ * Perform join:
+ *
+ *      TABLE_NAME --join=TABLE_NAME:COLUMN_NAME[=COLUMN_NAME][,...]
+ */
+static void
+join(TMSTAT tmstat, char *left_name, char *spec)
+{
+    struct join_text j = { 0 };
+    char           *right_name, *list, *term, *eq, *save = NULL;
+    char          **left_col = NULL, **right_col = NULL;
+    unsigned        col_count = 0;
+    TMCOL           left_cols, right_cols;
+    unsigned        left_col_count, right_col_count;
+    struct TMCOL   *col;
+    signed          ret;
+
+    right_name = strdup(spec);
+    if (right_name == NULL) {
+        err(EXIT_FAILURE, "strdup");
+    }
+    list = strchr(right_name, ':');
+    if ((list == NULL) || (list[1] == '\0')) {
+        errx(EXIT_FAILURE, "%s: Expected TABLE:COL[,COL]...", spec);
+    }
+    *list++ = '\0';
+    /* Parse join columns: COL (same name on both sides) or LEFT=RIGHT. */
+    for (term = strtok_r(list, ",", &save); term != NULL;
+         term = strtok_r(NULL, ",", &save)) {
+        left_col = realloc(left_col, sizeof(char *) * (col_count + 1));
+        right_col = realloc(right_col, sizeof(char *) * (col_count + 1));
+        if ((left_col == NULL) || (right_col == NULL)) {
+            err(EXIT_FAILURE, "realloc");
+        }
+        eq = strchr(term, '=');
+        if (eq != NULL) {
+            *eq++ = '\0';
+        }
+        left_col[col_count] = term;
+        right_col[col_count] = (eq != NULL) ? eq : term;
+        col_count++;
+    }
+    /* Header: left columns, then right columns qualified by table. */
+    tmstat_table_info(tmstat, left_name, &left_cols, &left_col_count);
+    if (left_col_count == 0) {
+        errx(EXIT_FAILURE, "%s: No such table.", left_name);
+    }
+    tmstat_table_info(tmstat, right_name, &right_cols, &right_col_count);
+    if (right_col_count == 0) {
+        errx(EXIT_FAILURE, "%s: No such table.", right_name);
+    }
+    j.col_count = left_col_count + right_col_count;
+    col = calloc(j.col_count, sizeof(struct TMCOL));
+    if (col == NULL) {
+        err(EXIT_FAILURE, "calloc");
+    }
+    memcpy(col, left_cols, left_col_count * sizeof(struct TMCOL));
+    memcpy(&col[left_col_count], right_cols,
+           right_col_count * sizeof(struct TMCOL));
+    for (unsigned i = left_col_count; i < j.col_count; i++) {
+        if (asprintf(&col[i].name, "%s.%s", right_name, col[i].name) < 0) {
+            err(EXIT_FAILURE, "asprintf");
+        }
+    }
+    ret = tmstat_query_join(tmstat, left_name, right_name, col_count,
+        left_col, right_col, join_row, &j);
+    if (ret != 0) {
+        err(EXIT_FAILURE, "tmstat_query_join");
+    }
+    display_text(j.text, j.row_count, col, j.col_count, false);
+    /* Free. */
+    for (unsigned i = left_col_count; i < j.col_count; i++) {
+        free(col[i].name);
+    }
+    free(col);
+    free(j.text);
+    free(left_col);
+    free(right_col);
+    free(right_name);
+}
+
 /*
  * Perform query:
  *
@@ -522,7 +724,9 @@ static void
 query(TMSTAT tmstat, int argc, char * const argv[], bool hide)
 {
     char           *table_name = argv[0];
-    unsigned        col_count = argc - 1;
+    unsigned        term_count = argc - 1;
+    unsigned        col_count = 0;
+    unsigned        pred_count = 0;
     signed          ret;
     TMCOL           table_col;
     unsigned        table_col_count;
@@ -530,62 +734,118 @@ query(TMSTAT tmstat, int argc, char * const argv[], bool hide)
     TMROW           row;
     unsigned        match_count;
     char          **col_name;
-    char          **col_pattern;
     void          **col_value;
-    char           *eq;
+    struct TMPRED  *pred;
+    struct TMPRED  *where = NULL;
+    enum tmstat_op  op;
+    char           *name;
+    char           *pattern;
+    void           *value;
     int             len;
 
-    col_name = malloc(sizeof(char *) * col_count);
+    col_name = malloc(sizeof(char *) * term_count);
     if (col_name == NULL) {
         err(EXIT_FAILURE, "malloc");
     }
-    col_pattern = malloc(sizeof(char *) * col_count);
-    if (col_pattern == NULL) {
-        err(EXIT_FAILURE, "malloc");
-    }
-    col_value = malloc(sizeof(char *) * col_count);
+    col_value = malloc(sizeof(char *) * term_count);
     if (col_value == NULL) {
         err(EXIT_FAILURE, "malloc");
     }
-    /* Parse query string. */
-    for (unsigned i = 0; i < col_count; i++) {
-        col_name[i] = malloc(strlen(argv[i + 1]));
-        col_pattern[i] = malloc(strlen(argv[i + 1]));
-        eq = strchr(argv[i + 1], '=');
-        if (eq == NULL) {
-            errx(EXIT_FAILURE, "%s: Invalid match pattern.", argv[i + 1]);
-        }
-        len = eq - argv[i + 1];
-        memcpy(col_name[i], argv[i + 1], len);
-        col_name[i][len] = '\0';
-        len = strlen(argv[i + 1]) - len + 1;
-        memcpy(col_pattern[i], eq + 1, len);
-        col_pattern[i][len] = '\0';
+    /* Two predicate nodes per term: the comparison and an AND. */
+    pred = calloc(2 * term_count, sizeof(struct TMPRED));
+    if (pred == NULL) {
+        err(EXIT_FAILURE, "calloc");
     }
-    /* Construct match values. */
     tmstat_table_info(tmstat, table_name, &table_col, &table_col_count);
     if (table_col_count == 0) {
         errx(EXIT_FAILURE, "%s: No such table.", table_name);
     }
-    for (unsigned i = 0; i < col_count; i++) {
+    /* Parse query terms: COL=VALUE, COL!=VALUE, COL<VALUE, etc. */
+    for (unsigned i = 0; i < term_count; i++) {
+        len = strcspn(argv[i + 1], "=!<>");
+        pattern = &argv[i + 1][len];
+        if (strncmp(pattern, "!=", 2) == 0) {
+            op = TMSTAT_OP_NE;
+            pattern += 2;
+        } else if (strncmp(pattern, "<=", 2) == 0) {
+            op = TMSTAT_OP_LE;
+            pattern += 2;
+        } else if (strncmp(pattern, ">=", 2) == 0) {
+            op = TMSTAT_OP_GE;
+            pattern += 2;
+        } else if (*pattern == '=') {
+            op = TMSTAT_OP_EQ;
+            pattern += 1;
+        } else if (*pattern == '<') {
+            op = TMSTAT_OP_LT;
+            pattern += 1;
+        } else if (*pattern == '>') {
+            op = TMSTAT_OP_GT;
+            pattern += 1;
+        } else {
+            errx(EXIT_FAILURE, "%s: Invalid match pattern.", argv[i + 1]);
+        }
+        name = strndup(argv[i + 1], len);
+        if (name == NULL) {
+            err(EXIT_FAILURE, "strndup");
+        }
+        /* Construct match value. */
         for (unsigned j = 0; j < table_col_count; j++) {
-            if (strcmp(col_name[i], table_col[j].name) == 0) {
-                if (table_col[j].rule != TMSTAT_R_KEY) {
-                    errx(EXIT_FAILURE, "column %s: Not a key.", col_name[i]);
+            if (strcmp(name, table_col[j].name) == 0) {
+                if (rollup &&
+                    ((table_col[j].rule != TMSTAT_R_KEY) ||
+                     (op != TMSTAT_OP_EQ))) {
+                    errx(EXIT_FAILURE, "column %s: Not a key.", name);
                 }
-                col_value[i] = malloc(table_col[j].size);
-                if (col_value[i] == NULL) {
+                value = malloc(table_col[j].size);
+                if (value == NULL) {
                     err(EXIT_FAILURE, "malloc");
                 }
-                convert_pattern(col_value[i], &table_col[j], col_pattern[i]);
-                goto next_col;
+                convert_pattern(value, &table_col[j], pattern);
+                if ((table_col[j].rule == TMSTAT_R_KEY) &&
+                    (op == TMSTAT_OP_EQ)) {
+                    /* Key lookups go straight to tmstat_query. */
+                    col_name[col_count] = name;
+                    col_value[col_count] = value;
+                    col_count++;
+                } else {
+                    /* Anything else becomes part of the predicate. */
+                    pred[pred_count].op = op;
+                    pred[pred_count].name = name;
+                    pred[pred_count].value = value;
+                    if (where == NULL) {
+                        where = &pred[pred_count];
+                    } else {
+                        pred[pred_count + 1].op = TMSTAT_OP_AND;
+                        pred[pred_count + 1].left = where;
+                        pred[pred_count + 1].right = &pred[pred_count];
+                        where = &pred[pred_count + 1];
+                    }
+                    pred_count += 2;
+                }
+                goto next_term;
             }
         }
-        errx(EXIT_FAILURE, "%s: No such column.", col_name[i]);
-next_col: ;
+        errx(EXIT_FAILURE, "%s: No such column.", name);
+next_term: ;
     }
     /* Perform query. */
-    if (rollup) {
+    if (explain) {
+        char *text;
+        ret = tmstat_query_explain(tmstat, table_name, col_count, col_name,
+            &text);
+        if (ret != 0) {
+            err(EXIT_FAILURE, "tmstat_query_explain");
+        }
+        fputs(text, stdout);
+        if (where != NULL) {
+            printf("  other terms filter the rows found.\n");
+        }
+        free(text);
+        rows = NULL;
+        match_count = 0;
+        goto out;
+    } else if (rollup) {
         ret = tmstat_query_rollup(tmstat, table_name, col_count, col_name,
             col_value, &row);
         if ( (ret != 0) || (NULL == row) ) {
@@ -597,6 +857,27 @@ next_col: ;
         }
         rows[0] = row;
         match_count = 1;
+    } else if (unmerged) {
+        if (where != NULL) {
+            errx(EXIT_FAILURE, "--unmerged only supports COL=VALUE on keys.");
+        }
+        ret = tmstat_query_flags(tmstat, table_name, col_count, col_name,
+            col_value, TMSTAT_QUERY_UNMERGED, &rows, &match_count);
+        if (ret != 0) {
+            err(EXIT_FAILURE, "tmstat_query_flags");
+        }
+    } else if (sort_col != NULL) {
+        ret = tmstat_query_top(tmstat, table_name, col_count, col_name,
+            col_value, where, sort_col, top, &rows, &match_count);
+        if (ret != 0) {
+            err(EXIT_FAILURE, "tmstat_query_top %s", sort_col);
+        }
+    } else if (where != NULL) {
+        ret = tmstat_query_where(tmstat, table_name, col_count, col_name,
+            col_value, where, &rows, &match_count);
+        if (ret != 0) {
+            err(EXIT_FAILURE, "tmstat_query_where");
+        }
     } else {
         ret = tmstat_query(tmstat, table_name, col_count, col_name, col_value,
             &rows, &match_count);
@@ -611,7 +892,12 @@ next_col: ;
      * will be stale (that is, will point to freed memory).
      */
     tmstat_table_info(tmstat, table_name, &table_col, &table_col_count);
-    display(tmstat, rows, match_count, table_col, table_col_count, hide);
+    if (unmerged) {
+        display_labeled(rows, match_count, table_col, table_col_count);
+    } else {
+        display(tmstat, rows, match_count, table_col, table_col_count, hide);
+    }
+out:
     /* Free. */
     for (unsigned i = 0; i < match_count; i++) {
         tmstat_row_drop(rows[i]);
@@ -621,9 +907,13 @@ next_col: ;
         free(col_name[i]);
         free(col_value[i]);
     }
+    for (unsigned i = 0; i < pred_count; i += 2) {
+        free(pred[i].name);
+        free(pred[i].value);
+    }
     free(col_name);
-    free(col_pattern);
     free(col_value);
+    free(pred);
 }
 
 /*
@@ -721,6 +1011,11 @@ main(int argc, char * const argv[])
             expr = optarg;
             break;
 
+        case 'E':
+            /* -E, --explain: Describe how a query would run. */
+            explain = true;
+            break;
+
         case 'f':
             /* -f, --file=PATH: Read specific segment file. */
             free(file_path);
@@ -738,6 +1033,11 @@ main(int argc, char * const argv[])
             internal = true;
             break;
 
+        case 'J':
+            /* -J, --join=TABLE:COL[=COL][,...]: Join with another table. */
+            join_spec = optarg;
+            break;
+
         case 'm':
             /* m, --merge=PATH: Merge subscribed segments into one file. */
             free(merge_path);
@@ -749,6 +1049,39 @@ main(int argc, char * const argv[])
             rollup = true;
             break;
 
+        case 'S':
+            /* -S, --select=GLOB: Only subscribe to matching segments. */
+            select_glob = optarg;
+            break;
+
+        case 's':
+            /* -s, --sort=COL: Order rows by COL, largest first. */
+            sort_col = optarg;
+            break;
+
+        case 't': {
+            /* -t, --top=N: Display only the first N rows. */
+            unsigned long n;
+            char *end;
+
+            /* strtoul would take a sign, or wrap a negative count. */
+            errno = 0;
+            n = isdigit((unsigned char)optarg[0]) ?
+                strtoul(optarg, &end, 10) : 0;
+            if ((n == 0) || (errno != 0) || (*end != '\0') ||
+                (n > UINT_MAX)) {
+                errx(EXIT_FAILURE, "%s: Invalid row count.", optarg);
+            }
+            top = n;
+            top_given = true;
+            break;
+        }
+
+        case 'u':
+            /* -u, --unmerged: Show each segment's rows separately. */
+            unmerged = true;
+            break;
+
         case 'x':
             /* -x, --extract: Extract segments into directory. */
             free(extract_dir);
@@ -769,6 +1102,21 @@ end_options:
     argc -= optind;
     argv += optind;
 
+    if (top_given && (sort_col == NULL)) {
+        errx(EXIT_FAILURE, "--top requires --sort.");
+    }
+    if (rollup && (sort_col != NULL)) {
+        errx(EXIT_FAILURE, "--sort cannot be used with --rollup.");
+    }
+    if (unmerged && (rollup || (sort_col != NULL))) {
+        errx(EXIT_FAILURE, "--unmerged cannot be used with --rollup or "
+             "--sort.");
+    }
+
+    if ((select_glob != NULL) && (file_path != NULL)) {
+        errx(EXIT_FAILURE, "--select cannot be used with --file.");
+    }
+
     if (file_path != NULL) {
         if (!extract) {
             rc = tmstat_read(&tmstat, file_path);
@@ -787,7 +1135,7 @@ end_options:
     }
 
     if (tmstat == NULL) {
-        rc = tmstat_subscribe(&tmstat, directory);
+        rc = tmstat_subscribe_select(&tmstat, directory, select_glob);
         if (rc != 0) {
             /* Subscription failure; tmstat_subscribe sets errno. */
             err(EXIT_FAILURE, "tmstat_subscribe %s", directory);
@@ -829,7 +1177,13 @@ end_options:
         goto out;
     }
 
-    if (argc > 0) {
+    if ((join_spec != NULL) && (argc != 1)) {
+        errx(EXIT_FAILURE, "--join requires exactly one table.");
+    }
+    if (join_spec != NULL) {
+        /* Perform join. */
+        join(tmstat, argv[0], join_spec);
+    } else if (argc > 0) {
         /* Perform query. */
         query(tmstat, argc, argv, false);
     } else {
@@ -108,6 +108,24 @@ typedef struct __TMROW *TMROW;
 typedef struct TMROW *TMROW;
 #endif
 
+/**
+ * Query result set.
+ */
+#ifdef __cplusplus
+typedef struct __TMRESULT *TMRESULT;
+#else
+typedef struct TMRESULT *TMRESULT;
+#endif
+
+/**
+ * Prepared query.
+ */
+#ifdef __cplusplus
+typedef struct __TMQUERY *TMQUERY;
+#else
+typedef struct TMQUERY *TMQUERY;
+#endif
+
 /**
  * Parser context.
  */
@@ -165,6 +183,38 @@ enum tmstat_rule {
     TMSTAT_R_MAX        = 4,    //!< Select largest.
 };
 
+/**
+ * Predicate operators.
+ */
+enum tmstat_op {
+    TMSTAT_OP_EQ        = 0,    //!< Column equals value.
+    TMSTAT_OP_NE        = 1,    //!< Column differs from value.
+    TMSTAT_OP_LT        = 2,    //!< Column less than value.
+    TMSTAT_OP_LE        = 3,    //!< Column less than or equal to value.
+    TMSTAT_OP_GT        = 4,    //!< Column greater than value.
+    TMSTAT_OP_GE        = 5,    //!< Column greater than or equal to value.
+    TMSTAT_OP_AND       = 6,    //!< Both operands hold.
+    TMSTAT_OP_OR        = 7,    //!< Either operand holds.
+};
+
+/**
+ * Query flags, used by tmstat_query_flags.
+ */
+enum tmstat_query_flag {
+    TMSTAT_QUERY_UNMERGED = 1 << 0, //!< Return each child's rows unmerged.
+    TMSTAT_QUERY_CACHED   = 1 << 1, //!< Answer from a cached merged view.
+    TMSTAT_QUERY_VERIFY   = 1 << 2, //!< Check disjoint tables' promise.
+    TMSTAT_QUERY_LAZY     = 1 << 3, //!< Merge each column on first read.
+};
+
+/**
+ * Table flags, used by tmstat_table_register_flags.
+ */
+enum tmstat_table_flag {
+    TMSTAT_TABLE_DISJOINT = 1 << 0, //!< No two rows ever share a key.
+    TMSTAT_TABLE_ROLLUP   = 1 << 1, //!< Keep a table-wide aggregate.
+};
+
 enum tmstat_merge { 
     TMSTAT_MERGE_PUBLIC = 0,    //!< Merge only public tables
     TMSTAT_MERGE_ALL    = 1,    //!< Include internal tables
@@ -327,6 +377,21 @@ int tmstat_create(TMSTAT *stat, char *name);
  */
 int tmstat_publish(TMSTAT stat, char *directory);
 
+/**
+ * Announce that a segment's rows have been updated.
+ *
+ * Readers querying with TMSTAT_QUERY_CACHED re-merge a publisher's rows
+ * only when its commit count has moved, so a publisher that wants to be
+ * seen by them should call this after each batch of updates.  Creating,
+ * preserving and removing rows move the count too, but values changed
+ * since the last commit may or may not be seen by such readers.  A
+ * publisher that has never moved its count is rescanned on every query.
+ *
+ * @param[in]   stat        Segment made with tmstat_create.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_commit(TMSTAT stat);
+
 /**
  * Destroy segment.
  *
@@ -394,6 +459,36 @@ int tmstat_union(TMSTAT *stat, TMSTAT *children, unsigned count);
  */
 int tmstat_subscribe(TMSTAT *stat, char *directory);
 
+/**
+ * Subscribe to the segments in directory whose names match pattern.
+ *
+ * Like tmstat_subscribe, but files whose names do not match the
+ * fnmatch(3) pattern (e.g. "tmm*") are never opened, so queries only
+ * visit the selected publishers.  Segment files are named after the
+ * segment, which is also the name in its .label table.  The pattern is
+ * kept and reapplied whenever the handle is refreshed.
+ *
+ * @param[out]  stat        New union handle.
+ * @param[in]   directory   Directory name.
+ * @param[in]   pattern     Segment name pattern, or NULL for all.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_subscribe_select(TMSTAT *stat, char *directory,
+        const char *pattern);
+
+/**
+ * Change the segment name pattern of a subscription.
+ *
+ * The directory is reread immediately with the new pattern.  This fails
+ * with EINVAL if stat is not a subscription, and with EBUSY while rows
+ * from stat are still referenced.  On failure, stat is unchanged.
+ *
+ * @param[in]   stat        Subscription handle.
+ * @param[in]   pattern     Segment name pattern, or NULL for all.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_select(TMSTAT stat, const char *pattern);
+
 /**
  * Extract tmstat segments from a specific file.
  *
@@ -485,6 +580,39 @@ void tmstat_refresh(TMSTAT stat, int force);
 int tmstat_table_register(TMSTAT stat, TMTABLE *table, char *name,
         struct TMCOL *cols, unsigned count, unsigned rowsz);
 
+/**
+ * Register table, as modified by flags.
+ *
+ * With no flags, this is tmstat_table_register.  TMSTAT_TABLE_DISJOINT
+ * promises that no two rows of the table, in this segment or in any
+ * other publishing it, share a key; typically because the key includes
+ * the publisher's identity and the publisher keeps a single row per
+ * key.  Such rows are never merged: queries return them as they lie in
+ * each segment, and unions simply put the children's rows together.
+ * A union's table is disjoint only if every child's table is.  Use
+ * TMSTAT_QUERY_VERIFY to check the promise.
+ *
+ * TMSTAT_TABLE_ROLLUP keeps a single aggregate row, merged from every
+ * row of the table by its columns' rules, in a companion table named
+ * ".rollup/<name>"; its extra "rollup.rows" column counts the rows
+ * merged.  tmstat_commit refreshes it.  A rollup of the whole table
+ * over a union then merges one aggregate per child instead of every
+ * row; each child's share is as of its latest tmstat_commit, so
+ * publishers using this flag should commit after each batch of updates.
+ * A child whose aggregate counts no rows is scanned instead.
+ *
+ * @param[in]   stat        Segment to store table in.
+ * @param[out]  table       New table handle.
+ * @param[in]   name        Table name.
+ * @param[in]   cols        Column descriptors.
+ * @param[in]   count       Total descriptors in cols.
+ * @param[in]   rowsz       Size in bytes of a row.
+ * @param[in]   flags       Bitwise OR of enum tmstat_table_flag.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_table_register_flags(TMSTAT stat, TMTABLE *table, char *name,
+        struct TMCOL *cols, unsigned count, unsigned rowsz, unsigned flags);
+
 /**
  * Obtain the column metadata for a table.
  *
@@ -620,7 +748,9 @@ int tmstat_row_field(TMROW row, char *name, void *p);
  *
  * Returns an unsigned representation of the named field's value, or 0 if
  * either the field's type is not representable as a number or does not
- * exist.
+ * exist.  A field of a lazily merged row that fails to merge also reads
+ * as 0.  To tell these from a true 0, clear errno first: it is set to
+ * ENOENT if the field does not exist, or by the merge if that fails.
  *
  * @param[in]   row         Row handle.
  * @param[in]   name        Field name.
@@ -633,7 +763,9 @@ signed long long tmstat_row_field_signed(TMROW row, char *name);
  *
  * Returns an unsigned representation of the named field's value, or 0 if
  * either the field's type is not representable as a number or does not
- * exist.
+ * exist.  A field of a lazily merged row that fails to merge also reads
+ * as 0.  To tell these from a true 0, clear errno first: it is set to
+ * ENOENT if the field does not exist, or by the merge if that fails.
  *
  * @param[in]   row         Row handle.
  * @param[in]   name        Field name.
@@ -657,6 +789,15 @@ void tmstat_row_info(TMROW row, struct TMCOL **cols, unsigned *col_count);
  */
 const char *tmstat_row_table(TMROW row);
 
+/**
+ * Obtain the label of the segment from which a row came; for rows
+ * returned with TMSTAT_QUERY_UNMERGED, this names the publisher.  The
+ * label stays valid while the row is held.
+ * @param[in]   row         Associated row.
+ * @return segment label.
+ */
+const char *tmstat_row_label(TMROW row);
+
 /**
  * Locate rows by column values.
  *
@@ -687,6 +828,384 @@ int tmstat_query(TMSTAT stat, char *table_name,
         unsigned col_count, char **col_names, void **col_values,
         TMROW **row_handles, unsigned *match_count);
 
+/**
+ * Locate rows by column values, as modified by flags.
+ *
+ * With no flags, this is tmstat_query.  TMSTAT_QUERY_UNMERGED skips the
+ * merge of rows sharing a key, returning each child segment's matching
+ * rows as they are, so per-publisher values can be told apart with
+ * tmstat_row_label.  As with tmstat_query, row_handles may be NULL to
+ * just count the rows.
+ *
+ * TMSTAT_QUERY_CACHED keeps the merged table on the union or
+ * subscription handle and, on later queries, re-merges only the
+ * children whose tmstat_commit count has moved: sums are brought up to
+ * date by taking out a child's old rows and adding its new ones, while
+ * keys under any other rule are merged afresh from every child.  Views
+ * are dropped whenever the handle is refreshed onto a new set of
+ * children.  It cannot be combined with TMSTAT_QUERY_UNMERGED, and has
+ * no effect on a segment made with tmstat_create.
+ *
+ * TMSTAT_QUERY_VERIFY first checks that no two matching rows of a table
+ * registered with TMSTAT_TABLE_DISJOINT share a key, failing with
+ * EEXIST if they do.  It costs an extra pass, so is meant for debugging.
+ *
+ * TMSTAT_QUERY_LAZY groups rows by key but leaves merging each column
+ * until it is first read through tmstat_row_field or its relatives, so
+ * that a caller wanting a few columns of a wide table does not pay for
+ * the rest.  A column reflects its sources as of that first read; a
+ * source row its publisher has since removed is left out of it.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_names   Column names to key upon.
+ * @param[in]   col_values  Column values to match.
+ * @param[in]   flags       Bitwise OR of enum tmstat_query_flag.
+ * @param[out]  row_handles Array containing result rows.
+ * @param[out]  match_count Number of result rows.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_query_flags(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        unsigned flags, TMROW **row_handles, unsigned *match_count);
+
+/**
+ * Locate rows by column values within a time budget.
+ *
+ * This is tmstat_query with a bound on how long it may take.  The
+ * children of a union are searched in a fixed order, and once the
+ * budget (which includes refreshing stat) is spent no further children
+ * are started; the rows found so far are merged and returned as usual.
+ * The children searched are always the first covered of child_count, so
+ * the result is complete exactly when covered equals child_count.  A
+ * segment which is not a union counts as its only child.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_names   Column names to key upon.
+ * @param[in]   col_values  Column values to match.
+ * @param[in]   budget_ms   Time budget, in milliseconds.
+ * @param[out]  row_handles Array containing result rows.
+ * @param[out]  match_count Number of result rows.
+ * @param[out]  covered     Number of children searched.
+ * @param[out]  child_count Number of children in stat.
+ * @return 0 on success (even if partial), -1 on failure.
+ */
+int tmstat_query_deadline(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        unsigned budget_ms, TMROW **row_handles, unsigned *match_count,
+        unsigned *covered, unsigned *child_count);
+
+/**
+ * Row visitor, called by tmstat_query_visit for each matching row.
+ *
+ * The row pointer refers either directly to segment memory or to a
+ * scratch buffer holding a merged row; in either case it is valid only
+ * until the visitor returns.
+ *
+ * @param[in]   arg         Caller context.
+ * @param[in]   row         Row data.
+ * @param[in]   cols        Column descriptors for row.
+ * @param[in]   col_count   Number of column descriptors.
+ * @return 0 to continue, any other value to stop.
+ */
+typedef int (*tmstat_visit_fn)(void *arg, const void *row,
+        struct TMCOL *cols, unsigned col_count);
+
+/**
+ * Visit rows by column values.
+ *
+ * Like tmstat_query, but instead of allocating a handle for each matching
+ * row, visit is called with a pointer to each row's data.  Rows that need
+ * merging are merged into a single reusable buffer and visited in key
+ * order.  No per-row allocation is performed.
+ *
+ * The segment is not refreshed while the visitor runs.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_names   Column names to key upon.
+ * @param[in]   col_values  Column values to match.
+ * @param[in]   visit       Function to call for each row.
+ * @param[in]   arg         Context passed to visit.
+ * @return 0 on success, -1 on failure, or the value with which visit
+ * stopped the walk.
+ */
+int tmstat_query_visit(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        tmstat_visit_fn visit, void *arg);
+
+/**
+ * Count rows by column values.
+ *
+ * Equivalent to tmstat_query with a NULL row_handles, but neither row
+ * handles nor merged rows are built.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_names   Column names to key upon.
+ * @param[in]   col_values  Column values to match.
+ * @param[out]  match_count Number of matching rows.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_query_count(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        unsigned *match_count);
+
+/**
+ * Locate rows by many keys at once.
+ *
+ * Equivalent to calling tmstat_query once per key, but every table is
+ * scanned only once: keys are looked up by hash, or merge-joined against
+ * tables that are sorted.  col_names must name every TMSTAT_R_KEY column
+ * of the table and nothing else.
+ *
+ * The values for key i are col_values[i * col_count] through
+ * col_values[i * col_count + col_count - 1].  row_handles must have
+ * room for key_count rows; on return, row_handles[i] is the (merged) row
+ * for key i, or NULL if there is none.  You must tmstat_row_drop each
+ * non-NULL row returned.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of key columns.
+ * @param[in]   col_names   Key column names.
+ * @param[in]   col_values  Key values, col_count per key.
+ * @param[in]   key_count   Number of keys.
+ * @param[out]  row_handles Result rows, aligned with the keys.
+ * @param[out]  match_count Number of keys found.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_query_batch(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        unsigned key_count, TMROW *row_handles, unsigned *match_count);
+
+/**
+ * Prepare a query for repeated execution.
+ *
+ * Table and column lookups, key layout checks, and the choice between a
+ * sorted binary search and a linear scan are done once here rather than
+ * on every tmstat_query.  The prepared query notices when tables are
+ * registered or a subscription is refreshed and resolves itself again
+ * on its next execution, so it stays valid for the life of the segment.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_names   Column names to key upon.
+ * @param[out]  query       Prepared query.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_query_prepare(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, TMQUERY *query);
+
+/**
+ * Execute a prepared query; results are as with tmstat_query, including
+ * a count-only result when row_handles is NULL.
+ *
+ * @param[in]   query       Prepared query.
+ * @param[in]   col_values  Column values to match.
+ * @param[out]  row_handles Array containing result rows.
+ * @param[out]  match_count Number of result rows.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_query_exec(TMQUERY query, void **col_values,
+        TMROW **row_handles, unsigned *match_count);
+
+/**
+ * Execute a prepared query, visiting rows as tmstat_query_visit does.
+ *
+ * @param[in]   query       Prepared query.
+ * @param[in]   col_values  Column values to match.
+ * @param[in]   visit       Callback for each result row.
+ * @param[in]   arg         Callback context.
+ * @return 0 on success, -1 on failure, or the visitor's stop value.
+ */
+int tmstat_query_exec_visit(TMQUERY query, void **col_values,
+        tmstat_visit_fn visit, void *arg);
+
+/**
+ * Free a prepared query.
+ *
+ * @param[in]   query       Prepared query.
+ */
+void tmstat_query_free(TMQUERY query);
+
+/**
+ * Describe how a query would find its rows.
+ *
+ * The text names each table the query would search, with its row and
+ * slab counts and the access path chosen for it: a binary search on the
+ * full key or a key prefix (for sorted tables), or a scan of every
+ * slab.  The caller must free the text.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_names   Column names to key upon.
+ * @param[out]  text        Description, one line per table.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_query_explain(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, char **text);
+
+/**
+ * Row predicate, used by tmstat_query_where.
+ *
+ * Comparison nodes name a column and point to a value laid out like that
+ * column (as with tmstat_query's col_values); columns are compared by
+ * type, as keys are.  AND and OR nodes combine their two operands.
+ * A range is the AND of two comparisons.
+ */
+struct TMPRED {
+    enum tmstat_op      op;             //!< Operator.
+    char                *name;          //!< Column name (comparisons).
+    void                *value;         //!< Column value (comparisons).
+    struct TMPRED       *left;          //!< First operand (AND, OR).
+    struct TMPRED       *right;         //!< Second operand (AND, OR).
+};
+
+/**
+ * Locate rows by column values and a predicate.
+ *
+ * Like tmstat_query, but rows must also satisfy pred, which may refer to
+ * any column.  Terms over key columns are evaluated during the scan;
+ * terms over merged (SUM, MIN, MAX, OR) columns are evaluated on the
+ * merged rows.  Only rows that qualify are returned.
+ *
+ * As with tmstat_query, row_handles may be NULL to obtain only the count.
+ * Otherwise you must tmstat_row_drop each of the rows returned.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_names   Column names to key upon.
+ * @param[in]   col_values  Column values to match.
+ * @param[in]   pred        Predicate, or NULL for none.
+ * @param[out]  row_handles Array containing result rows.
+ * @param[out]  match_count Number of matching rows.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_query_where(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        struct TMPRED *pred, TMROW **row_handles, unsigned *match_count);
+
+/**
+ * Locate the k rows with the largest values in a numeric column.
+ *
+ * Rows are selected as with tmstat_query_where (pred may be NULL) and
+ * merged by key before they are ranked, so the ranking is over whole
+ * keys rather than individual contributions.  Only the best k rows are
+ * kept while scanning; row_handles receives them, largest first, and
+ * must be freed as with tmstat_query.  Ties keep the row seen first.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_names   Column names to key upon.
+ * @param[in]   col_values  Column values to match.
+ * @param[in]   pred        Row predicate, or NULL.
+ * @param[in]   sort_name   Numeric column to rank rows by.
+ * @param[in]   k           Most rows to return.
+ * @param[out]  row_handles Array containing result rows.
+ * @param[out]  match_count Number of result rows.
+ * @return 0 on success, -1 on failure (ENOENT if there is no such sort
+ *         column, EINVAL if it is not numeric).
+ */
+int tmstat_query_top(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        struct TMPRED *pred, char *sort_name, unsigned k,
+        TMROW **row_handles, unsigned *match_count);
+
+/**
+ * Column projection, used by tmstat_query_project.
+ */
+struct TMPROJ {
+    char                *name;          //!< Column name.
+    unsigned            size;           //!< Output element size (0: column's).
+    void                *out;           //!< Output array.
+};
+
+/**
+ * Locate rows by column values and project columns into arrays.
+ *
+ * For each (merged) matching row, the named columns are written to
+ * consecutive elements of the corresponding output arrays, yielding a
+ * struct-of-arrays layout.  Integer columns are sign- or zero-extended to
+ * the requested element size, which must be 1, 2, 4 or 8 bytes; other
+ * columns are copied and zero-padded.  Narrowing is not permitted.
+ *
+ * At most capacity rows are written; row_count reports all matches, so a
+ * caller seeing row_count > capacity may retry with larger arrays.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_names   Column names to key upon.
+ * @param[in]   col_values  Column values to match.
+ * @param[in]   proj        Projections; a zero size stands for the
+ *                          column's own size.
+ * @param[in]   proj_count  Number of projections.
+ * @param[in]   capacity    Number of elements in each output array.
+ * @param[out]  row_count   Number of matching rows.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_query_project(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        struct TMPROJ *proj, unsigned proj_count,
+        unsigned capacity, unsigned *row_count);
+
+/**
+ * Locate rows by column values, returning a result set.
+ *
+ * Like tmstat_query, but the matching (merged) rows are copied into a
+ * result set whose handles and data are allocated in bulk and released
+ * together by tmstat_result_free.  The rows need not be dropped, and
+ * must not be used once the result set is freed.  Result rows are a
+ * snapshot taken at query time, so the segment may be refreshed while
+ * a result set exists.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_names   Column names to key upon.
+ * @param[in]   col_values  Column values to match.
+ * @param[out]  result      Result set.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_query_result(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        TMRESULT *result);
+
+/**
+ * Obtain the number of rows in a result set.
+ *
+ * @param[in]   result      Result set.
+ * @return number of rows.
+ */
+unsigned tmstat_result_count(TMRESULT result);
+
+/**
+ * Obtain a row from a result set.  The handle remains valid until the
+ * result set is freed; dropping it is permitted but not necessary.
+ *
+ * @param[in]   result      Result set.
+ * @param[in]   i           Row index.
+ * @return row handle, or NULL if i is out of range.
+ */
+TMROW tmstat_result_row(TMRESULT result, unsigned i);
+
+/**
+ * Free a result set and all of its rows.
+ *
+ * @param[in]   result      Result set to free.
+ */
+void tmstat_result_free(TMRESULT result);
+
 /**
  * Locate rows by column values and perform rollup (merge).
  *
@@ -714,6 +1233,117 @@ int tmstat_query_rollup(TMSTAT stat, char *table_name,
         unsigned col_count, char **col_names, void **col_values,
         TMROW *row_handle);
 
+/**
+ * Locate rows by column values and roll them up into a buffer.
+ *
+ * This is tmstat_query_rollup without the row: the merged values are
+ * written straight into data, which must hold at least a row of the
+ * table (see tmstat_table_row_size).  Nothing is allocated, so this is
+ * the cheapest way to poll a table's totals.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_names   Column names to key upon.
+ * @param[in]   col_values  Column values to match.
+ * @param[out]  data        Buffer for the rolled up row.
+ * @param[in]   size        Size in bytes of data.
+ * @return 0 on success, -1 on failure (ENOENT if no rows matched).
+ */
+int tmstat_query_rollup_data(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        void *data, unsigned size);
+
+/**
+ * Locate rows by column values and roll them up by group.
+ *
+ * This sits between tmstat_query, which merges rows sharing the full
+ * key, and tmstat_query_rollup, which merges every row: rows that agree
+ * on the group columns are merged into one row using each column's
+ * rule, in a single pass over every child.  Group columns must be key
+ * columns (TMSTAT_R_KEY); the other key columns are zero in the result.
+ * With no group columns, every matching row lands in one group.
+ *
+ * Result rows are ordered by the group columns and must be freed as
+ * with tmstat_query.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   table_name  Table name to search for.
+ * @param[in]   col_count   Number of columns to key on.
+ * @param[in]   col_names   Column names to key upon.
+ * @param[in]   col_values  Column values to match.
+ * @param[in]   group_count Number of group columns.
+ * @param[in]   group_names Key columns to group by.
+ * @param[out]  row_handles Array containing one row per group.
+ * @param[out]  match_count Number of groups.
+ * @return 0 on success, -1 on failure (ENOENT if a group column does
+ *         not exist, EINVAL if it is not a key).
+ */
+int tmstat_query_group(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        unsigned group_count, char **group_names,
+        TMROW **row_handles, unsigned *match_count);
+
+/**
+ * Callback for each joined pair of rows.
+ *
+ * @param[in]   arg         Caller's context.
+ * @param[in]   left        Left table row data.
+ * @param[in]   right       Right table row data.
+ * @param[in]   left_cols   Left table column descriptors.
+ * @param[in]   left_col_count Number of left table columns.
+ * @param[in]   right_cols  Right table column descriptors.
+ * @param[in]   right_col_count Number of right table columns.
+ * @return 0 to continue, nonzero to stop.
+ */
+typedef int (*tmstat_join_fn)(void *arg, const void *left,
+        const void *right, struct TMCOL *left_cols, unsigned left_col_count,
+        struct TMCOL *right_cols, unsigned right_col_count);
+
+/**
+ * Join the merged rows of two tables on shared column values.
+ *
+ * Each table's rows are merged by key as with tmstat_query; then every
+ * pair whose join columns hold equal values is handed to fn.  The join
+ * columns are named pairwise (left_cols[i] matches right_cols[i]) and
+ * must have the same type and size.  The table with fewer rows is
+ * copied into a hash table, and the other is walked past it as by
+ * tmstat_query_visit.  That walk still gathers and sorts pointers to
+ * the larger side's rows to merge them, but never copies the rows.  Row
+ * data is only valid for the duration of the callback.
+ *
+ * @param[in]   stat        Segment to search.
+ * @param[in]   left_name   Left table name.
+ * @param[in]   right_name  Right table name.
+ * @param[in]   col_count   Number of join columns.
+ * @param[in]   left_cols   Join column names in the left table.
+ * @param[in]   right_cols  Join column names in the right table.
+ * @param[in]   fn          Callback for each joined pair.
+ * @param[in]   arg         Callback context.
+ * @return 0 on success, -1 on failure (ENOENT if a join column does not
+ *         exist, EINVAL if a pair of join columns differ in type or size),
+ *         or the callback's nonzero return value if it stopped the join.
+ */
+int tmstat_query_join(TMSTAT stat, char *left_name, char *right_name,
+        unsigned col_count, char **left_cols, char **right_cols,
+        tmstat_join_fn fn, void *arg);
+
+/**
+ * Set the number of threads used to scan large tables.
+ *
+ * With more than one thread, rollups over tables spanning many slabs
+ * split the slabs among a pool of worker threads (the caller counts as
+ * one), roll up each share, and combine the partial rows with the
+ * table's merge rules.  The default, 1, scans on the calling thread
+ * only.  The pool is owned by the segment and freed with it; the
+ * segment itself still must not be used from several threads at once.
+ *
+ * @param[in]   stat        Segment.
+ * @param[in]   threads     Total number of threads.
+ * @return 0 on success, -1 on failure.
+ */
+int tmstat_set_threads(TMSTAT stat, unsigned threads);
+
 
 /**
  * Merge all tables into one segment file.
@@ -55,6 +55,13 @@ tmstat_publish(TMSTAT stat, char *directory)
     return -1;
 }
 
+int
+tmstat_commit(TMSTAT stat)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
 void
 tmstat_destroy(TMSTAT stat)
 {
@@ -88,6 +95,20 @@ tmstat_subscribe(TMSTAT *stat, char *directory)
     return -1;
 }
 
+int
+tmstat_subscribe_select(TMSTAT *stat, char *directory, const char *pattern)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_select(TMSTAT stat, const char *pattern)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
 int
 tmstat_read(TMSTAT *stat, char *path)
 {
@@ -109,6 +130,14 @@ tmstat_table_register(TMSTAT stat, TMTABLE *table, char *name,
     return -1;
 }
 
+int
+tmstat_table_register_flags(TMSTAT stat, TMTABLE *table, char *name,
+        struct TMCOL *cols, unsigned count, unsigned rowsz, unsigned flags)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
 void
 tmstat_table_info(TMSTAT stat, char *table_name,
         struct TMCOL **cols, unsigned *col_count)
@@ -197,6 +226,13 @@ tmstat_row_table(TMROW row)
     return NULL;
 }
 
+const char *
+tmstat_row_label(TMROW row)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
 int
 tmstat_query(TMSTAT stat, char *table_name,
         unsigned col_count, char **col_names, void **col_values,
@@ -206,6 +242,148 @@ tmstat_query(TMSTAT stat, char *table_name,
     return -1;
 }
 
+int
+tmstat_query_flags(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        unsigned flags, TMROW **row_handles, unsigned *match_count)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_deadline(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        unsigned budget_ms, TMROW **row_handles, unsigned *match_count,
+        unsigned *covered, unsigned *child_count)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_visit(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        tmstat_visit_fn visit, void *arg)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_count(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        unsigned *match_count)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_batch(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        unsigned key_count, TMROW *row_handles, unsigned *match_count)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_prepare(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, TMQUERY *query)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_exec(TMQUERY query, void **col_values,
+        TMROW **row_handles, unsigned *match_count)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_exec_visit(TMQUERY query, void **col_values,
+        tmstat_visit_fn visit, void *arg)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+void
+tmstat_query_free(TMQUERY query)
+{
+    errno = ENOSYS;
+}
+
+int
+tmstat_query_explain(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, char **text)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_where(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        struct TMPRED *pred, TMROW **row_handles, unsigned *match_count)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_top(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        struct TMPRED *pred, char *sort_name, unsigned k,
+        TMROW **row_handles, unsigned *match_count)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_project(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        struct TMPROJ *proj, unsigned proj_count,
+        unsigned capacity, unsigned *row_count)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_result(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        TMRESULT *result)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+unsigned
+tmstat_result_count(TMRESULT result)
+{
+    errno = ENOSYS;
+    return 0;
+}
+
+TMROW
+tmstat_result_row(TMRESULT result, unsigned i)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+void
+tmstat_result_free(TMRESULT result)
+{
+    errno = ENOSYS;
+}
+
 int
 tmstat_query_rollup(TMSTAT stat, char *table_name,
         unsigned col_count, char **col_names, void **col_values,
@@ -215,6 +393,41 @@ tmstat_query_rollup(TMSTAT stat, char *table_name,
     return -1;
 }
 
+int
+tmstat_query_rollup_data(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        void *data, unsigned size)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_group(TMSTAT stat, char *table_name,
+        unsigned col_count, char **col_names, void **col_values,
+        unsigned group_count, char **group_names,
+        TMROW **row_handles, unsigned *match_count)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_query_join(TMSTAT stat, char *left_name, char *right_name,
+        unsigned col_count, char **left_cols, char **right_cols,
+        tmstat_join_fn fn, void *arg)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+tmstat_set_threads(TMSTAT stat, unsigned threads)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
 int
 tmstat_merge(TMSTAT stat, char *path, enum tmstat_merge merge)
 {
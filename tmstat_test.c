@@ -103,6 +103,26 @@ static const char usage_str[] =
    "              cmod          (Sort of) concurrent read/write test.\n"
    "              rollup        Test rollup queries.\n"
    "              insn          Test by-n row creation.\n"
+   "              visit         Test cursor-style queries.\n"
+   "              result        Test query result sets.\n"
+   "              project       Test projected queries.\n"
+   "              where         Test filtered queries.\n"
+   "              batch         Test batched key lookups.\n"
+   "              prepare       Test prepared queries.\n"
+   "              parallel      Test parallel rollups.\n"
+   "              explain       Test the query planner.\n"
+   "              top           Test top-K queries.\n"
+   "              group         Test group-by queries.\n"
+   "              join          Test joined queries.\n"
+   "              unmerged      Test unmerged queries.\n"
+   "              select        Test selected subscriptions.\n"
+   "              deadline      Test queries with a deadline.\n"
+   "              wide          Test vector merges of wide rows.\n"
+   "              disjoint      Test disjoint tables.\n"
+   "              cached        Test cached merged views.\n"
+   "              lazy          Test lazily merged queries.\n"
+   "              rollup-maintained\n"
+   "                            Test publisher-maintained rollups.\n"
    "   -v, --verbose            Be verbose.\n"
    "\n"
    "For --merge-test, the argument should be like this example:\n"
@@ -584,6 +604,33 @@ test_merge(void)
         free_count++;
     }
     free(sub_row);
+    /* A parallel merge returns the same rows, in the same order. */
+    {
+        TMROW *par_row;
+        unsigned par_rows;
+
+        ret = tmstat_query(sub_stat, "test", 0, NULL, NULL, &sub_row, &rows);
+        assert(ret == 0);
+        ret = tmstat_set_threads(sub_stat, 4);
+        assert(ret == 0);
+        ret = tmstat_query(sub_stat, "test", 0, NULL, NULL,
+                           &par_row, &par_rows);
+        assert(ret == 0);
+        ret = tmstat_set_threads(sub_stat, 1);
+        assert(ret == 0);
+        assert(par_rows == rows);
+        for (unsigned i = 0; i < rows; i++) {
+            struct row *q;
+
+            tmstat_row_field(sub_row[i], NULL, &p);
+            tmstat_row_field(par_row[i], NULL, &q);
+            assert(memcmp(p, q, sizeof(*p)) == 0);
+            tmstat_row_drop(sub_row[i]);
+            tmstat_row_drop(par_row[i]);
+        }
+        free(sub_row);
+        free(par_row);
+    }
     /* Merge out to new segment */
     printf(" output merged segment;");
     tmstat_merge(sub_stat, "test_merged", TMSTAT_MERGE_ALL);
@@ -615,7 +662,94 @@ test_merge(void)
         tmstat_row_drop(*sub_row);
         free(sub_row);
     }
+    /* Merging an already-sorted segment keeps every row as it was. */
+    ret = tmstat_merge(merge_stat, "test_merged2", TMSTAT_MERGE_ALL);
+    assert(ret == 0);
+    tmstat_destroy(merge_stat);
+    snprintf(filename, sizeof(filename), "%s/private/test_merged2",
+             tmstat_path);
+    assert(tmstat_read(&merge_stat, filename) == 0);
+    assert(tmstat_is_table_sorted(merge_stat, "test") == true);
+    ret = tmstat_query(merge_stat, "test", 0, NULL, NULL, &sub_row, &rows);
+    assert(ret == 0);
+    assert(rows == SIZE);
+    for (unsigned i = 0; i < rows; i++) {
+        tmstat_row_field(sub_row[i], NULL, &p);
+        assert(p->key == i);
+        assert(p->sum == SMALL_SIZE);
+        assert(p->min == 1);
+        assert(p->max == ((SMALL_SIZE - 1) << 8) + 1);
+        assert(p->or == 0xffffffff);
+        tmstat_row_drop(sub_row[i]);
+    }
+    free(sub_row);
     tmstat_destroy(merge_stat);
+
+    /* Merged files come out sorted by signed keys, too. */
+    {
+        const int K = 3000;
+        struct skey_row {
+            signed      k;
+            unsigned    v;
+        } *sk;
+        static struct TMCOL skey_cols[] = {
+            TMCOL_INT(struct skey_row, k),
+            TMCOL_UINT(struct skey_row, v, .rule = TMSTAT_R_SUM),
+        };
+        char *skey_names[] = { "k" };
+        TMSTAT stat_k, stat_m;
+        TMROW sk_row;
+        char *text;
+
+        ret = tmstat_create(&stat_k, "skey");
+        assert(ret == 0);
+        ret = tmstat_table_register(stat_k, &table, "skey", skey_cols,
+                                    array_count(skey_cols),
+                                    sizeof(struct skey_row));
+        assert(ret == 0);
+        /* Each key twice, in scrambled order, enough to share out. */
+        for (int i = 0; i < 2 * K; ++i) {
+            ret = tmstat_row_create(stat_k, table, &sk_row);
+            assert(ret == 0);
+            tmstat_row_field(sk_row, NULL, &sk);
+            sk->k = (i * 7919) % K - K / 2;
+            sk->v = 1;
+            tmstat_row_preserve(sk_row);
+            tmstat_row_drop(sk_row);
+        }
+        ret = tmstat_set_threads(stat_k, 4);
+        assert(ret == 0);
+        snprintf(filename, sizeof(filename), "%s/%s/skey_merged", tmstat_path,
+                 TMSTAT_DIR_PRIVATE);
+        ret = tmstat_merge(stat_k, filename, TMSTAT_MERGE_PUBLIC);
+        assert(ret == 0);
+        ret = tmstat_read(&stat_m, filename);
+        assert(ret == 0);
+        assert(tmstat_is_table_sorted(stat_m, "skey"));
+        ret = tmstat_query_explain(stat_m, "skey", 1, skey_names, &text);
+        assert(ret == 0);
+        assert(strstr(text, "binary search on full key") != NULL);
+        free(text);
+        ret = tmstat_query(stat_m, "skey", 0, NULL, NULL, NULL, &rows);
+        assert(ret == 0);
+        assert(rows == K);
+        for (int k = -K / 2; k < K - K / 2; ++k) {
+            void *kv[] = { &k };
+
+            /* Binary search finds every key only if the order is right. */
+            ret = tmstat_query(stat_m, "skey", 1, skey_names, kv, &sub_row,
+                               &rows);
+            assert(ret == 0);
+            assert(rows == 1);
+            tmstat_row_field(sub_row[0], NULL, &sk);
+            assert(sk->k == k);
+            assert(sk->v == 2);
+            tmstat_row_drop(sub_row[0]);
+            free(sub_row);
+        }
+        tmstat_destroy(stat_m);
+        tmstat_destroy(stat_k);
+    }
     printf("Done: %d allocs, %d frees, %d queries, %d matches.\n",
         alloc_count, free_count, search_count, match_count);
     free(row);
@@ -2704,6 +2838,26 @@ test_one(TMSTAT stat, unsigned N, unsigned n, unsigned c, unsigned z)
     assert(r->c == (z > 0) ? N : n);
     tmstat_row_drop(row);
 
+    /* Rolling up into a buffer gives the same totals. */
+    {
+        struct foo_row buf;
+
+        ret = tmstat_query_rollup_data(stat, "foo", 0, NULL, NULL,
+                                       &buf, sizeof(buf));
+        assert(ret == 0);
+        assert(buf.a == sum);
+        assert(buf.b == 1);
+        ret = tmstat_query_rollup_data(stat, "foo", 0, NULL, NULL,
+                                       &buf, sizeof(buf) - 1);
+        assert(ret == -1);
+        assert(errno == EINVAL);
+        strncpy(value, "ldfhasadfkjgha", sizeof(value));
+        ret = tmstat_query_rollup_data(stat, "foo", 1, names,
+                                       (void **)values, &buf, sizeof(buf));
+        assert(ret == -1);
+        assert(errno == ENOENT);
+    }
+
     for (unsigned i = 1; i <= n; ++i) {
         snprintf(value, sizeof(value), "row%u", i);
         ret = tmstat_query_rollup(
@@ -2887,6 +3041,1808 @@ test_rollup(void)
     return EXIT_SUCCESS;
 }
 
+struct visit_ctx {
+    unsigned    count;          // Rows visited.
+    unsigned    weight;         // Rows merged into each visited row.
+    unsigned    stop;           // Stop after this many rows, if nonzero.
+};
+
+static int
+visit_foo(void *arg, const void *row, struct TMCOL *cols, unsigned col_count)
+{
+    struct visit_ctx *ctx = arg;
+    const struct foo_row *r = row;
+    unsigned i;
+
+    assert(col_count == array_count(foo_cols));
+    assert(strcmp(cols[0].name, "text") == 0);
+    assert(sscanf(r->text, "row%u", &i) == 1);
+    assert(r->a == i * ctx->weight);
+    assert(r->b == i);
+    assert(r->c == i);
+    ctx->count++;
+    return (ctx->count == ctx->stop) ? 42 : 0;
+}
+
+/*
+ * Join callback for test_join: count pairs, checking they match.
+ */
+static int
+join_pair(void *arg, const void *left, const void *right,
+          struct TMCOL *left_cols, unsigned left_col_count,
+          struct TMCOL *right_cols, unsigned right_col_count)
+{
+    struct visit_ctx *ctx = arg;
+
+    assert(left_col_count == 3);
+    assert(right_col_count == 3);
+    ctx->count++;
+    return ((ctx->stop != 0) && (ctx->count == ctx->stop)) ? 42 : 0;
+}
+
+/*
+ * Publish Z segments in directory dir, each holding C copies of rows
+ * row1 through rowN of table "foo", and subscribe to them all.  The
+ * segments are named after the directory: dir0, dir1 and so on.
+ */
+static void
+foo_publish(char *dir, unsigned C, unsigned Z, unsigned N,
+            TMSTAT *stat_c, TMSTAT *stat_s)
+{
+    int ret;
+    TMTABLE table;
+    TMROW row;
+    struct foo_row *r;
+    char path[PATH_MAX];
+    char name[32];
+
+    snprintf(path, sizeof(path), "%s/%s", tmstat_path, dir);
+    mkdir(path, 0777);
+    for (unsigned z = 0; z < Z; ++z) {
+        snprintf(name, sizeof(name), "%s%u", dir, z);
+        ret = tmstat_create(&stat_c[z], name);
+        assert(ret == 0);
+        ret = tmstat_table_register(
+            stat_c[z], &table, "foo", foo_cols,
+            array_count(foo_cols), sizeof(struct foo_row));
+        assert(ret == 0);
+        ret = tmstat_publish(stat_c[z], dir);
+        assert(ret == 0);
+        for (unsigned i = 1; i <= N; ++i) {
+            for (unsigned j = 0; j < C; ++j) {
+                ret = tmstat_row_create(stat_c[z], table, &row);
+                assert(ret == 0);
+                tmstat_row_field(row, NULL, &r);
+                snprintf(r->text, sizeof(r->text), "row%u", i);
+                r->a = i;
+                r->b = i;
+                r->c = i;
+                tmstat_row_preserve(row);
+                tmstat_row_drop(row);
+            }
+        }
+    }
+    ret = tmstat_subscribe(stat_s, dir);
+    assert(ret == 0);
+}
+
+struct pair_row {
+    unsigned    x;
+    unsigned    y;
+    unsigned    v;
+};
+
+static struct TMCOL pair_cols[] = {
+    TMCOL_UINT(struct pair_row, x),
+    TMCOL_UINT(struct pair_row, y),
+    TMCOL_UINT(struct pair_row, v, .rule = TMSTAT_R_SUM),
+};
+
+/*
+ * Publish a segment named dir_pair in directory dir, holding C copies of
+ * each row of table "pair" with x below 4 and y below 8, all with v 1.
+ */
+static void
+pair_publish(char *dir, unsigned C, TMSTAT *stat_p, TMTABLE *table)
+{
+    int ret;
+    TMROW row;
+    struct pair_row *pr;
+    char path[PATH_MAX];
+    char name[32];
+
+    snprintf(path, sizeof(path), "%s/%s", tmstat_path, dir);
+    mkdir(path, 0777);
+    snprintf(name, sizeof(name), "%s_pair", dir);
+    ret = tmstat_create(stat_p, name);
+    assert(ret == 0);
+    ret = tmstat_table_register(*stat_p, table, "pair", pair_cols,
+        array_count(pair_cols), sizeof(struct pair_row));
+    assert(ret == 0);
+    ret = tmstat_publish(*stat_p, dir);
+    assert(ret == 0);
+    for (unsigned i = 0; i < 4 * 8 * C; ++i) {
+        ret = tmstat_row_create(*stat_p, *table, &row);
+        assert(ret == 0);
+        tmstat_row_field(row, NULL, &pr);
+        pr->x = (i / C) % 4;
+        pr->y = (i / C) / 4;
+        pr->v = 1;
+        tmstat_row_preserve(row);
+        tmstat_row_drop(row);
+    }
+}
+
+static int
+test_visit(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    TMROW *rows;
+    struct foo_row *r;
+    struct visit_ctx ctx;
+    char value[32];
+    char *names[] = { "text" };
+    void *values[] = { value };
+    unsigned count;
+
+    foo_publish("visit", C, Z, N, stat_c, &stat_s);
+
+    /* A writer's rows are merged by key, too. */
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.weight = C;
+    ret = tmstat_query_visit(stat_c[0], "foo", 0, NULL, NULL,
+                             visit_foo, &ctx);
+    assert(ret == 0);
+    assert(ctx.count == N);
+    ret = tmstat_query_count(stat_c[0], "foo", 0, NULL, NULL, &count);
+    assert(ret == 0);
+    assert(count == N);
+
+    /* A subscriber visits each key once, merged across all rows. */
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.weight = C * Z;
+    ret = tmstat_query_visit(stat_s, "foo", 0, NULL, NULL, visit_foo, &ctx);
+    assert(ret == 0);
+    assert(ctx.count == N);
+    ret = tmstat_query_count(stat_s, "foo", 0, NULL, NULL, &count);
+    assert(ret == 0);
+    assert(count == N);
+    ret = tmstat_query(stat_s, "foo", 0, NULL, NULL, NULL, &count);
+    assert(ret == 0);
+    assert(count == N);
+
+    /* Visiting agrees with the handle-based query. */
+    ret = tmstat_query(stat_s, "foo", 0, NULL, NULL, &rows, &count);
+    assert(ret == 0);
+    assert(count == N);
+    for (unsigned i = 0; i < count; ++i) {
+        tmstat_row_field(rows[i], NULL, &r);
+        ctx.count = 0;
+        ret = visit_foo(&ctx, r, foo_cols, array_count(foo_cols));
+        assert(ret == 0);
+        tmstat_row_drop(rows[i]);
+    }
+    free(rows);
+
+    /* Key lookups. */
+    for (unsigned i = 1; i <= N; ++i) {
+        snprintf(value, sizeof(value), "row%u", i);
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.weight = C * Z;
+        ret = tmstat_query_visit(stat_s, "foo", 1, names, values,
+                                 visit_foo, &ctx);
+        assert(ret == 0);
+        assert(ctx.count == 1);
+        ret = tmstat_query_count(stat_s, "foo", 1, names, values, &count);
+        assert(ret == 0);
+        assert(count == 1);
+    }
+    snprintf(value, sizeof(value), "nonesuch");
+    ret = tmstat_query_count(stat_s, "foo", 1, names, values, &count);
+    assert(ret == 0);
+    assert(count == 0);
+
+    /* The visitor may stop the walk early. */
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.weight = C * Z;
+    ctx.stop = 2;
+    ret = tmstat_query_visit(stat_s, "foo", 0, NULL, NULL, visit_foo, &ctx);
+    assert(ret == 42);
+    assert(ctx.count == 2);
+
+    /* Missing tables are empty. */
+    ret = tmstat_query_count(stat_s, "nonesuch", 0, NULL, NULL, &count);
+    assert(ret == 0);
+    assert(count == 0);
+
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test result sets, which hold their rows across a refresh.
+ */
+static int
+test_result(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    TMROW row;
+    TMRESULT result;
+    struct foo_row *r;
+    struct visit_ctx ctx;
+
+    foo_publish("result", C, Z, N, stat_c, &stat_s);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.weight = C * Z;
+    ret = tmstat_query_result(stat_s, "foo", 0, NULL, NULL, &result);
+    assert(ret == 0);
+    assert(tmstat_result_count(result) == N);
+    tmstat_refresh(stat_s, true);
+    for (unsigned i = 0; i < tmstat_result_count(result); ++i) {
+        signed *pa;
+
+        row = tmstat_result_row(result, i);
+        assert(row != NULL);
+        assert(strcmp(tmstat_row_table(row), "foo") == 0);
+        tmstat_row_field(row, NULL, &r);
+        ret = tmstat_row_field(row, "a", &pa);
+        assert(ret == 0);
+        assert(pa == &r->a);
+        ret = visit_foo(&ctx, r, foo_cols, array_count(foo_cols));
+        assert(ret == 0);
+    }
+    assert(tmstat_result_row(result, N) == NULL);
+    tmstat_row_drop(tmstat_result_row(result, 0));
+    tmstat_result_free(result);
+    ret = tmstat_query_result(stat_s, "nonesuch", 0, NULL, NULL, &result);
+    assert(ret == 0);
+    assert(tmstat_result_count(result) == 0);
+    tmstat_result_free(result);
+
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test projections, which widen integers into struct-of-arrays output.
+ */
+static int
+test_project(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    char value[32];
+    char *names[] = { "text" };
+    void *values[] = { value };
+    unsigned count;
+    char text[N][32];
+    int64_t a[N];
+    uint16_t b[N];
+    int32_t c[N];
+    bool seen[N + 1];
+    struct TMPROJ proj[] = {
+        { .name = "text", .size = 0, .out = text },
+        { .name = "a", .size = sizeof(a[0]), .out = a },
+        { .name = "c", .size = sizeof(c[0]), .out = c },
+    };
+
+    foo_publish("project", C, Z, N, stat_c, &stat_s);
+
+    memset(seen, 0, sizeof(seen));
+    ret = tmstat_query_project(stat_s, "foo", 0, NULL, NULL,
+                               proj, array_count(proj), N, &count);
+    assert(ret == 0);
+    assert(count == N);
+    assert(proj[0].size == 0);
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned k;
+        assert(sscanf(text[i], "row%u", &k) == 1);
+        assert(a[i] == k * C * Z);
+        assert(c[i] == k);
+        assert(!seen[k]);
+        seen[k] = true;
+    }
+
+    /* Short arrays still report the full count. */
+    ret = tmstat_query_project(stat_s, "foo", 0, NULL, NULL,
+                               proj, 2, 1, &count);
+    assert(ret == 0);
+    assert(count == N);
+
+    /* Projections are checked even when no row is written. */
+    proj[2].name = "nonesuch";
+    ret = tmstat_query_project(stat_s, "foo", 0, NULL, NULL,
+                               proj, 3, 0, &count);
+    assert(ret == -1);
+    assert(errno == ENOENT);
+    snprintf(value, sizeof(value), "nonesuch");
+    ret = tmstat_query_project(stat_s, "foo", 1, names, values,
+                               proj, 3, N, &count);
+    assert(ret == -1);
+    assert(errno == ENOENT);
+    proj[2].name = "c";
+
+    /* Narrowing is refused. */
+    proj[0].name = "a";
+    proj[0].size = sizeof(b[0]);
+    proj[0].out = b;
+    ret = tmstat_query_project(stat_s, "foo", 0, NULL, NULL,
+                               proj, 1, N, &count);
+    assert(ret == -1);
+    assert(errno == EINVAL);
+
+    proj[0].name = "nonesuch";
+    ret = tmstat_query_project(stat_s, "foo", 0, NULL, NULL,
+                               proj, 1, N, &count);
+    assert(ret == -1);
+    assert(errno == ENOENT);
+
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test predicates on merged and key columns.
+ */
+static int
+test_where(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    TMROW *rows;
+    struct foo_row *r;
+    char value[32];
+    char *names[] = { "text" };
+    void *values[] = { value };
+    unsigned count;
+    int lo = 10 * C * Z, hi = 20 * C * Z, b = 15;
+    char key[32] = "row15";
+    struct TMPRED ge = { .op = TMSTAT_OP_GE, .name = "a", .value = &lo };
+    struct TMPRED lt = { .op = TMSTAT_OP_LT, .name = "a", .value = &hi };
+    struct TMPRED range = { .op = TMSTAT_OP_AND, .left = &ge,
+                            .right = &lt };
+    struct TMPRED ne = { .op = TMSTAT_OP_NE, .name = "text",
+                         .value = key };
+    struct TMPRED eq = { .op = TMSTAT_OP_EQ, .name = "b", .value = &b };
+    struct TMPRED both = { .op = TMSTAT_OP_AND, .left = &range,
+                           .right = &ne };
+    struct TMPRED either = { .op = TMSTAT_OP_OR, .left = &both,
+                             .right = &eq };
+
+    foo_publish("where", C, Z, N, stat_c, &stat_s);
+
+    /* 10 <= i < 20 */
+    ret = tmstat_query_where(stat_s, "foo", 0, NULL, NULL, &range,
+                             &rows, &count);
+    assert(ret == 0);
+    assert(count == 10);
+    for (unsigned i = 0; i < count; ++i) {
+        tmstat_row_field(rows[i], NULL, &r);
+        assert((r->a >= lo) && (r->a < hi));
+        tmstat_row_drop(rows[i]);
+    }
+    free(rows);
+    /* ... but not 15, ... */
+    ret = tmstat_query_where(stat_s, "foo", 0, NULL, NULL, &both,
+                             NULL, &count);
+    assert(ret == 0);
+    assert(count == 9);
+    /* ... or else 15 after all. */
+    ret = tmstat_query_where(stat_s, "foo", 0, NULL, NULL, &either,
+                             NULL, &count);
+    assert(ret == 0);
+    assert(count == 10);
+    /* Combined with a key lookup. */
+    snprintf(value, sizeof(value), "row15");
+    ret = tmstat_query_where(stat_s, "foo", 1, names, values, &either,
+                             NULL, &count);
+    assert(ret == 0);
+    assert(count == 1);
+    ret = tmstat_query_where(stat_s, "foo", 1, names, values, &both,
+                             NULL, &count);
+    assert(ret == 0);
+    assert(count == 0);
+    ge.name = "nonesuch";
+    ret = tmstat_query_where(stat_s, "foo", 0, NULL, NULL, &range,
+                             NULL, &count);
+    assert(ret == -1);
+    assert(errno == ENOENT);
+
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test batched lookups, against both hashed and sorted tables.
+ */
+static int
+test_batch(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+    const unsigned K = N + 2;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    struct foo_row *r;
+    struct visit_ctx ctx;
+    char path[PATH_MAX];
+    char *names[] = { "text" };
+    unsigned count;
+    char keys[K][32];
+    void *kv[K];
+    TMROW found[K];
+    TMSTAT stat_m;
+
+    foo_publish("batch", C, Z, N, stat_c, &stat_s);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.weight = C * Z;
+    for (unsigned k = 0; k < N; ++k) {
+        snprintf(keys[k], sizeof(keys[k]), "row%u", N - k);
+    }
+    snprintf(keys[N], sizeof(keys[N]), "nonesuch");
+    snprintf(keys[N + 1], sizeof(keys[N + 1]), "row1");
+    for (unsigned k = 0; k < K; ++k) {
+        kv[k] = keys[k];
+    }
+    snprintf(path, sizeof(path), "%s/%s/batch_merged", tmstat_path,
+             TMSTAT_DIR_PRIVATE);
+    ret = tmstat_merge(stat_s, path, TMSTAT_MERGE_PUBLIC);
+    assert(ret == 0);
+    ret = tmstat_read(&stat_m, path);
+    assert(ret == 0);
+    assert(tmstat_is_table_sorted(stat_m, "foo"));
+    for (TMSTAT st = stat_s; st != NULL;
+         st = (st == stat_s) ? stat_m : NULL) {
+        ret = tmstat_query_batch(st, "foo", 1, names, kv, K, found,
+                                 &count);
+        assert(ret == 0);
+        assert(count == N + 1);
+        for (unsigned k = 0; k < K; ++k) {
+            if (k == N) {
+                assert(found[k] == NULL);
+                continue;
+            }
+            assert(found[k] != NULL);
+            tmstat_row_field(found[k], NULL, &r);
+            assert(strcmp(r->text, keys[k]) == 0);
+            ctx.count = 0;
+            ret = visit_foo(&ctx, r, foo_cols, array_count(foo_cols));
+            assert(ret == 0);
+            tmstat_row_drop(found[k]);
+        }
+    }
+    /* Partial keys are refused. */
+    ret = tmstat_query_batch(stat_s, "foo", 0, NULL, kv, K, found,
+                             &count);
+    assert(ret == -1);
+    assert(errno == EINVAL);
+
+    tmstat_destroy(stat_m);
+    unlink(path);
+
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test prepared queries, before and after the subscription moves.
+ */
+static int
+test_prepare(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    TMROW *rows;
+    struct foo_row *r;
+    struct visit_ctx ctx;
+    char value[32];
+    char *names[] = { "text" };
+    void *values[] = { value };
+    unsigned count;
+    TMQUERY query;
+
+    foo_publish("prepare", C, Z, N, stat_c, &stat_s);
+
+    ret = tmstat_query_prepare(stat_s, "foo", 1, names, &query);
+    assert(ret == 0);
+    for (unsigned pass = 0; pass < 2; ++pass) {
+        for (unsigned i = 1; i <= N; ++i) {
+            snprintf(value, sizeof(value), "row%u", i);
+            ret = tmstat_query_exec(query, values, &rows, &count);
+            assert(ret == 0);
+            assert(count == 1);
+            tmstat_row_field(rows[0], NULL, &r);
+            assert(strcmp(r->text, value) == 0);
+            assert(r->a == i * C * Z);
+            tmstat_row_drop(rows[0]);
+            free(rows);
+            memset(&ctx, 0, sizeof(ctx));
+            ctx.weight = C * Z;
+            ret = tmstat_query_exec_visit(query, values, visit_foo, &ctx);
+            assert(ret == 0);
+            assert(ctx.count == 1);
+        }
+        snprintf(value, sizeof(value), "nonesuch");
+        ret = tmstat_query_exec(query, values, NULL, &count);
+        assert(ret == 0);
+        assert(count == 0);
+        /* Force the subscription to be rebuilt underneath the query. */
+        tmstat_refresh(stat_s, true);
+    }
+    tmstat_query_free(query);
+
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test that parallel rollups agree with serial ones.
+ */
+static int
+test_parallel(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    struct foo_row *r;
+    char value[32];
+    char *names[] = { "text" };
+    void *values[] = { value };
+
+    foo_publish("parallel", C, Z, N, stat_c, &stat_s);
+
+    for (unsigned k = 0; k < 2; ++k) {
+        TMROW serial, parallel;
+        struct foo_row *p;
+
+        snprintf(value, sizeof(value), "row%u", N / 2);
+        ret = tmstat_query_rollup(stat_s, "foo", k, names, values, &serial);
+        assert(ret == 0);
+        ret = tmstat_set_threads(stat_s, 4);
+        assert(ret == 0);
+        ret = tmstat_query_rollup(stat_s, "foo", k, names, values,
+                                  &parallel);
+        assert(ret == 0);
+        ret = tmstat_set_threads(stat_s, 1);
+        assert(ret == 0);
+        tmstat_row_field(serial, NULL, &r);
+        tmstat_row_field(parallel, NULL, &p);
+        assert(strcmp(r->text, p->text) == 0);
+        assert(r->a == p->a);
+        assert(r->b == p->b);
+        assert(r->c == p->c);
+        assert(p->a == ((k == 0) ? N * (N + 1) / 2 : N / 2) * C * Z);
+        tmstat_row_drop(serial);
+        tmstat_row_drop(parallel);
+    }
+
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test the query planner, which searches sorted tables and scans the rest.
+ */
+static int
+test_explain(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    TMSTAT stat_m;
+    TMROW *rows;
+    struct foo_row *r;
+    char path[PATH_MAX];
+    char value[32];
+    char *text;
+    char *names[] = { "text" };
+    char *pnames[] = { "text", "a" };
+    void *pvalues[] = { value, &(signed){ N * C * Z } };
+    unsigned count;
+
+    foo_publish("explain", C, Z, N, stat_c, &stat_s);
+    snprintf(path, sizeof(path), "%s/%s/explain_merged", tmstat_path,
+             TMSTAT_DIR_PRIVATE);
+    ret = tmstat_merge(stat_s, path, TMSTAT_MERGE_PUBLIC);
+    assert(ret == 0);
+    ret = tmstat_read(&stat_m, path);
+    assert(ret == 0);
+    assert(tmstat_is_table_sorted(stat_m, "foo"));
+
+    ret = tmstat_query_explain(stat_m, "foo", 1, names, &text);
+    assert(ret == 0);
+    assert(strstr(text, "binary search on full key") != NULL);
+    free(text);
+    ret = tmstat_query_explain(stat_m, "foo", 2, pnames, &text);
+    assert(ret == 0);
+    assert(strstr(text, "binary search on 1 of 1 key") != NULL);
+    free(text);
+    ret = tmstat_query_explain(stat_s, "foo", 1, names, &text);
+    assert(ret == 0);
+    assert(strstr(text, "scan all") != NULL);
+    free(text);
+    snprintf(value, sizeof(value), "row%u", N);
+    ret = tmstat_query(stat_m, "foo", 2, pnames, pvalues, &rows, &count);
+    assert(ret == 0);
+    assert(count == 1);
+    tmstat_row_field(rows[0], NULL, &r);
+    assert(strcmp(r->text, value) == 0);
+    tmstat_row_drop(rows[0]);
+    free(rows);
+    snprintf(value, sizeof(value), "nonesuch");
+    ret = tmstat_query_count(stat_m, "foo", 2, pnames, pvalues, &count);
+    assert(ret == 0);
+    assert(count == 0);
+
+    tmstat_destroy(stat_m);
+    unlink(path);
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test top-K queries, which keep the largest merged rows, largest first.
+ */
+static int
+test_top(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    TMROW *rows;
+    struct foo_row *r;
+    char value[32];
+    char *names[] = { "text" };
+    void *values[] = { value };
+    unsigned count;
+
+    foo_publish("top", C, Z, N, stat_c, &stat_s);
+
+    for (unsigned k = 5; k <= N + 1; k += N - 4) {
+        ret = tmstat_query_top(stat_s, "foo", 0, NULL, NULL, NULL, "a", k,
+                               &rows, &count);
+        assert(ret == 0);
+        assert(count == ((k < N) ? k : N));
+        for (unsigned i = 0; i < count; ++i) {
+            tmstat_row_field(rows[i], NULL, &r);
+            assert(r->a == (N - i) * C * Z);
+            tmstat_row_drop(rows[i]);
+        }
+        free(rows);
+    }
+    ret = tmstat_query_top(stat_s, "foo", 0, NULL, NULL, NULL, "nonesuch",
+                           5, &rows, &count);
+    assert(ret == -1);
+    assert(errno == ENOENT);
+    ret = tmstat_query_top(stat_s, "foo", 0, NULL, NULL, NULL, "text", 5,
+                           &rows, &count);
+    assert(ret == -1);
+    assert(errno == EINVAL);
+    /* The sort column is checked even when no row matches. */
+    snprintf(value, sizeof(value), "nonesuch");
+    ret = tmstat_query_top(stat_s, "foo", 1, names, values, NULL,
+                           "nonesuch", 5, &rows, &count);
+    assert(ret == -1);
+    assert(errno == ENOENT);
+    ret = tmstat_query_top(stat_s, "foo", 1, names, values, NULL, "text", 5,
+                           &rows, &count);
+    assert(ret == -1);
+    assert(errno == EINVAL);
+    ret = tmstat_query_top(stat_s, "foo", 0, NULL, NULL, NULL, "text", 0,
+                           &rows, &count);
+    assert(ret == -1);
+    assert(errno == EINVAL);
+
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test group-by queries, which merge on a subset of the key.
+ */
+static int
+test_group(void)
+{
+    const unsigned C = 2;
+
+    int ret;
+    TMSTAT stat_p;
+    TMSTAT stat_s;
+    TMTABLE table;
+    TMROW *rows;
+    struct pair_row *pr;
+    char *gnames[] = { "x", "y", "v" };
+    unsigned count;
+
+    pair_publish("group", C, &stat_p, &table);
+    ret = tmstat_subscribe(&stat_s, "group");
+    assert(ret == 0);
+
+    ret = tmstat_query_group(stat_s, "pair", 0, NULL, NULL, 1, gnames,
+                             &rows, &count);
+    assert(ret == 0);
+    assert(count == 4);
+    for (unsigned i = 0; i < count; ++i) {
+        tmstat_row_field(rows[i], NULL, &pr);
+        assert(pr->x == i);
+        assert(pr->y == 0);
+        assert(pr->v == 8 * C);
+        tmstat_row_drop(rows[i]);
+    }
+    free(rows);
+    ret = tmstat_query_group(stat_s, "pair", 0, NULL, NULL, 2, gnames,
+                             &rows, &count);
+    assert(ret == 0);
+    assert(count == 4 * 8);
+    for (unsigned i = 0; i < count; ++i) {
+        tmstat_row_field(rows[i], NULL, &pr);
+        assert(pr->v == C);
+        tmstat_row_drop(rows[i]);
+    }
+    free(rows);
+    ret = tmstat_query_group(stat_s, "pair", 0, NULL, NULL, 0, gnames,
+                             &rows, &count);
+    assert(ret == 0);
+    assert(count == 1);
+    tmstat_row_field(rows[0], NULL, &pr);
+    assert(pr->v == 4 * 8 * C);
+    tmstat_row_drop(rows[0]);
+    free(rows);
+    ret = tmstat_query_group(stat_s, "pair", 0, NULL, NULL, 1,
+                             &gnames[2], &rows, &count);
+    assert(ret == -1);
+    assert(errno == EINVAL);
+
+    tmstat_destroy(stat_p);
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test joins, which pair rows up on matching column values.
+ */
+static int
+test_join(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_p;
+    TMSTAT stat_s;
+    TMTABLE table;
+    struct visit_ctx ctx;
+    char *jl[] = { "x" }, *jr[] = { "v" }, *ja[] = { "a" };
+
+    foo_publish("join", C, Z, N, stat_c, &stat_s);
+    pair_publish("join", C, &stat_p, &table);
+    tmstat_refresh(stat_s, true);
+
+    memset(&ctx, 0, sizeof(ctx));
+    ret = tmstat_query_join(stat_s, "pair", "pair", 1, jl, jl,
+                            join_pair, &ctx);
+    assert(ret == 0);
+    /* Each x value appears in 8 merged rows: 8 * 8 pairs each. */
+    assert(ctx.count == 4 * 8 * 8);
+    memset(&ctx, 0, sizeof(ctx));
+    ret = tmstat_query_join(stat_s, "pair", "pair", 1, jl, jr,
+                            join_pair, &ctx);
+    assert(ret == 0);
+    /* Only x == 2 matches v == C (2), from every merged row. */
+    assert(ctx.count == 8 * 4 * 8);
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.stop = 3;
+    ret = tmstat_query_join(stat_s, "pair", "pair", 1, jl, jl,
+                            join_pair, &ctx);
+    assert(ret == 42);
+    assert(ctx.count == 3);
+    ret = tmstat_query_join(stat_s, "pair", "foo", 1, jl, ja,
+                            join_pair, &ctx);
+    assert(ret == -1);
+    assert(errno == EINVAL);
+
+    tmstat_destroy(stat_p);
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test unmerged queries, which keep each publisher's rows apart.
+ */
+static int
+test_unmerged(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    TMROW *rows;
+    struct foo_row *r;
+    char value[32];
+    char *names[] = { "text" };
+    void *values[] = { value };
+    unsigned count;
+
+    foo_publish("unmerged", C, Z, N, stat_c, &stat_s);
+
+    snprintf(value, sizeof(value), "row%u", 1);
+    ret = tmstat_query_flags(stat_s, "foo", 1, names, values,
+                             TMSTAT_QUERY_UNMERGED, &rows, &count);
+    assert(ret == 0);
+    assert(count == C * Z);
+    {
+        unsigned per_child[Z];
+
+        memset(per_child, 0, sizeof(per_child));
+        for (unsigned i = 0; i < count; ++i) {
+            unsigned z;
+            tmstat_row_field(rows[i], NULL, &r);
+            assert(r->a == 1);
+            assert(sscanf(tmstat_row_label(rows[i]), "unmerged%u", &z) == 1);
+            assert(z < Z);
+            per_child[z]++;
+            tmstat_row_drop(rows[i]);
+        }
+        for (unsigned z = 0; z < Z; ++z) {
+            assert(per_child[z] == C);
+        }
+    }
+    free(rows);
+    ret = tmstat_query_flags(stat_s, "foo", 0, NULL, NULL,
+                             TMSTAT_QUERY_UNMERGED, NULL, &count);
+    assert(ret == 0);
+    assert(count == N * C * Z);
+
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test selected subscriptions, which only see the matching publishers.
+ */
+static int
+test_select(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    TMSTAT stat_sel;
+    struct visit_ctx ctx;
+    unsigned count;
+
+    foo_publish("select", C, Z, N, stat_c, &stat_s);
+
+    ret = tmstat_subscribe_select(&stat_sel, "select", "select[01]");
+    assert(ret == 0);
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.weight = C * 2;
+    ret = tmstat_query_visit(stat_sel, "foo", 0, NULL, NULL,
+                             visit_foo, &ctx);
+    assert(ret == 0);
+    assert(ctx.count == N);
+    ret = tmstat_select(stat_sel, "select2");
+    assert(ret == 0);
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.weight = C;
+    ret = tmstat_query_visit(stat_sel, "foo", 0, NULL, NULL,
+                             visit_foo, &ctx);
+    assert(ret == 0);
+    assert(ctx.count == N);
+    ret = tmstat_select(stat_sel, "nonesuch*");
+    assert(ret == 0);
+    ret = tmstat_query_count(stat_sel, "foo", 0, NULL, NULL, &count);
+    assert(ret == 0);
+    assert(count == 0);
+    ret = tmstat_select(stat_c[0], "select*");
+    assert(ret == -1);
+    assert(errno == EINVAL);
+    tmstat_dealloc(stat_sel);
+
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test query deadlines: a generous budget covers every child; an empty
+ * one, none.
+ */
+static int
+test_deadline(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    TMROW *rows;
+    struct foo_row *r;
+    unsigned count;
+    unsigned covered, total;
+
+    foo_publish("deadline", C, Z, N, stat_c, &stat_s);
+
+    ret = tmstat_query_deadline(stat_s, "foo", 0, NULL, NULL, 60000,
+                                &rows, &count, &covered, &total);
+    assert(ret == 0);
+    assert(total == Z);
+    assert(covered == Z);
+    assert(count == N);
+    for (unsigned i = 0; i < count; ++i) {
+        tmstat_row_field(rows[i], NULL, &r);
+        assert(r->a == r->b * C * Z);
+        tmstat_row_drop(rows[i]);
+    }
+    free(rows);
+    ret = tmstat_query_deadline(stat_s, "foo", 0, NULL, NULL, 0,
+                                &rows, &count, &covered, &total);
+    assert(ret == 0);
+    assert(total == Z);
+    assert(covered == 0);
+    assert(count == 0);
+    free(rows);
+
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test merging long runs of like columns a vector at a time.
+ */
+static int
+test_wide(void)
+{
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMTABLE table;
+    TMROW row;
+    TMROW *rows;
+    char path[PATH_MAX];
+    char name[10];
+    unsigned count;
+    struct wide_row {
+        uint64_t    key;
+        uint64_t    s0, s1, s2, s3, s4, s5, s6, s7, s8;
+        int64_t     g0, g1, g2, g3, g4;
+        uint32_t    m0, m1, m2, m3, m4, m5;
+        uint8_t     bits[32];
+    } *w;
+    static struct TMCOL wide_cols[] = {
+        TMCOL_UINT(struct wide_row, key),
+        TMCOL_UINT(struct wide_row, s0, .rule = TMSTAT_R_SUM),
+        TMCOL_UINT(struct wide_row, s1, .rule = TMSTAT_R_SUM),
+        TMCOL_UINT(struct wide_row, s2, .rule = TMSTAT_R_SUM),
+        TMCOL_UINT(struct wide_row, s3, .rule = TMSTAT_R_SUM),
+        TMCOL_UINT(struct wide_row, s4, .rule = TMSTAT_R_SUM),
+        TMCOL_UINT(struct wide_row, s5, .rule = TMSTAT_R_SUM),
+        TMCOL_UINT(struct wide_row, s6, .rule = TMSTAT_R_SUM),
+        TMCOL_UINT(struct wide_row, s7, .rule = TMSTAT_R_SUM),
+        TMCOL_UINT(struct wide_row, s8, .rule = TMSTAT_R_SUM),
+        TMCOL_INT(struct wide_row, g0, .rule = TMSTAT_R_MAX),
+        TMCOL_INT(struct wide_row, g1, .rule = TMSTAT_R_MAX),
+        TMCOL_INT(struct wide_row, g2, .rule = TMSTAT_R_MAX),
+        TMCOL_INT(struct wide_row, g3, .rule = TMSTAT_R_MAX),
+        TMCOL_INT(struct wide_row, g4, .rule = TMSTAT_R_MAX),
+        TMCOL_UINT(struct wide_row, m0, .rule = TMSTAT_R_MIN),
+        TMCOL_UINT(struct wide_row, m1, .rule = TMSTAT_R_MIN),
+        TMCOL_UINT(struct wide_row, m2, .rule = TMSTAT_R_MIN),
+        TMCOL_UINT(struct wide_row, m3, .rule = TMSTAT_R_MIN),
+        TMCOL_UINT(struct wide_row, m4, .rule = TMSTAT_R_MIN),
+        TMCOL_UINT(struct wide_row, m5, .rule = TMSTAT_R_MIN),
+        TMCOL_BIN(struct wide_row, bits, .rule = TMSTAT_R_OR),
+    };
+    TMSTAT stat_w[Z], stat_ws;
+    uint64_t *sum;
+    int64_t *gauge;
+    uint32_t *low;
+
+    snprintf(path, sizeof(path), "%s/wide", tmstat_path);
+    mkdir(path, 0777);
+    for (unsigned z = 0; z < Z; ++z) {
+        snprintf(name, sizeof(name), "wide%u", z);
+        ret = tmstat_create(&stat_w[z], name);
+        assert(ret == 0);
+        ret = tmstat_table_register(
+            stat_w[z], &table, "wide", wide_cols,
+            array_count(wide_cols), sizeof(struct wide_row));
+        assert(ret == 0);
+        ret = tmstat_publish(stat_w[z], "wide");
+        assert(ret == 0);
+        for (unsigned i = 0; i < N; ++i) {
+            ret = tmstat_row_create(stat_w[z], table, &row);
+            assert(ret == 0);
+            tmstat_row_field(row, NULL, &w);
+            w->key = i;
+            sum = &w->s0;
+            for (unsigned j = 0; j < 9; ++j) {
+                sum[j] = i + j;
+            }
+            gauge = &w->g0;
+            for (unsigned j = 0; j < 5; ++j) {
+                gauge[j] = ((int64_t)z - 1) * (j + 1);
+            }
+            low = &w->m0;
+            for (unsigned j = 0; j < 6; ++j) {
+                low[j] = 100 + z + j;
+            }
+            for (unsigned j = 0; j < sizeof(w->bits); ++j) {
+                w->bits[j] = 1 << ((z + j) % 8);
+            }
+            tmstat_row_preserve(row);
+            tmstat_row_drop(row);
+        }
+    }
+    ret = tmstat_subscribe(&stat_ws, "wide");
+    assert(ret == 0);
+    ret = tmstat_query(stat_ws, "wide", 0, NULL, NULL, &rows, &count);
+    assert(ret == 0);
+    assert(count == N);
+    for (unsigned i = 0; i < count; ++i) {
+        tmstat_row_field(rows[i], NULL, &w);
+        sum = &w->s0;
+        for (unsigned j = 0; j < 9; ++j) {
+            assert(sum[j] == (w->key + j) * Z);
+        }
+        gauge = &w->g0;
+        for (unsigned j = 0; j < 5; ++j) {
+            assert(gauge[j] == ((int64_t)Z - 2) * (j + 1));
+        }
+        low = &w->m0;
+        for (unsigned j = 0; j < 6; ++j) {
+            assert(low[j] == 100 + j);
+        }
+        for (unsigned j = 0; j < sizeof(w->bits); ++j) {
+            uint8_t bits = 0;
+            for (unsigned z = 0; z < Z; ++z) {
+                bits |= 1 << ((z + j) % 8);
+            }
+            assert(w->bits[j] == bits);
+        }
+        tmstat_row_drop(rows[i]);
+    }
+    free(rows);
+    tmstat_destroy(stat_ws);
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_w[z]);
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test that disjoint tables are put together, not merged.
+ */
+static int
+test_disjoint(void)
+{
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMTABLE table;
+    TMROW row;
+    TMROW *rows;
+    char path[PATH_MAX];
+    char name[10];
+    unsigned count;
+    struct owned_row {
+        unsigned    owner;
+        unsigned    n;
+        unsigned    v;
+    } *o;
+    static struct TMCOL owned_cols[] = {
+        TMCOL_UINT(struct owned_row, owner),
+        TMCOL_UINT(struct owned_row, n),
+        TMCOL_UINT(struct owned_row, v, .rule = TMSTAT_R_SUM),
+    };
+    TMSTAT stat_o[Z], stat_os;
+    TMTABLE shared;
+    char label[10];
+
+    snprintf(path, sizeof(path), "%s/owned", tmstat_path);
+    mkdir(path, 0777);
+    for (unsigned z = 0; z < Z; ++z) {
+        snprintf(name, sizeof(name), "owned%u", z);
+        ret = tmstat_create(&stat_o[z], name);
+        assert(ret == 0);
+        ret = tmstat_table_register_flags(
+            stat_o[z], &table, "owned", owned_cols,
+            array_count(owned_cols), sizeof(struct owned_row),
+            TMSTAT_TABLE_DISJOINT);
+        assert(ret == 0);
+        /* This one breaks its promise: owners share keys. */
+        ret = tmstat_table_register_flags(
+            stat_o[z], &shared, "shared", &owned_cols[1],
+            array_count(owned_cols) - 1, sizeof(struct owned_row),
+            TMSTAT_TABLE_DISJOINT);
+        assert(ret == 0);
+        ret = tmstat_publish(stat_o[z], "owned");
+        assert(ret == 0);
+        for (unsigned i = 0; i < N; ++i) {
+            ret = tmstat_row_create(stat_o[z], table, &row);
+            assert(ret == 0);
+            tmstat_row_field(row, NULL, &o);
+            o->owner = z;
+            o->n = i;
+            o->v = i;
+            tmstat_row_preserve(row);
+            tmstat_row_drop(row);
+            ret = tmstat_row_create(stat_o[z], shared, &row);
+            assert(ret == 0);
+            tmstat_row_field(row, NULL, &o);
+            o->n = i;
+            o->v = i;
+            tmstat_row_preserve(row);
+            tmstat_row_drop(row);
+        }
+    }
+    ret = tmstat_subscribe(&stat_os, "owned");
+    assert(ret == 0);
+    ret = tmstat_query_flags(stat_os, "owned", 0, NULL, NULL,
+                             TMSTAT_QUERY_VERIFY, &rows, &count);
+    assert(ret == 0);
+    assert(count == Z * N);
+    for (unsigned i = 0; i < count; ++i) {
+        /* Each row is still the publisher's own. */
+        tmstat_row_field(rows[i], NULL, &o);
+        assert(o->v == o->n);
+        snprintf(label, sizeof(label), "owned%u", o->owner);
+        assert(strcmp(tmstat_row_label(rows[i]), label) == 0);
+        tmstat_row_drop(rows[i]);
+    }
+    free(rows);
+    ret = tmstat_query(stat_os, "shared", 0, NULL, NULL, &rows, &count);
+    assert(ret == 0);
+    assert(count == Z * N);
+    for (unsigned i = 0; i < count; ++i) {
+        tmstat_row_drop(rows[i]);
+    }
+    free(rows);
+    /* Batched lookups do not merge them either. */
+    {
+        char *n_names[] = { "n" };
+        unsigned keys[2] = { 1, N - 1 };
+        void *kv[2] = { &keys[0], &keys[1] };
+        TMROW found[2];
+
+        ret = tmstat_query_batch(stat_os, "shared", 1, n_names, kv, 2,
+                                 found, &count);
+        assert(ret == 0);
+        assert(count == 2);
+        for (unsigned k = 0; k < 2; ++k) {
+            tmstat_row_field(found[k], NULL, &o);
+            assert(o->n == keys[k]);
+            assert(o->v == keys[k]);
+            tmstat_row_drop(found[k]);
+        }
+    }
+    ret = tmstat_query_flags(stat_os, "shared", 0, NULL, NULL,
+                             TMSTAT_QUERY_VERIFY, &rows, &count);
+    assert(ret == -1);
+    assert(errno == EEXIST);
+    tmstat_destroy(stat_os);
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_o[z]);
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test cached views, which follow each publisher's commits.
+ */
+static int
+test_cached(void)
+{
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMSTAT stat_c[Z];
+    TMSTAT stat_s;
+    TMTABLE table;
+    TMTABLE table_c[Z];
+    TMROW row;
+    TMROW *rows;
+    struct foo_row *r;
+    struct visit_ctx ctx;
+    char path[PATH_MAX];
+    char name[10];
+    char value[32];
+    char *names[] = { "text" };
+    void *values[] = { value };
+    unsigned count;
+    TMROW extra[2];
+
+    snprintf(path, sizeof(path), "%s/cached", tmstat_path);
+    mkdir(path, 0777);
+    for (unsigned z = 0; z < Z; ++z) {
+        snprintf(name, sizeof(name), "cached%u", z);
+        ret = tmstat_create(&stat_c[z], name);
+        assert(ret == 0);
+        ret = tmstat_table_register(
+            stat_c[z], &table, "foo", foo_cols,
+            array_count(foo_cols), sizeof(struct foo_row));
+        assert(ret == 0);
+        table_c[z] = table;
+        ret = tmstat_publish(stat_c[z], "cached");
+        assert(ret == 0);
+        for (unsigned i = 1; i <= N; ++i) {
+            for (unsigned j = 0; j < C; ++j) {
+                ret = tmstat_row_create(stat_c[z], table, &row);
+                assert(ret == 0);
+                tmstat_row_field(row, NULL, &r);
+                snprintf(r->text, sizeof(r->text), "row%u", i);
+                r->a = i;
+                r->b = i;
+                r->c = i;
+                tmstat_row_preserve(row);
+                tmstat_row_drop(row);
+            }
+        }
+    }
+    ret = tmstat_subscribe(&stat_s, "cached");
+    assert(ret == 0);
+
+    ret = tmstat_query_flags(stat_s, "foo", 0, NULL, NULL,
+                             TMSTAT_QUERY_CACHED, &rows, &count);
+    assert(ret == 0);
+    assert(count == N);
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.weight = C * Z;
+    for (unsigned i = 0; i < count; ++i) {
+        tmstat_row_field(rows[i], NULL, &r);
+        ret = visit_foo(&ctx, r, foo_cols, array_count(foo_cols));
+        assert(ret == 0);
+        tmstat_row_drop(rows[i]);
+    }
+    free(rows);
+
+    /* New rows are seen, but changes only once they are committed. */
+    ret = tmstat_row_create(stat_c[1], table_c[1], &extra[0]);
+    assert(ret == 0);
+    tmstat_row_field(extra[0], NULL, &r);
+    snprintf(r->text, sizeof(r->text), "row1");
+    r->a = 0;
+    r->b = 0;
+    r->c = 0;
+    snprintf(value, sizeof(value), "row1");
+    ret = tmstat_query_flags(stat_s, "foo", 1, names, values,
+                             TMSTAT_QUERY_CACHED, &rows, &count);
+    assert(ret == 0);
+    assert(count == 1);
+    tmstat_row_field(rows[0], NULL, &r);
+    assert(r->a == C * Z);
+    tmstat_row_drop(rows[0]);
+    free(rows);
+    tmstat_row_field(extra[0], NULL, &r);
+    r->a = 100;
+    r->c = 1000;
+    ret = tmstat_query_flags(stat_s, "foo", 1, names, values,
+                             TMSTAT_QUERY_CACHED, &rows, &count);
+    assert(ret == 0);
+    assert(count == 1);
+    tmstat_row_field(rows[0], NULL, &r);
+    assert(r->a == C * Z);
+    tmstat_row_drop(rows[0]);
+    free(rows);
+    ret = tmstat_commit(stat_c[1]);
+    assert(ret == 0);
+    ret = tmstat_query_flags(stat_s, "foo", 1, names, values,
+                             TMSTAT_QUERY_CACHED, &rows, &count);
+    assert(ret == 0);
+    assert(count == 1);
+    tmstat_row_field(rows[0], NULL, &r);
+    assert(r->a == C * Z + 100);
+    assert(r->b == 0);
+    assert(r->c == 1000);
+    tmstat_row_drop(rows[0]);
+    free(rows);
+
+    /* New keys come and go. */
+    ret = tmstat_row_create(stat_c[2], table_c[2], &extra[1]);
+    assert(ret == 0);
+    tmstat_row_field(extra[1], NULL, &r);
+    snprintf(r->text, sizeof(r->text), "row%u", N + 1);
+    r->a = N + 1;
+    r->b = N + 1;
+    r->c = N + 1;
+    ret = tmstat_commit(stat_c[2]);
+    assert(ret == 0);
+    ret = tmstat_query_flags(stat_s, "foo", 0, NULL, NULL,
+                             TMSTAT_QUERY_CACHED, NULL, &count);
+    assert(ret == 0);
+    assert(count == N + 1);
+    tmstat_row_drop(extra[0]);
+    tmstat_row_drop(extra[1]);
+    ret = tmstat_query_flags(stat_s, "foo", 0, NULL, NULL,
+                             TMSTAT_QUERY_CACHED, &rows, &count);
+    assert(ret == 0);
+    assert(count == N);
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.weight = C * Z;
+    for (unsigned i = 0; i < count; ++i) {
+        tmstat_row_field(rows[i], NULL, &r);
+        ret = visit_foo(&ctx, r, foo_cols, array_count(foo_cols));
+        assert(ret == 0);
+        tmstat_row_drop(rows[i]);
+    }
+    free(rows);
+
+    ret = tmstat_query_flags(stat_s, "foo", 0, NULL, NULL,
+                             TMSTAT_QUERY_CACHED | TMSTAT_QUERY_UNMERGED,
+                             &rows, &count);
+    assert(ret == -1);
+    assert(errno == EINVAL);
+    ret = tmstat_commit(stat_s);
+    assert(ret == -1);
+    assert(errno == EINVAL);
+
+    /* Cached sums take a publisher's old rows back out. */
+    {
+        struct pair_row *pr;
+        char *gnames[] = { "x", "y" };
+        unsigned zero = 0;
+        void *pvalues[] = { &zero, &zero };
+        TMSTAT stat_p;
+
+        pair_publish("cached", C, &stat_p, &table);
+        tmstat_refresh(stat_s, true);
+
+        ret = tmstat_query_flags(stat_s, "pair", 0, NULL, NULL,
+                                 TMSTAT_QUERY_CACHED, &rows, &count);
+        assert(ret == 0);
+        assert(count == 4 * 8);
+        for (unsigned i = 0; i < count; ++i) {
+            tmstat_row_field(rows[i], NULL, &pr);
+            assert(pr->v == C);
+            tmstat_row_drop(rows[i]);
+        }
+        free(rows);
+        ret = tmstat_row_create(stat_p, table, &row);
+        assert(ret == 0);
+        tmstat_row_field(row, NULL, &pr);
+        for (unsigned v = 5; v <= 6; ++v) {
+            pr->v = v;
+            ret = tmstat_commit(stat_p);
+            assert(ret == 0);
+            ret = tmstat_query_flags(stat_s, "pair", 2, gnames, pvalues,
+                                     TMSTAT_QUERY_CACHED, &rows, &count);
+            assert(ret == 0);
+            assert(count == 1);
+            tmstat_row_field(rows[0], NULL, &pr);
+            assert(pr->v == C + v);
+            tmstat_row_drop(rows[0]);
+            free(rows);
+            tmstat_row_field(row, NULL, &pr);
+        }
+        tmstat_row_drop(row);
+        ret = tmstat_commit(stat_p);
+        assert(ret == 0);
+        ret = tmstat_query_flags(stat_s, "pair", 2, gnames, pvalues,
+                                 TMSTAT_QUERY_CACHED, &rows, &count);
+        assert(ret == 0);
+        assert(count == 1);
+        tmstat_row_field(rows[0], NULL, &pr);
+        assert(pr->v == C);
+        tmstat_row_drop(rows[0]);
+        free(rows);
+        tmstat_destroy(stat_p);
+    }
+
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_c[z]);
+    }
+    tmstat_destroy(stat_s);
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test rollups answered from the aggregates publishers maintain.
+ */
+static int
+test_rollup_maintained(void)
+{
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+
+    int ret;
+    TMTABLE table;
+    TMROW row;
+    char path[PATH_MAX];
+    char name[10];
+    unsigned count;
+    struct tot_row {
+        unsigned    n;
+        unsigned    v;
+    } tot, *t;
+    static struct TMCOL tot_cols[] = {
+        TMCOL_UINT(struct tot_row, n),
+        TMCOL_UINT(struct tot_row, v, .rule = TMSTAT_R_SUM),
+    };
+    TMSTAT stat_t[Z], stat_ts;
+    TMROW last[Z];
+
+    snprintf(path, sizeof(path), "%s/tot", tmstat_path);
+    mkdir(path, 0777);
+    for (unsigned z = 0; z < Z; ++z) {
+        snprintf(name, sizeof(name), "tot%u", z);
+        ret = tmstat_create(&stat_t[z], name);
+        assert(ret == 0);
+        ret = tmstat_table_register_flags(
+            stat_t[z], &table, "tot", tot_cols, array_count(tot_cols),
+            sizeof(struct tot_row), TMSTAT_TABLE_ROLLUP);
+        assert(ret == 0);
+        ret = tmstat_publish(stat_t[z], "tot");
+        assert(ret == 0);
+        for (unsigned i = 0; i < N; ++i) {
+            ret = tmstat_row_create(stat_t[z], table, &row);
+            assert(ret == 0);
+            tmstat_row_field(row, NULL, &t);
+            t->n = i;
+            t->v = i;
+            if (i < N - 1) {
+                tmstat_row_preserve(row);
+                tmstat_row_drop(row);
+            } else {
+                last[z] = row;
+            }
+        }
+        ret = tmstat_commit(stat_t[z]);
+        assert(ret == 0);
+    }
+    ret = tmstat_subscribe(&stat_ts, "tot");
+    assert(ret == 0);
+    ret = tmstat_query(stat_ts, ".rollup/tot", 0, NULL, NULL,
+                       NULL, &count);
+    assert(ret == 0);
+    assert(count == 1);
+    ret = tmstat_query_rollup_data(stat_ts, "tot", 0, NULL, NULL,
+                                   &tot, sizeof(tot));
+    assert(ret == 0);
+    assert(tot.v == Z * N * (N - 1) / 2);
+    /* Updates show once committed. */
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_row_field(last[z], NULL, &t);
+        t->v++;
+    }
+    ret = tmstat_query_rollup_data(stat_ts, "tot", 0, NULL, NULL,
+                                   &tot, sizeof(tot));
+    assert(ret == 0);
+    assert(tot.v == Z * N * (N - 1) / 2);
+    for (unsigned z = 0; z < Z; ++z) {
+        ret = tmstat_commit(stat_t[z]);
+        assert(ret == 0);
+    }
+    ret = tmstat_query_rollup_data(stat_ts, "tot", 0, NULL, NULL,
+                                   &tot, sizeof(tot));
+    assert(ret == 0);
+    assert(tot.v == Z * N * (N - 1) / 2 + Z);
+    /* Keyed rollups still scan. */
+    {
+        char *n_name[] = { "n" };
+        unsigned n = N - 1;
+        void *n_value[] = { &n };
+
+        ret = tmstat_query_rollup(stat_ts, "tot", 1, n_name, n_value,
+                                  &row);
+        assert(ret == 0);
+        tmstat_row_field(row, NULL, &t);
+        assert(t->v == Z * N);
+        tmstat_row_drop(row);
+    }
+    tmstat_destroy(stat_ts);
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_row_drop(last[z]);
+        tmstat_destroy(stat_t[z]);
+    }
+
+    /* Empty or unfolded aggregates stand for nothing. */
+    {
+        struct lo_row {
+            unsigned    k;
+            unsigned    lo;
+        } lo, *l;
+        static struct TMCOL lo_cols[] = {
+            TMCOL_UINT(struct lo_row, k),
+            TMCOL_UINT(struct lo_row, lo, .rule = TMSTAT_R_MIN),
+        };
+        char *k_name[] = { "k" };
+        unsigned k = 1;
+        void *k_value[] = { &k };
+        TMSTAT stat_l[3], stat_lu;
+
+        for (unsigned z = 0; z < 3; ++z) {
+            snprintf(name, sizeof(name), "lo%u", z);
+            ret = tmstat_create(&stat_l[z], name);
+            assert(ret == 0);
+        }
+        /* One child with a row, one empty, one registered too late. */
+        ret = tmstat_table_register_flags(
+            stat_l[0], &table, "lo", lo_cols, array_count(lo_cols),
+            sizeof(struct lo_row), TMSTAT_TABLE_ROLLUP);
+        assert(ret == 0);
+        ret = tmstat_row_create(stat_l[0], table, &row);
+        assert(ret == 0);
+        tmstat_row_field(row, NULL, &l);
+        l->k = 1;
+        l->lo = 50;
+        tmstat_row_preserve(row);
+        tmstat_row_drop(row);
+        ret = tmstat_table_register_flags(
+            stat_l[1], &table, "lo", lo_cols, array_count(lo_cols),
+            sizeof(struct lo_row), TMSTAT_TABLE_ROLLUP);
+        assert(ret == 0);
+        for (unsigned z = 0; z < 3; ++z) {
+            ret = tmstat_commit(stat_l[z]);
+            assert(ret == 0);
+        }
+        ret = tmstat_union(&stat_lu, stat_l, 2);
+        assert(ret == 0);
+        ret = tmstat_query_rollup_data(stat_lu, "lo", 0, NULL, NULL,
+                                       &lo, sizeof(lo));
+        assert(ret == 0);
+        assert(lo.lo == 50);
+        ret = tmstat_query_rollup_data(stat_lu, "lo", 1, k_name, k_value,
+                                       &lo, sizeof(lo));
+        assert(ret == 0);
+        assert(lo.lo == 50);
+        tmstat_destroy(stat_lu);
+
+        ret = tmstat_table_register_flags(
+            stat_l[2], &table, "lo", lo_cols, array_count(lo_cols),
+            sizeof(struct lo_row), TMSTAT_TABLE_ROLLUP);
+        assert(ret == 0);
+        ret = tmstat_union(&stat_lu, &stat_l[2], 1);
+        assert(ret == 0);
+        ret = tmstat_query_rollup_data(stat_lu, "lo", 0, NULL, NULL,
+                                       &lo, sizeof(lo));
+        assert(ret == -1);
+        assert(errno == ENOENT);
+        ret = tmstat_row_create(stat_l[2], table, &row);
+        assert(ret == 0);
+        tmstat_row_field(row, NULL, &l);
+        l->k = 1;
+        l->lo = 70;
+        tmstat_row_preserve(row);
+        tmstat_row_drop(row);
+        ret = tmstat_query_rollup_data(stat_lu, "lo", 0, NULL, NULL,
+                                       &lo, sizeof(lo));
+        assert(ret == 0);
+        assert(lo.lo == 70);
+        tmstat_destroy(stat_lu);
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Test lazily merged query results, including against rows retired in
+ * the meantime.
+ */
+static int
+test_lazy(void)
+{
+    struct lazy_row {
+        unsigned    k;
+        unsigned    v;
+        uint8_t     odd[3];
+    } *l;
+    static struct TMCOL lazy_cols[] = {
+        TMCOL_UINT(struct lazy_row, k),
+        TMCOL_UINT(struct lazy_row, v, .rule = TMSTAT_R_SUM),
+        /* No kernel sums three bytes, so this column fails to merge. */
+        TMCOL_BIN(struct lazy_row, odd, .rule = TMSTAT_R_SUM),
+    };
+    const unsigned C = 2;
+    const unsigned Z = 3;
+    const unsigned N = SMALL_SIZE;
+    TMSTAT stat_f[Z], stat_s;
+    TMSTAT stat_c[2], stat_u;
+    TMTABLE table[2];
+    TMROW row[2], *rows;
+    struct foo_row *r;
+    struct visit_ctx ctx;
+    char name[32];
+    unsigned count;
+    void *old;
+    int ret;
+
+    /* Lazy queries merge each column as it is read. */
+    foo_publish("lazy", C, Z, N, stat_f, &stat_s);
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.weight = C * Z;
+    ret = tmstat_query_flags(stat_s, "foo", 0, NULL, NULL,
+                             TMSTAT_QUERY_LAZY, &rows, &count);
+    assert(ret == 0);
+    assert(count == N);
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned k;
+        signed *a;
+        assert(tmstat_row_field(rows[i], "text", &r) == 0);
+        assert(sscanf(r->text, "row%u", &k) == 1);
+        assert(tmstat_row_field_signed(rows[i], "a") == k * C * Z);
+        assert(tmstat_row_field(rows[i], "a", &a) == 0);
+        assert(*a == k * C * Z);
+        tmstat_row_field(rows[i], NULL, &r);
+        ctx.count = 0;
+        ret = visit_foo(&ctx, r, foo_cols, array_count(foo_cols));
+        assert(ret == 0);
+        tmstat_row_drop(rows[i]);
+    }
+    free(rows);
+    for (unsigned z = 0; z < Z; ++z) {
+        tmstat_destroy(stat_f[z]);
+    }
+    tmstat_destroy(stat_s);
+
+    /* A key's slot may be retired and reused under a lazy row. */
+    for (unsigned z = 0; z < 2; ++z) {
+        snprintf(name, sizeof(name), "lazy_c%u", z);
+        ret = tmstat_create(&stat_c[z], name);
+        assert(ret == 0);
+        ret = tmstat_table_register(stat_c[z], &table[z], "lazy", lazy_cols,
+                                    array_count(lazy_cols),
+                                    sizeof(struct lazy_row));
+        assert(ret == 0);
+        ret = tmstat_row_create(stat_c[z], table[z], &row[z]);
+        assert(ret == 0);
+        tmstat_row_field(row[z], NULL, &l);
+        l->k = 1;
+        l->v = 10;
+    }
+    ret = tmstat_union(&stat_u, stat_c, 2);
+    assert(ret == 0);
+    ret = tmstat_query_flags(stat_u, "lazy", 0, NULL, NULL,
+                             TMSTAT_QUERY_LAZY, &rows, &count);
+    assert(ret == 0);
+    assert(count == 1);
+
+    /* The second publisher retires key 1; key 2 takes its slot. */
+    tmstat_row_field(row[1], NULL, &old);
+    tmstat_row_drop(row[1]);
+    ret = tmstat_row_create(stat_c[1], table[1], &row[1]);
+    assert(ret == 0);
+    tmstat_row_field(row[1], NULL, &l);
+    assert((void *)l == old);
+    l->k = 2;
+    l->v = 99;
+
+    /* Only the first publisher's row is left to count. */
+    assert(tmstat_row_field_unsigned(rows[0], "k") == 1);
+    assert(tmstat_row_field_unsigned(rows[0], "v") == 10);
+    tmstat_row_drop(rows[0]);
+    free(rows);
+    tmstat_row_drop(row[0]);
+    tmstat_row_drop(row[1]);
+
+    /* A field that fails to merge reads as 0, with errno set. */
+    for (unsigned z = 0; z < 2; ++z) {
+        ret = tmstat_row_create(stat_c[z], table[z], &row[z]);
+        assert(ret == 0);
+        tmstat_row_field(row[z], NULL, &l);
+        l->k = 3;
+        l->v = 1;
+    }
+    ret = tmstat_query_flags(stat_u, "lazy", 0, NULL, NULL,
+                             TMSTAT_QUERY_LAZY, &rows, &count);
+    assert(ret == 0);
+    assert(count == 1);
+    errno = 0;
+    assert(tmstat_row_field_unsigned(rows[0], "v") == 2);
+    assert(errno == 0);
+    assert(tmstat_row_field_unsigned(rows[0], "odd") == 0);
+    assert(errno == EINVAL);
+    errno = 0;
+    assert(tmstat_row_field_signed(rows[0], "odd") == 0);
+    assert(errno == EINVAL);
+    errno = 0;
+    assert(tmstat_row_field_signed(rows[0], "nonesuch") == 0);
+    assert(errno == ENOENT);
+    errno = 0;
+    assert(tmstat_row_field_unsigned(rows[0], "nonesuch") == 0);
+    assert(errno == ENOENT);
+    tmstat_row_drop(rows[0]);
+    free(rows);
+    tmstat_row_drop(row[0]);
+    tmstat_row_drop(row[1]);
+    tmstat_destroy(stat_u);
+    return EXIT_SUCCESS;
+}
+
 /*
  * Test our resilience in the face of modifications to a segment that
  * is being read.  We don't test real synchronicity: We alternately
@@ -3360,6 +5316,44 @@ main(int argc, char * const argv[])
                 ret = test_long_keys();
             } else if (strcmp(optarg, "unterminated-keys") == 0) {
                 ret = test_unterminated_keys();
+            } else if (strcmp(optarg, "visit") == 0) {
+                ret = test_visit();
+            } else if (strcmp(optarg, "result") == 0) {
+                ret = test_result();
+            } else if (strcmp(optarg, "project") == 0) {
+                ret = test_project();
+            } else if (strcmp(optarg, "where") == 0) {
+                ret = test_where();
+            } else if (strcmp(optarg, "batch") == 0) {
+                ret = test_batch();
+            } else if (strcmp(optarg, "prepare") == 0) {
+                ret = test_prepare();
+            } else if (strcmp(optarg, "parallel") == 0) {
+                ret = test_parallel();
+            } else if (strcmp(optarg, "explain") == 0) {
+                ret = test_explain();
+            } else if (strcmp(optarg, "top") == 0) {
+                ret = test_top();
+            } else if (strcmp(optarg, "group") == 0) {
+                ret = test_group();
+            } else if (strcmp(optarg, "join") == 0) {
+                ret = test_join();
+            } else if (strcmp(optarg, "unmerged") == 0) {
+                ret = test_unmerged();
+            } else if (strcmp(optarg, "select") == 0) {
+                ret = test_select();
+            } else if (strcmp(optarg, "deadline") == 0) {
+                ret = test_deadline();
+            } else if (strcmp(optarg, "wide") == 0) {
+                ret = test_wide();
+            } else if (strcmp(optarg, "disjoint") == 0) {
+                ret = test_disjoint();
+            } else if (strcmp(optarg, "cached") == 0) {
+                ret = test_cached();
+            } else if (strcmp(optarg, "lazy") == 0) {
+                ret = test_lazy();
+            } else if (strcmp(optarg, "rollup-maintained") == 0) {
+                ret = test_rollup_maintained();
             } else {
                 ret = EXIT_FAILURE;
                 warnx("unknown test: `%s'", optarg);